@@ -0,0 +1,15 @@
+-- Migration: v2 -> v3
+-- Single-row counter from which each app instance leases blocks of ids;
+-- ids are scrambled into 7-char base62 codes, so new codes never collide.
+
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS short_code_allocator (
+    id      SMALLINT PRIMARY KEY DEFAULT 1 CHECK (id = 1),
+    next_id BIGINT   NOT NULL CHECK (next_id >= 0)
+);
+
+INSERT INTO short_code_allocator(id, next_id) VALUES (1, 0)
+ON CONFLICT (id) DO NOTHING;
+
+COMMIT;
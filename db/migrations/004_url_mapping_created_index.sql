@@ -0,0 +1,7 @@
+-- Migration: v3 -> v4
+-- Lets the startup cache warm-up read the newest links across all users
+-- without sorting the whole table.
+-- CONCURRENTLY cannot run inside a transaction block, so there is no BEGIN.
+
+CREATE INDEX CONCURRENTLY IF NOT EXISTS idx_url_mapping_created
+    ON url_mapping(created_at DESC, code DESC);
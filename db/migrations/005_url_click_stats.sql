@@ -0,0 +1,14 @@
+-- Migration: v4 -> v5
+-- Per-link click counts, written in batches by each app instance's click
+-- flusher. No foreign key: a flush must not fail because one link expired
+-- and was cleaned up while its clicks were buffered.
+
+BEGIN;
+
+CREATE TABLE IF NOT EXISTS url_click_stats (
+    code          VARCHAR(16) PRIMARY KEY,
+    clicks        BIGINT      NOT NULL DEFAULT 0 CHECK (clicks >= 0),
+    last_click_at TIMESTAMPTZ NOT NULL
+);
+
+COMMIT;
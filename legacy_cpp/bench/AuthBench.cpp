@@ -0,0 +1,70 @@
+#include "security/JwtService.h"
+#include "security/PasswordHasher.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+const JwtService& benchJwtService() {
+    static const JwtService service("bench-secret-0123456789abcdef", std::chrono::seconds{3600});
+    return service;
+}
+
+void BM_JwtIssueToken(benchmark::State& state) {
+    const auto& jwt = benchJwtService();
+    for (auto _ : state) {
+        auto token = jwt.issueToken(42, "Bench User", "bench@example.com");
+        benchmark::DoNotOptimize(token);
+    }
+}
+BENCHMARK(BM_JwtIssueToken);
+
+void BM_JwtVerify(benchmark::State& state) {
+    const auto& jwt = benchJwtService();
+    const auto token = jwt.issueToken(42, "Bench User", "bench@example.com");
+    for (auto _ : state) {
+        auto claims = jwt.verify(token);
+        benchmark::DoNotOptimize(claims);
+    }
+}
+BENCHMARK(BM_JwtVerify);
+
+// Cycles through more distinct tokens than the per-thread cache holds, so
+// most iterations take the full decode + HMAC path.
+void BM_JwtVerifyUncached(benchmark::State& state) {
+    const auto& jwt = benchJwtService();
+    std::vector<std::string> tokens;
+    for (long i = 0; i < 1024; ++i) {
+        tokens.push_back(jwt.issueToken(i, "Bench User", "bench@example.com"));
+    }
+    size_t next = 0;
+    for (auto _ : state) {
+        auto claims = jwt.verify(tokens[next]);
+        benchmark::DoNotOptimize(claims);
+        next = (next + 1) % tokens.size();
+    }
+}
+BENCHMARK(BM_JwtVerifyUncached);
+
+void BM_JwtVerifyBadSignature(benchmark::State& state) {
+    const auto& jwt = benchJwtService();
+    auto token = jwt.issueToken(42, "Bench User", "bench@example.com");
+    token.back() = token.back() == 'A' ? 'B' : 'A';
+    for (auto _ : state) {
+        auto claims = jwt.verify(token);
+        benchmark::DoNotOptimize(claims);
+    }
+}
+BENCHMARK(BM_JwtVerifyBadSignature);
+
+// 120k PBKDF2 iterations: expect tens of milliseconds per call.
+void BM_PasswordHasherVerify(benchmark::State& state) {
+    const auto stored = PasswordHasher::hash("correct horse battery staple");
+    for (auto _ : state) {
+        auto ok = PasswordHasher::verify("correct horse battery staple", stored);
+        benchmark::DoNotOptimize(ok);
+    }
+}
+BENCHMARK(BM_PasswordHasherVerify)->Unit(benchmark::kMillisecond);
+}  // namespace
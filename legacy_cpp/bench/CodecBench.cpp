@@ -0,0 +1,47 @@
+#include "security/JwtService.h"
+#include "utils.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace {
+void BM_Base62EncodeFast7(benchmark::State& state) {
+    std::mt19937_64 rng{42};
+    uint64_t value = rng();
+    for (auto _ : state) {
+        auto code = Base62::encodeFast7(value);
+        benchmark::DoNotOptimize(code);
+        value += 0x9e3779b97f4a7c15ULL;
+    }
+}
+BENCHMARK(BM_Base62EncodeFast7);
+
+std::string payloadOfSize(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>((i * 131) & 0xff);
+    }
+    return data;
+}
+
+void BM_Base64UrlEncode(benchmark::State& state) {
+    const auto data = payloadOfSize(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        auto encoded = JwtService::base64UrlEncode(data);
+        benchmark::DoNotOptimize(encoded);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Base64UrlEncode)->Arg(32)->Arg(128)->Arg(512);
+
+void BM_Base64UrlDecode(benchmark::State& state) {
+    const auto encoded = JwtService::base64UrlEncode(payloadOfSize(static_cast<size_t>(state.range(0))));
+    for (auto _ : state) {
+        auto decoded = JwtService::base64UrlDecode(encoded);
+        benchmark::DoNotOptimize(decoded);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Base64UrlDecode)->Arg(32)->Arg(128)->Arg(512);
+}  // namespace
@@ -0,0 +1,39 @@
+#include "JsonResponses.h"
+#include <benchmark/benchmark.h>
+#include <json/json.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+// The shorten reply, as handleShorten builds it.
+void BM_ShortenJsonResponse(benchmark::State& state) {
+    const std::string baseUrl = "https://myurlshortener.westus3.cloudapp.azure.com";
+    for (auto _ : state) {
+        Json::Value response;
+        response["code"] = "a1B2c3D";
+        response["short"] = baseUrl + "/a1B2c3D";
+        auto resp = responses::json(response);
+        benchmark::DoNotOptimize(resp);
+    }
+}
+BENCHMARK(BM_ShortenJsonResponse);
+
+// A link-list page body with state.range(0) items.
+void BM_ListJsonResponse(benchmark::State& state) {
+    const std::string baseUrl = "https://myurlshortener.westus3.cloudapp.azure.com";
+    std::vector<DataStore::UrlListItem> rows(static_cast<size_t>(state.range(0)));
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i].code = "a1B2c3D";
+        rows[i].url = "https://example.com/some/long/path?campaign=spring&item=" + std::to_string(i);
+        rows[i].createdAt = std::chrono::system_clock::now();
+        rows[i].clicks = i * 17;
+    }
+    for (auto _ : state) {
+        auto body = responses::listBody(rows, baseUrl);
+        benchmark::DoNotOptimize(body);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ListJsonResponse)->Arg(50)->Arg(200);
+}  // namespace
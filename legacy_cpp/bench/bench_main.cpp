@@ -0,0 +1,5 @@
+#include <benchmark/benchmark.h>
+
+// Run with --benchmark_format=json (or scripts/run_benchmarks.sh) for
+// machine-readable output that can be diffed between releases.
+BENCHMARK_MAIN();
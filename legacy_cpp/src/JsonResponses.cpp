@@ -0,0 +1,74 @@
+#include "JsonResponses.h"
+#include <chrono>
+
+namespace responses {
+drogon::HttpResponsePtr json(const Json::Value& data, drogon::HttpStatusCode status) {
+    auto resp = drogon::HttpResponse::newHttpJsonResponse(data);
+    resp->setStatusCode(status);
+    return resp;
+}
+
+void appendJsonString(std::string& out, std::string_view value) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (const char c : value) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += kHex[(c >> 4) & 0xf];
+                    out += kHex[c & 0xf];
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+int64_t epochSeconds(DataStore::TimePoint when) {
+    return std::chrono::duration_cast<std::chrono::seconds>(when.time_since_epoch()).count();
+}
+
+void appendListItem(std::string& out, const DataStore::UrlListItem& item, const std::string& baseUrl) {
+    out += "{\"code\":";
+    appendJsonString(out, item.code);
+    out += ",\"url\":";
+    appendJsonString(out, item.url);
+    out += ",\"short\":";
+    appendJsonString(out, baseUrl + "/" + item.code);
+    out += ",\"created_at\":";
+    out += std::to_string(epochSeconds(item.createdAt));
+    if (item.expiresAt) {
+        out += ",\"expires_at\":";
+        out += std::to_string(epochSeconds(*item.expiresAt));
+    }
+    out += ",\"clicks\":";
+    out += std::to_string(item.clicks);
+    if (item.lastClickAt) {
+        out += ",\"last_click_at\":";
+        out += std::to_string(epochSeconds(*item.lastClickAt));
+    }
+    out += '}';
+}
+
+std::string listBody(const std::vector<DataStore::UrlListItem>& rows, const std::string& baseUrl) {
+    std::string body;
+    body.reserve(rows.size() * 160 + 2);
+    body += '[';
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i > 0) {
+            body += ',';
+        }
+        appendListItem(body, rows[i], baseUrl);
+    }
+    body += ']';
+    return body;
+}
+}  // namespace responses
@@ -0,0 +1,24 @@
+#pragma once
+#include "services/DataStore.h"
+#include <drogon/HttpResponse.h>
+#include <json/json.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Response bodies shared by the URL handlers, kept out of
+// UrlShortenerService so the benchmarks time the code that serves requests.
+namespace responses {
+drogon::HttpResponsePtr json(const Json::Value& data, drogon::HttpStatusCode status = drogon::k200OK);
+
+int64_t epochSeconds(DataStore::TimePoint when);
+
+void appendJsonString(std::string& out, std::string_view value);
+
+// Serializes a list row straight to JSON text; no Json::Value per row.
+void appendListItem(std::string& out, const DataStore::UrlListItem& item, const std::string& baseUrl);
+
+// The JSON array a link-list page answers with.
+std::string listBody(const std::vector<DataStore::UrlListItem>& rows, const std::string& baseUrl);
+}  // namespace responses
@@ -1,31 +1,196 @@
 #include "UrlShortenerService.h"
+#include "JsonResponses.h"
+#include "logging/Log.h"
+#include "metrics/Metrics.h"
+#include "security/JwtService.h"
+#include "services/BulkInputReader.h"
 #include "utils.h"
 #include <algorithm>
 #include <chrono>
 #include <cstdlib>
-#include <random>
+#include <mutex>
 
 using namespace std;
 using namespace drogon;
 using SystemClock = std::chrono::system_clock;
 
+namespace {
+// Write-back TTL for links resolved from the DB without their own expiry.
+constexpr std::chrono::seconds kResolveCacheTtl{300};
+constexpr int kMaxShortenAttempts = 5;
+
+// Bulk shorten keeps at most this many rows in flight per request and
+// refills once half have completed, so memory stays flat however long the
+// body is and results go out in batch-sized chunks.
+constexpr size_t kBulkWindow = 512;
+constexpr size_t kBulkFlushBytes = 16 * 1024;
+// The app-wide client_max_body_size stays small for the JSON endpoints; the
+// bulk handler reads its own body off the request stream up to this cap.
+constexpr size_t kBulkMaxBodyBytes = 64 * 1024 * 1024;
+// Drogon cannot pause a request stream, so a client uploading faster than
+// rows commit is cut off once this much input is waiting to be parsed.
+constexpr size_t kBulkMaxBufferedBytes = 4 * 1024 * 1024;
+
+constexpr size_t kListMaxLimit = 200;
+// NDJSON exports fetch and send one keyset page at a time.
+constexpr size_t kExportPageRows = 1000;
+
+// Postgres text columns reject NUL bytes and invalid UTF-8. Such a row would
+// fail the whole multi-row INSERT it is batched into, so it is refused here.
+bool isStorableText(std::string_view text) {
+    size_t i = 0;
+    while (i < text.size()) {
+        const auto lead = static_cast<unsigned char>(text[i]);
+        if (lead == 0) {
+            return false;
+        }
+        if (lead < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;  // range of the first continuation byte
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;          // overlong
+            if (lead == 0xED) high = 0x9F;         // surrogates
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;          // overlong
+            if (lead == 0xF4) high = 0x8F;         // above U+10FFFF
+        } else {
+            return false;
+        }
+        if (text.size() - i < length) {
+            return false;
+        }
+        for (size_t k = 1; k < length; ++k) {
+            const auto c = static_cast<unsigned char>(text[i + k]);
+            if (k == 1 ? (c < low || c > high) : (c < 0x80 || c > 0xBF)) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+// Accepts {"url": "...", "ttl": 60} or a bare "url" string.
+bool parseBulkItem(std::string_view item, std::string& url, int& ttlSeconds, std::string& error) {
+    thread_local std::unique_ptr<Json::CharReader> reader = [] {
+        Json::CharReaderBuilder builder;
+        return std::unique_ptr<Json::CharReader>(builder.newCharReader());
+    }();
+    Json::Value value;
+    std::string errors;
+    if (!reader->parse(item.data(), item.data() + item.size(), &value, &errors)) {
+        error = "invalid JSON";
+        return false;
+    }
+    if (value.isString()) {
+        url = value.asString();
+    } else if (value.isObject() && value.isMember("url") && value["url"].isString()) {
+        url = value["url"].asString();
+        if (value.isMember("ttl") && value["ttl"].isInt()) {
+            ttlSeconds = value["ttl"].asInt();
+        }
+    } else {
+        error = "url required";
+        return false;
+    }
+    if (url.empty()) {
+        error = "url cannot be empty";
+        return false;
+    }
+    if (!isStorableText(url)) {
+        error = "url must be valid UTF-8 without NUL bytes";
+        return false;
+    }
+    return true;
+}
+
+void appendNdjson(std::string& out, const Json::Value& value) {
+    static const Json::StreamWriterBuilder writer = [] {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+    out += Json::writeString(writer, value);
+    out += '\n';
+}
+
+Counter& bulkItems(const char* result) {
+    return MetricsRegistry::instance().counter(
+        "urlshortener_bulk_items_total", "Bulk shorten items by outcome", {{"result", result}});
+}
+
+struct ResolveMetrics {
+    Counter& localHit;
+    Counter& localMiss;
+    Counter& snapshotHit;
+    Counter& snapshotMiss;
+    Counter& negativeHit;
+    Counter& redisHit;
+    Counter& redisMiss;
+    Counter& redisError;
+    Counter& filterReject;
+    Counter& coalesced;
+    Counter& dbFound;
+    Counter& dbNotFound;
+    Counter& dbError;
+};
+
+ResolveMetrics& resolveMetrics() {
+    static ResolveMetrics metrics = [] {
+        auto& registry = MetricsRegistry::instance();
+        const std::string lookups = "urlshortener_resolve_lookups_total";
+        const std::string help = "Resolve lookups per layer and outcome";
+        return ResolveMetrics{
+            registry.counter(lookups, help, {{"layer", "local"}, {"result", "hit"}}),
+            registry.counter(lookups, help, {{"layer", "local"}, {"result", "miss"}}),
+            registry.counter(lookups, help, {{"layer", "snapshot"}, {"result", "hit"}}),
+            registry.counter(lookups, help, {{"layer", "snapshot"}, {"result", "miss"}}),
+            registry.counter(lookups, help, {{"layer", "negative"}, {"result", "hit"}}),
+            registry.counter(lookups, help, {{"layer", "redis"}, {"result", "hit"}}),
+            registry.counter(lookups, help, {{"layer", "redis"}, {"result", "miss"}}),
+            registry.counter(lookups, help, {{"layer", "redis"}, {"result", "error"}}),
+            registry.counter(lookups, help, {{"layer", "bloom"}, {"result", "reject"}}),
+            registry.counter("urlshortener_resolve_coalesced_total",
+                             "Resolve misses answered by another request's in-flight DB lookup"),
+            registry.counter(lookups, help, {{"layer", "db"}, {"result", "hit"}}),
+            registry.counter(lookups, help, {{"layer", "db"}, {"result", "miss"}}),
+            registry.counter(lookups, help, {{"layer", "db"}, {"result", "error"}}),
+        };
+    }();
+    return metrics;
+}
+}
+
 UrlShortenerService::UrlShortenerService(std::shared_ptr<DataStore> dataStore,
                                                                                  std::shared_ptr<AuthService> authService,
                                                                                  std::string baseUrl,
-                                                                                 drogon::nosql::RedisClientPtr redisClient)
+                                                                                 std::shared_ptr<RedisPool> redis,
+                                                                                 std::shared_ptr<InsertBatcher> insertBatcher,
+                                                                                 std::shared_ptr<ShortCodeAllocator> codeAllocator,
+                                                                                 Caches caches,
+                                                                                 std::shared_ptr<ClickAnalytics> clickAnalytics)
         : dataStore_(std::move(dataStore)),
             authService_(std::move(authService)),
             baseUrl_(std::move(baseUrl)),
-            redisClient_(std::move(redisClient)) {
-        if (!dataStore_ || !authService_ || !redisClient_) {
+            redis_(std::move(redis)),
+            insertBatcher_(std::move(insertBatcher)),
+            codeAllocator_(std::move(codeAllocator)),
+            caches_(std::move(caches)),
+            clickAnalytics_(std::move(clickAnalytics)) {
+        if (!dataStore_ || !authService_ || !redis_ || !insertBatcher_ || !codeAllocator_) {
                 throw std::runtime_error("Service dependencies missing");
         }
 }
 
 HttpResponsePtr UrlShortenerService::createJsonResponse(const Json::Value& data, HttpStatusCode status) const {
-    auto resp = HttpResponse::newHttpJsonResponse(data);
-    resp->setStatusCode(status);
-    return resp;
+    return responses::json(data, status);
 }
 
 HttpResponsePtr UrlShortenerService::createErrorResponse(const string& message, HttpStatusCode status) const {
@@ -34,14 +199,6 @@ HttpResponsePtr UrlShortenerService::createErrorResponse(const string& message,
     return createJsonResponse(json, status);
 }
 
-string UrlShortenerService::generateShortCode() const {
-    static thread_local mt19937_64 rng{random_device{}()};
-    uniform_int_distribution<uint64_t> dist;
-    
-    // Use optimized fast path for width=7 (most common case)
-    return Base62::encodeFast7(dist(rng));
-}
-
 string UrlShortenerService::getBaseUrl() const {
     if (!baseUrl_.empty()) {
         return baseUrl_;
@@ -58,21 +215,6 @@ string UrlShortenerService::getBaseUrl() const {
     return "http://localhost:" + port;
 }
 
-void UrlShortenerService::handleHealth(const HttpRequestPtr& req, 
-                                      function<void(const HttpResponsePtr&)>&& callback) const {
-    bool db_ok = dataStore_->ping();
-    auto resp = HttpResponse::newHttpResponse();
-    resp->setContentTypeCode(CT_TEXT_PLAIN);
-    if (db_ok) {
-        resp->setStatusCode(k200OK);
-        resp->setBody("ok");
-    } else {
-        resp->setStatusCode(k503ServiceUnavailable);
-        resp->setBody("db-unavailable");
-    }
-    callback(resp);
-}
-
 void UrlShortenerService::handleShorten(const HttpRequestPtr& req, 
                                        function<void(const HttpResponsePtr&)>&& callback) {
     auto body = req->getJsonObject();
@@ -88,6 +230,10 @@ void UrlShortenerService::handleShorten(const HttpRequestPtr& req,
         callback(createErrorResponse("url cannot be empty"));
         return;
     }
+    if (!isStorableText(url)) {
+        callback(createErrorResponse("url must be valid UTF-8 without NUL bytes"));
+        return;
+    }
     
     auto user = authService_->authenticate(req);
     if (!user) {
@@ -100,104 +246,521 @@ void UrlShortenerService::handleShorten(const HttpRequestPtr& req,
         ttlSeconds = (*body)["ttl"].asInt();
     }
 
-    std::optional<DataStore::TimePoint> expiresAt;
+    auto pending = makePendingShorten(url, ttlSeconds, user->id);
+    pending->done = [this, callback = std::move(callback)](const std::string& code, const std::string& error) {
+        if (!error.empty()) {
+            callback(createErrorResponse(error, k500InternalServerError));
+            return;
+        }
+        Json::Value response;
+        response["code"] = code;
+        response["short"] = getBaseUrl() + "/" + code;
+        callback(createJsonResponse(response));
+    };
+    submitShorten(std::move(pending), 0);
+}
+
+std::shared_ptr<UrlShortenerService::PendingShorten> UrlShortenerService::makePendingShorten(
+    std::string url, int ttlSeconds, long userId) {
+    auto pending = std::make_shared<PendingShorten>();
+    pending->url = std::move(url);
     if (ttlSeconds > 0) {
-        expiresAt = SystemClock::now() + std::chrono::seconds(ttlSeconds);
+        pending->expiresAt = SystemClock::now() + std::chrono::seconds(ttlSeconds);
     }
+    pending->userId = userId;
+    // Write-through: cache in Redis (short TTL if set, else default 1 day)
+    pending->cacheTtl = ttlSeconds > 0 ? ttlSeconds : 86400;
+    return pending;
+}
 
-    string code;
-    for (int attempt = 0; attempt < 5; ++attempt) {
-        code = generateShortCode();
-        try {
-            if (dataStore_->insertMapping(code, url, expiresAt, user->id)) {
-                // Write-through: cache in Redis (short TTL if set, else default 1 day)
-                int cacheTtl = ttlSeconds > 0 ? ttlSeconds : 86400;
-                redisClient_->execCommandAsync(
-                    [](const drogon::nosql::RedisResult&) {},
-                    [](const drogon::nosql::RedisException&) {},
-                    "setex %s %d %s", code.c_str(), cacheTtl, url.c_str());
-                break;
-            }
-        } catch (const std::exception& e) {
-            callback(createErrorResponse(string("db error: ") + e.what(), k500InternalServerError));
+void UrlShortenerService::submitShorten(std::shared_ptr<PendingShorten> pending, int attempt) {
+    codeAllocator_->next([this, pending, attempt](std::optional<std::string> code) {
+        if (!code) {
+            pending->done({}, "db error: could not allocate code");
             return;
         }
+        DataStore::NewMapping row{*code, pending->url, pending->expiresAt, pending->userId};
+        insertBatcher_->submit(
+            std::move(row),
+            [this, pending, code = *code, attempt](InsertBatcher::Outcome outcome) {
+                switch (outcome) {
+                case InsertBatcher::Outcome::Inserted:
+                    completeShorten(*pending, code);
+                    return;
+                case InsertBatcher::Outcome::Conflict:
+                    if (attempt + 1 < kMaxShortenAttempts) {
+                        submitShorten(pending, attempt + 1);
+                    } else {
+                        pending->done({}, "collision");
+                    }
+                    return;
+                case InsertBatcher::Outcome::Failed:
+                    pending->done({}, "db error: insert failed");
+                    return;
+                }
+            });
+    });
+}
+
+void UrlShortenerService::completeShorten(const PendingShorten& pending, const std::string& code) {
+    if (caches_.codeFilter) {
+        caches_.codeFilter->recordInsert(code);
+    }
+    if (caches_.negative) {
+        caches_.negative->erase(code);
+    }
+    redis_->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [](const drogon::nosql::RedisException&) {},
+        "setex %s %d %s", code.c_str(), pending.cacheTtl, pending.url.c_str());
+    pending.done(code, {});
+}
+
+struct UrlShortenerService::BulkJob {
+    explicit BulkJob(long user) : userId(user) {}
+
+    long userId{0};
+
+    std::mutex mutex;
+    BulkInputReader reader;
+    size_t received{0};
+    ResponseStreamPtr stream;
+    std::string out;
+    size_t nextIndex{0};
+    size_t inFlight{0};
+    size_t created{0};
+    size_t failed{0};
+    bool inputDone{false};
+    bool closed{false};
+};
+
+void UrlShortenerService::handleShortenBulk(const HttpRequestPtr& req,
+                                            const RequestStreamPtr& stream,
+                                            function<void(const HttpResponsePtr&)>&& callback) {
+    auto user = authService_->authenticate(req);
+    if (!user) {
+        discardBulkBody(stream);
+        callback(createErrorResponse("authentication required", k401Unauthorized));
+        return;
+    }
+    const auto& declared = req->getHeader("content-length");
+    if (!declared.empty() && std::strtoull(declared.c_str(), nullptr, 10) > kBulkMaxBodyBytes) {
+        discardBulkBody(stream);
+        callback(createErrorResponse("request body too large", k413RequestEntityTooLarge));
+        return;
+    }
+
+    auto job = std::make_shared<BulkJob>(user->id);
+    if (stream) {
+        // Rows are launched as their lines arrive; the reader keeps only the
+        // unparsed tail. Both callbacks run on the connection's loop.
+        stream->setStreamReader(RequestStreamReader::newReader(
+            [this, job](const char* data, size_t length) {
+                {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    if (job->inputDone) {
+                        return;
+                    }
+                    job->received += length;
+                    if (job->received > kBulkMaxBodyBytes) {
+                        stopBulkInput(*job, "request body too large; stopped reading");
+                    } else if (job->reader.buffered() + length > kBulkMaxBufferedBytes) {
+                        stopBulkInput(*job, "input arrived faster than rows commit; stopped reading");
+                    } else {
+                        job->reader.append(std::string_view(data, length));
+                    }
+                }
+                pumpBulkJob(job);
+            },
+            [this, job](std::exception_ptr error) {
+                {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    if (job->inputDone) {
+                        return;
+                    }
+                    if (error) {
+                        stopBulkInput(*job, "request body cut short; stopped reading");
+                    } else {
+                        job->reader.finish();
+                    }
+                }
+                pumpBulkJob(job);
+            }));
+    } else {
+        // Request streaming is off: Drogon already buffered the body within
+        // client_max_body_size.
+        job->reader.append(req->body());
+        job->reader.finish();
+    }
+
+    auto resp = HttpResponse::newAsyncStreamResponse(
+        [this, job](ResponseStreamPtr stream) {
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->stream = std::move(stream);
+            }
+            pumpBulkJob(job);
+        },
+        true);
+    resp->setContentTypeString("application/x-ndjson");
+    callback(resp);
+}
+
+void UrlShortenerService::discardBulkBody(const RequestStreamPtr& stream) {
+    if (stream) {
+        stream->setStreamReader(RequestStreamReader::newNullReader());
+    }
+}
+
+// Caller holds job.mutex. Rows already launched still report their results.
+void UrlShortenerService::stopBulkInput(BulkJob& job, const char* reason) {
+    static auto& failedItems = bulkItems("failed");
+    Json::Value line;
+    line["index"] = static_cast<Json::UInt64>(job.nextIndex++);
+    line["error"] = reason;
+    appendNdjson(job.out, line);
+    ++job.failed;
+    failedItems.inc();
+    job.inputDone = true;
+}
 
-        if (attempt == 4) {
-            callback(createErrorResponse("collision", k500InternalServerError));
+void UrlShortenerService::pumpBulkJob(const std::shared_ptr<BulkJob>& job) {
+    static auto& createdItems = bulkItems("created");
+    static auto& failedItems = bulkItems("failed");
+
+    std::vector<std::pair<size_t, std::shared_ptr<PendingShorten>>> launch;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->stream || job->closed) {
             return;
         }
-    }
+        if (job->inFlight <= kBulkWindow / 2) {
+            while (!job->inputDone && job->inFlight + launch.size() < kBulkWindow) {
+                std::string_view item;
+                const auto status = job->reader.next(item);
+                if (status == BulkInputReader::Status::NeedMore) {
+                    break;
+                }
+                if (status == BulkInputReader::Status::End) {
+                    job->inputDone = true;
+                    break;
+                }
+                const auto index = job->nextIndex++;
+                Json::Value line;
+                line["index"] = static_cast<Json::UInt64>(index);
+                if (status == BulkInputReader::Status::Malformed) {
+                    line["error"] = "malformed input; stopped reading";
+                    appendNdjson(job->out, line);
+                    ++job->failed;
+                    failedItems.inc();
+                    job->inputDone = true;
+                    break;
+                }
+                std::string url;
+                int ttlSeconds = 0;
+                std::string error;
+                if (!parseBulkItem(item, url, ttlSeconds, error)) {
+                    line["error"] = error;
+                    appendNdjson(job->out, line);
+                    ++job->failed;
+                    failedItems.inc();
+                    // A long run of bad items launches nothing, so flush here to stay bounded.
+                    if (job->out.size() >= kBulkFlushBytes) {
+                        if (!job->stream->send(job->out)) {
+                            job->closed = true;
+                            job->inputDone = true;
+                            job->stream->close();
+                            return;
+                        }
+                        job->out.clear();
+                    }
+                    continue;
+                }
+                launch.emplace_back(index, makePendingShorten(std::move(url), ttlSeconds, job->userId));
+            }
+            job->inFlight += launch.size();
+        }
 
-    // Build response
-    Json::Value response;
-    response["code"] = code;
-    response["short"] = getBaseUrl() + "/" + code;
+        const bool finished = job->inputDone && job->inFlight == 0;
+        if (finished) {
+            Json::Value summary;
+            summary["done"] = true;
+            summary["created"] = static_cast<Json::UInt64>(job->created);
+            summary["failed"] = static_cast<Json::UInt64>(job->failed);
+            appendNdjson(job->out, summary);
+        }
+        if (finished || !launch.empty() || job->out.size() >= kBulkFlushBytes) {
+            const bool sent = job->out.empty() || job->stream->send(job->out);
+            job->out.clear();
+            if (!sent || finished) {
+                // A failed send means the client went away; in-flight rows still commit.
+                job->closed = true;
+                job->inputDone = true;
+                job->stream->close();
+                return;
+            }
+        }
+    }
 
-    callback(createJsonResponse(response));
+    for (auto& [index, pending] : launch) {
+        pending->done = [this, job, index = index](const std::string& code, const std::string& error) {
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                --job->inFlight;
+                Json::Value line;
+                line["index"] = static_cast<Json::UInt64>(index);
+                if (error.empty()) {
+                    line["code"] = code;
+                    line["short"] = getBaseUrl() + "/" + code;
+                    ++job->created;
+                    createdItems.inc();
+                } else {
+                    line["error"] = error;
+                    ++job->failed;
+                    failedItems.inc();
+                }
+                if (!job->closed) {
+                    appendNdjson(job->out, line);
+                }
+            }
+            pumpBulkJob(job);
+        };
+        submitShorten(pending, 0);
+    }
 }
 
 void UrlShortenerService::handleInfo(const HttpRequestPtr& req, 
                                     function<void(const HttpResponsePtr&)>&& callback, 
                                     const string& code) const {
-    try {
-        auto info = dataStore_->getUrlInfo(code);
-        if (!info) {
-            callback(createErrorResponse("not found", k404NotFound));
-            return;
+    async_run([this, callback = std::move(callback), code]() -> Task<> {
+        try {
+            auto info = co_await dataStore_->getUrlInfoCoro(code);
+            if (!info) {
+                callback(createErrorResponse("not found", k404NotFound));
+                co_return;
+            }
+            Json::Value response;
+            response["code"] = code;
+            response["url"] = info->url;
+            response["ttl_active"] = info->ttlActive;
+            response["clicks"] = static_cast<Json::UInt64>(info->clicks);
+            if (info->lastClickAt) {
+                response["last_click_at"] = static_cast<Json::Int64>(responses::epochSeconds(*info->lastClickAt));
+            }
+            callback(createJsonResponse(response));
+        } catch (const std::exception& e) {
+            callback(createErrorResponse(string("db error: ") + e.what(), k500InternalServerError));
         }
-        Json::Value response;
-        response["code"] = code;
-        response["url"] = info->url;
-        response["ttl_active"] = info->ttlActive;
-        callback(createJsonResponse(response));
-    } catch (const std::exception& e) {
-        callback(createErrorResponse(string("db error: ") + e.what(), k500InternalServerError));
-        return;
-    }
+    });
 }
 
 void UrlShortenerService::handleResolve(const HttpRequestPtr& req, 
                                        function<void(const HttpResponsePtr&)>&& callback, 
                                        const string& code) const {
-    // Try Redis cache first
-    redisClient_->execCommandAsync(
-        [this, callback, code](const drogon::nosql::RedisResult& r) {
+    // In-process caches answer hot codes and recent 404s without a network hop
+    auto& metrics = resolveMetrics();
+    if (caches_.local) {
+        if (auto url = caches_.local->get(code)) {
+            metrics.localHit.inc();
+            callback(HttpResponse::newRedirectionResponse(*url));
+            recordRedirect(code);
+            return;
+        }
+        metrics.localMiss.inc();
+    }
+    // The snapshot predates recent links, so only its hits are answers
+    if (caches_.snapshot) {
+        if (auto snapshot = caches_.snapshot->current()) {
+            auto hit = snapshot->find(code);
+            if (hit && (!hit->expiresAt || *hit->expiresAt > SystemClock::now())) {
+                metrics.snapshotHit.inc();
+                callback(HttpResponse::newRedirectionResponse(std::string(hit->url)));
+                recordRedirect(code);
+                return;
+            }
+            metrics.snapshotMiss.inc();
+        }
+    }
+    if (caches_.negative && caches_.negative->get(code)) {
+        metrics.negativeHit.inc();
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        callback(resp);
+        return;
+    }
+
+    // Then Redis
+    redis_->execCommandAsync(
+        [this, callback, code](const drogon::nosql::RedisResult& r) mutable {
             if (r && !r.isNil()) {
                 // Cache hit
+                resolveMetrics().redisHit.inc();
                 std::string url = r.asString();
-                std::cout << "[DEBUG] Redis CACHE HIT for code: " << code << " -> " << url << std::endl;
+                APP_LOG_SAMPLED(kDebug) << "redis cache hit code=" << code;
                 callback(HttpResponse::newRedirectionResponse(url));
+                fillLocalCacheFromRedis(code, url);
+                recordRedirect(code);
                 return;
             }
-            std::cout << "[DEBUG] Redis CACHE MISS for code: " << code << std::endl;
-            // Cache miss: fallback to DB
-            try {
-                auto url = dataStore_->resolveUrl(code);
-                if (!url) {
-                    auto resp = HttpResponse::newHttpResponse();
-                    resp->setStatusCode(k404NotFound);
-                    callback(resp);
-                    return;
-                }
-                // Cache in Redis (short TTL, e.g., 5 min)
-                redisClient_->execCommandAsync(
-                    [](const drogon::nosql::RedisResult&) {},
-                    [](const drogon::nosql::RedisException&) {},
-                    "setex %s 300 %s", code.c_str(), url->c_str());
-                callback(HttpResponse::newRedirectionResponse(*url));
-            } catch (const std::exception& e) {
-                auto resp = HttpResponse::newHttpResponse();
-                resp->setStatusCode(k500InternalServerError);
-                callback(resp);
-            }
+            APP_LOG_SAMPLED(kDebug) << "redis cache miss code=" << code;
+            resolveMetrics().redisMiss.inc();
+            resolveFromDatabase(code, std::move(callback));
         },
-        [](const drogon::nosql::RedisException& e) {
-            // Redis error: fallback to DB (handled in lambda above)
+        [this, callback, code](const drogon::nosql::RedisException&) mutable {
+            // Timeout, broken connection or open breaker: answer from Postgres instead
+            resolveMetrics().redisError.inc();
+            resolveFromDatabase(code, std::move(callback));
         },
         "get %s", code.c_str());
 }
 
+void UrlShortenerService::recordRedirect(const string& code) const {
+    if (clickAnalytics_) {
+        clickAnalytics_->record(code);
+    }
+    if (caches_.popular) {
+        caches_.popular->recordRedirect(code);
+    }
+}
+
+void UrlShortenerService::fillLocalCacheFromRedis(const string& code, const string& url) const {
+    if (!caches_.local) {
+        return;
+    }
+    // Runs after the redirect has been sent, so the extra round trip is off the response path.
+    redis_->execCommandAsync(
+        [this, code, url](const drogon::nosql::RedisResult& r) {
+            auto remainingMs = r.asInteger();
+            if (remainingMs == -1) {
+                caches_.local->put(code, url);
+            } else if (remainingMs > 0) {
+                caches_.local->put(code, url, std::chrono::seconds(remainingMs / 1000));
+            }
+        },
+        [](const drogon::nosql::RedisException&) {},
+        "pttl %s", code.c_str());
+}
+
+void UrlShortenerService::resolveFromDatabase(const string& code,
+                                              function<void(const HttpResponsePtr&)>&& callback) const {
+    // Redis has already missed; a negative filter answer means Postgres would too.
+    // Codes created on other replicas are still found via their Redis write-through.
+    if (caches_.codeFilter && !caches_.codeFilter->mightExist(code)) {
+        resolveMetrics().filterReject.inc();
+        if (caches_.negative) {
+            caches_.negative->put(code, std::string());
+        }
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setStatusCode(k404NotFound);
+        callback(resp);
+        return;
+    }
+
+    // Concurrent misses for the same code wait on the first one's lookup.
+    // Each waiter is its own redirect, so each one records its click.
+    const bool leader = resolveFlights_.join(
+        code,
+        [this, code, callback = std::move(callback)](const DbResolveResult& result) {
+            if (result.resolved) {
+                recordRedirect(code);
+            }
+            callback(resolveResponse(result));
+        });
+    if (!leader) {
+        resolveMetrics().coalesced.inc();
+        return;
+    }
+
+    // Both continuations may fire on a DB loop thread; neither blocks it.
+    // A synchronous throw (binding, replica selection) must still complete
+    // the flight, or every later miss for this code would wait on it forever.
+    try {
+        dataStore_->resolveUrlAsync(
+            code,
+            [this, code](std::optional<DataStore::ResolvedUrl> resolved) {
+                completeDatabaseResolve(code, std::move(resolved));
+            },
+            [this, code](const std::exception&) {
+                resolveMetrics().dbError.inc();
+                resolveFlights_.complete(code, DbResolveResult{true, std::nullopt});
+            });
+    } catch (const std::exception& e) {
+        APP_LOG_SAMPLED(kError) << "resolve lookup failed to start code=" << code << ": " << e.what();
+        resolveMetrics().dbError.inc();
+        resolveFlights_.complete(code, DbResolveResult{true, std::nullopt});
+    }
+}
+
+void UrlShortenerService::completeDatabaseResolve(const string& code,
+                                                  std::optional<DataStore::ResolvedUrl> resolved) const {
+    if (!resolved) {
+        resolveMetrics().dbNotFound.inc();
+        if (caches_.codeFilter) {
+            caches_.codeFilter->recordFalsePositive();
+        }
+        if (caches_.negative) {
+            caches_.negative->put(code, std::string());
+        }
+        resolveFlights_.complete(code, DbResolveResult{false, std::nullopt});
+        return;
+    }
+    resolveMetrics().dbFound.inc();
+    // Never cache a link past its own expiry
+    auto ttl = kResolveCacheTtl;
+    if (resolved->expiresAt) {
+        auto remaining = std::chrono::duration_cast<std::chrono::seconds>(*resolved->expiresAt - SystemClock::now());
+        ttl = std::min(ttl, remaining);
+    }
+    if (ttl.count() > 0) {
+        redis_->execCommandAsync(
+            [](const drogon::nosql::RedisResult&) {},
+            [](const drogon::nosql::RedisException&) {},
+            "setex %s %d %s", code.c_str(), static_cast<int>(ttl.count()), resolved->url.c_str());
+        if (caches_.local) {
+            caches_.local->put(code, resolved->url, ttl);
+        }
+    }
+    resolveFlights_.complete(code, DbResolveResult{false, std::move(resolved)});
+}
+
+HttpResponsePtr UrlShortenerService::resolveResponse(const DbResolveResult& result) {
+    if (result.resolved) {
+        return HttpResponse::newRedirectionResponse(result.resolved->url);
+    }
+    auto resp = HttpResponse::newHttpResponse();
+    resp->setStatusCode(result.failed ? k500InternalServerError : k404NotFound);
+    return resp;
+}
+
+std::string UrlShortenerService::encodeListCursor(const DataStore::UrlListItem& last) {
+    const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(last.createdAt.time_since_epoch()).count();
+    return JwtService::base64UrlEncode(std::to_string(micros) + ":" + last.code);
+}
+
+std::optional<DataStore::UrlListKey> UrlShortenerService::decodeListCursor(std::string_view token) {
+    auto raw = JwtService::base64UrlDecode(token);
+    if (!raw) {
+        return std::nullopt;
+    }
+    const auto colon = raw->find(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == raw->size() || raw->size() - colon - 1 > 16) {
+        return std::nullopt;
+    }
+    int64_t micros = 0;
+    for (size_t i = 0; i < colon; ++i) {
+        const char c = (*raw)[i];
+        if (c < '0' || c > '9' || i >= 18) {
+            return std::nullopt;
+        }
+        micros = micros * 10 + (c - '0');
+    }
+    DataStore::UrlListKey key;
+    key.createdAt = DataStore::TimePoint(
+        std::chrono::duration_cast<DataStore::TimePoint::duration>(std::chrono::microseconds(micros)));
+    key.code = raw->substr(colon + 1);
+    return key;
+}
+
 void UrlShortenerService::handleListUserUrls(
     const HttpRequestPtr& req,
     function<void(const HttpResponsePtr&)>&& callback) const {
@@ -206,33 +769,95 @@ void UrlShortenerService::handleListUserUrls(
         callback(createErrorResponse("authentication required", k401Unauthorized));
         return;
     }
+    std::optional<DataStore::UrlListKey> after;
+    const auto& cursorParam = req->getParameter("cursor");
+    if (!cursorParam.empty()) {
+        after = decodeListCursor(cursorParam);
+        if (!after) {
+            callback(createErrorResponse("invalid cursor"));
+            return;
+        }
+    }
+
+    if (req->getParameter("format") == "ndjson") {
+        auto resp = HttpResponse::newAsyncStreamResponse(
+            [this, userId = user->id, after](ResponseStreamPtr stream) {
+                async_run([this, userId, after, stream = std::move(stream)]() mutable {
+                    return exportUrls(userId, std::move(after), std::move(stream));
+                });
+            },
+            true);
+        resp->setContentTypeString("application/x-ndjson");
+        callback(resp);
+        return;
+    }
+
     size_t limit = 50;
     auto limitParam = req->getParameter("limit");
     if (!limitParam.empty()) {
         try {
-            limit = std::clamp(static_cast<size_t>(std::stoul(limitParam)), size_t{1}, size_t{200});
+            limit = std::clamp(static_cast<size_t>(std::stoul(limitParam)), size_t{1}, kListMaxLimit);
         } catch (...) {
             callback(createErrorResponse("invalid limit value"));
             return;
         }
     }
 
-    try {
-        auto rows = dataStore_->listUrlsForUser(user->id, limit);
-        Json::Value json(Json::arrayValue);
+    async_run([this, callback = std::move(callback), userId = user->id, after = std::move(after),
+               limit]() mutable -> Task<> {
+        std::vector<DataStore::UrlListItem> rows;
+        try {
+            // One row past the page tells us whether to hand out a next cursor.
+            rows = co_await dataStore_->listUrlsForUserCoro(userId, std::move(after), limit + 1);
+        } catch (const std::exception& e) {
+            callback(createErrorResponse(string("db error: ") + e.what(), k500InternalServerError));
+            co_return;
+        }
+        const bool more = rows.size() > limit;
+        if (more) {
+            rows.resize(limit);
+        }
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setContentTypeCode(CT_APPLICATION_JSON);
+        resp->setBody(responses::listBody(rows, getBaseUrl()));
+        if (more) {
+            resp->addHeader("X-Next-Cursor", encodeListCursor(rows.back()));
+        }
+        callback(resp);
+    });
+}
+
+Task<> UrlShortenerService::exportUrls(long userId,
+                                       std::optional<DataStore::UrlListKey> after,
+                                       ResponseStreamPtr stream) const {
+    const auto baseUrl = getBaseUrl();
+    size_t total = 0;
+    for (;;) {
+        std::vector<DataStore::UrlListItem> rows;
+        try {
+            rows = co_await dataStore_->listUrlsForUserCoro(userId, after, kExportPageRows);
+        } catch (const std::exception&) {
+            stream->send("{\"error\":\"db error\"}\n");
+            stream->close();
+            co_return;
+        }
+        std::string out;
+        out.reserve(rows.size() * 160 + 64);
         for (const auto& row : rows) {
-            Json::Value item;
-            item["code"] = row.code;
-            item["url"] = row.url;
-            item["short"] = getBaseUrl() + "/" + row.code;
-            item["created_at"] = static_cast<Json::Int64>(std::chrono::duration_cast<std::chrono::seconds>(row.createdAt.time_since_epoch()).count());
-            if (row.expiresAt) {
-                item["expires_at"] = static_cast<Json::Int64>(std::chrono::duration_cast<std::chrono::seconds>(row.expiresAt->time_since_epoch()).count());
-            }
-            json.append(item);
+            responses::appendListItem(out, row, baseUrl);
+            out += '\n';
+        }
+        total += rows.size();
+        const bool last = rows.size() < kExportPageRows;
+        if (last) {
+            out += "{\"done\":true,\"count\":" + std::to_string(total) + "}\n";
+        } else {
+            after = DataStore::UrlListKey{rows.back().createdAt, rows.back().code};
+        }
+        // A failed send means the client went away; stop paging.
+        if (!stream->send(out) || last) {
+            stream->close();
+            co_return;
         }
-        callback(createJsonResponse(json));
-    } catch (const std::exception& e) {
-        callback(createErrorResponse(string("db error: ") + e.what(), k500InternalServerError));
     }
-}
\ No newline at end of file
+}
@@ -1,20 +1,82 @@
 #pragma once
+#include "cache/CodeExistenceFilter.h"
+#include "cache/LocalUrlCache.h"
+#include "cache/PopularLinks.h"
+#include "cache/RedisPool.h"
+#include "cache/SingleFlight.h"
+#include "cache/SnapshotReloader.h"
 #include "services/AuthService.h"
+#include "services/ClickAnalytics.h"
 #include "services/DataStore.h"
+#include "services/InsertBatcher.h"
+#include "services/ShortCodeAllocator.h"
+#include <drogon/RequestStream.h>
 #include <drogon/drogon.h>
 #include <json/json.h>
-#include <drogon/nosql/RedisClient.h>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 
 class UrlShortenerService {
+public:
+    // Optional lookup layers consulted before Redis/Postgres; any may be null.
+    struct Caches {
+        std::shared_ptr<LocalUrlCache> local;
+        // Remembers recent 404s; values are always empty strings
+        std::shared_ptr<LocalUrlCache> negative;
+        std::shared_ptr<CodeExistenceFilter> codeFilter;
+        // Memory-mapped url_mapping snapshot; answers hits only
+        std::shared_ptr<SnapshotReloader> snapshot;
+        // Sampled redirect counts that tell the next instance what to warm
+        std::shared_ptr<PopularLinks> popular;
+    };
+
 private:
     std::shared_ptr<DataStore> dataStore_;
     std::shared_ptr<AuthService> authService_;
     std::string baseUrl_;
-    drogon::nosql::RedisClientPtr redisClient_;
+    std::shared_ptr<RedisPool> redis_;
+    std::shared_ptr<InsertBatcher> insertBatcher_;
+    std::shared_ptr<ShortCodeAllocator> codeAllocator_;
+    Caches caches_;
+    std::shared_ptr<ClickAnalytics> clickAnalytics_;
+
+    struct PendingShorten {
+        std::string url;
+        std::optional<DataStore::TimePoint> expiresAt;
+        long userId{0};
+        int cacheTtl{0};
+        // error is empty on success, in which case code is the new mapping
+        std::function<void(const std::string& code, const std::string& error)> done;
+    };
+    static std::shared_ptr<PendingShorten> makePendingShorten(std::string url, int ttlSeconds, long userId);
+    // Allocates the next code and queues it with the insert batcher. Only codes
+    // taken by the old random generator can conflict; those are skipped.
+    void submitShorten(std::shared_ptr<PendingShorten> pending, int attempt);
+    void completeShorten(const PendingShorten& pending, const std::string& code);
+
+    // State for one streamed /api/v1/shorten/bulk request
+    struct BulkJob;
+    static void stopBulkInput(BulkJob& job, const char* reason);
+    void pumpBulkJob(const std::shared_ptr<BulkJob>& job);
+
+    // Streams /api/v1/urls?format=ndjson one keyset page at a time
+    drogon::Task<> exportUrls(long userId,
+                              std::optional<DataStore::UrlListKey> after,
+                              drogon::ResponseStreamPtr stream) const;
+
+    // Opaque ?cursor= / X-Next-Cursor token for the link list
+    static std::string encodeListCursor(const DataStore::UrlListItem& last);
+    static std::optional<DataStore::UrlListKey> decodeListCursor(std::string_view token);
+
+    struct DbResolveResult {
+        bool failed{false};
+        std::optional<DataStore::ResolvedUrl> resolved;
+    };
+    // One Postgres lookup (and one write-back) per code, however many requests miss together
+    mutable SingleFlight<DbResolveResult> resolveFlights_;
 
     drogon::HttpResponsePtr createJsonResponse(
         const Json::Value& data,
@@ -24,23 +86,44 @@ private:
         const std::string& message,
         drogon::HttpStatusCode status = drogon::k400BadRequest) const;
 
-    std::string generateShortCode() const;
     std::string getBaseUrl() const;
 
+    // Redis miss path: async Postgres lookup followed by a write-back SETEX
+    void resolveFromDatabase(const std::string& code,
+                             std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+    void completeDatabaseResolve(const std::string& code,
+                                 std::optional<DataStore::ResolvedUrl> resolved) const;
+    static drogon::HttpResponsePtr resolveResponse(const DbResolveResult& result);
+
+    // Counts a served redirect towards click stats and popularity, when tracked
+    void recordRedirect(const std::string& code) const;
+
+    // Populates the local cache after a Redis hit, honoring the key's remaining TTL
+    void fillLocalCacheFromRedis(const std::string& code, const std::string& url) const;
+
 public:
     UrlShortenerService(std::shared_ptr<DataStore> dataStore,
                         std::shared_ptr<AuthService> authService,
                         std::string baseUrl,
-                        drogon::nosql::RedisClientPtr redisClient);
-    
-    // Health check endpoint
-    void handleHealth(const drogon::HttpRequestPtr& req, 
-                     std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+                        std::shared_ptr<RedisPool> redis,
+                        std::shared_ptr<InsertBatcher> insertBatcher,
+                        std::shared_ptr<ShortCodeAllocator> codeAllocator,
+                        Caches caches = {},
+                        std::shared_ptr<ClickAnalytics> clickAnalytics = nullptr);
     
     // Shorten URL endpoint
     void handleShorten(const drogon::HttpRequestPtr& req, 
                       std::function<void(const drogon::HttpResponsePtr&)>&& callback);
     
+    // Bulk shorten: NDJSON or JSON array body, NDJSON results streamed back
+    // as rows are committed. The body is parsed off the request stream as it
+    // arrives; a null stream falls back to req->body().
+    void handleShortenBulk(const drogon::HttpRequestPtr& req,
+                           const drogon::RequestStreamPtr& stream,
+                           std::function<void(const drogon::HttpResponsePtr&)>&& callback);
+    // Drains a rejected bulk request's body without buffering it
+    static void discardBulkBody(const drogon::RequestStreamPtr& stream);
+
     // Get URL info endpoint
     void handleInfo(const drogon::HttpRequestPtr& req, 
                    std::function<void(const drogon::HttpResponsePtr&)>&& callback, 
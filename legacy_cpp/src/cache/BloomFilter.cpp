@@ -0,0 +1,73 @@
+#include "BloomFilter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr size_t kMinBits = 1024;
+constexpr size_t kMaxHashes = 16;
+
+uint64_t fnv1a(std::string_view key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+}  // namespace
+
+BloomFilter::BloomFilter(size_t expectedItems, double falsePositiveRate) {
+    const double n = static_cast<double>(std::max<size_t>(expectedItems, 1));
+    const double p = std::clamp(falsePositiveRate, 1e-9, 0.5);
+    const double ln2 = std::log(2.0);
+    const auto bits = static_cast<size_t>(std::ceil(-n * std::log(p) / (ln2 * ln2)));
+    bitCount_ = std::max(bits, kMinBits);
+    words_ = (bitCount_ + 63) / 64;
+    bitCount_ = words_ * 64;
+    const auto hashes = static_cast<size_t>(std::round(static_cast<double>(bitCount_) / n * ln2));
+    hashCount_ = std::clamp<size_t>(hashes, 1, kMaxHashes);
+    bits_ = std::make_unique<std::atomic<uint64_t>[]>(words_);
+    for (size_t i = 0; i < words_; ++i) {
+        bits_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void BloomFilter::add(std::string_view key) {
+    const auto h = fnv1a(key);
+    const uint64_t h1 = mix64(h);
+    const uint64_t h2 = mix64(h ^ 0x9e3779b97f4a7c15ULL) | 1;
+    for (size_t i = 0; i < hashCount_; ++i) {
+        const auto bit = (h1 + i * h2) % bitCount_;
+        bits_[bit / 64].fetch_or(uint64_t{1} << (bit % 64), std::memory_order_relaxed);
+    }
+    inserted_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BloomFilter::mightContain(std::string_view key) const {
+    const auto h = fnv1a(key);
+    const uint64_t h1 = mix64(h);
+    const uint64_t h2 = mix64(h ^ 0x9e3779b97f4a7c15ULL) | 1;
+    for (size_t i = 0; i < hashCount_; ++i) {
+        const auto bit = (h1 + i * h2) % bitCount_;
+        if ((bits_[bit / 64].load(std::memory_order_relaxed) & (uint64_t{1} << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double BloomFilter::estimatedFalsePositiveRate() const {
+    const double k = static_cast<double>(hashCount_);
+    const double n = static_cast<double>(insertedCount());
+    const double m = static_cast<double>(bitCount_);
+    return std::pow(1.0 - std::exp(-k * n / m), k);
+}
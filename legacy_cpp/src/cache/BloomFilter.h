@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Fixed-size Bloom filter over short codes. Bits are atomics, so add() and
+// mightContain() may run concurrently from any thread without a lock.
+class BloomFilter {
+public:
+    BloomFilter(size_t expectedItems, double falsePositiveRate);
+
+    void add(std::string_view key);
+    bool mightContain(std::string_view key) const;
+
+    size_t bitCount() const { return bitCount_; }
+    size_t hashCount() const { return hashCount_; }
+    uint64_t insertedCount() const { return inserted_.load(std::memory_order_relaxed); }
+    size_t memoryBytes() const { return words_ * sizeof(uint64_t); }
+
+    // (1 - e^(-k*n/m))^k for the number of keys added so far
+    double estimatedFalsePositiveRate() const;
+
+private:
+    size_t bitCount_;
+    size_t hashCount_;
+    size_t words_;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits_;
+    std::atomic<uint64_t> inserted_{0};
+};
@@ -0,0 +1,249 @@
+#include "CacheWarmer.h"
+#include "LocalUrlCache.h"
+#include "PopularLinks.h"
+#include "RedisPool.h"
+#include "../metrics/Metrics.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+// Redis writes of one batch still outstanding.
+struct PendingWrites {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending{0};
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+};
+}  // namespace
+
+const char* CacheWarmer::outcomeName(Outcome outcome) {
+    switch (outcome) {
+        case Outcome::Pending:
+            return "pending";
+        case Outcome::Running:
+            return "running";
+        case Outcome::Completed:
+            return "completed";
+        case Outcome::Deadline:
+            return "deadline";
+        case Outcome::Budget:
+            return "budget";
+        case Outcome::Failed:
+            return "failed";
+        case Outcome::Stopped:
+            return "stopped";
+    }
+    return "unknown";
+}
+
+CacheWarmer::CacheWarmer(std::shared_ptr<DataStore> store,
+                         std::shared_ptr<RedisPool> redis,
+                         std::shared_ptr<LocalUrlCache> local,
+                         std::shared_ptr<PopularLinks> popular,
+                         Options options)
+    : store_(std::move(store)),
+      redis_(std::move(redis)),
+      local_(std::move(local)),
+      popular_(std::move(popular)),
+      options_(options) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (!redis_) {
+        throw std::runtime_error("RedisPool dependency missing");
+    }
+    options_.batchSize = std::clamp<size_t>(options_.batchSize, 1, 10000);
+    if (options_.maxDuration.count() <= 0) {
+        throw std::runtime_error("warm-up duration must be positive");
+    }
+
+    MetricsRegistry::instance().addCollector([this](PrometheusWriter& out) {
+        const auto current = outcome();
+        out.family("urlshortener_warmup_in_progress", "1 while the startup cache warm-up runs", "gauge");
+        out.sample("urlshortener_warmup_in_progress", {}, current == Outcome::Running ? 1.0 : 0.0);
+        out.family("urlshortener_warmup_links", "Links loaded by the startup cache warm-up", "gauge");
+        out.sample("urlshortener_warmup_links", {{"source", "popular"}},
+                   static_cast<double>(popularLoaded_.load(std::memory_order_relaxed)));
+        out.sample("urlshortener_warmup_links", {{"source", "recent"}},
+                   static_cast<double>(recentLoaded_.load(std::memory_order_relaxed)));
+        out.family("urlshortener_warmup_bytes", "Code and URL bytes loaded by the startup cache warm-up", "gauge");
+        out.sample("urlshortener_warmup_bytes", {}, static_cast<double>(bytesLoaded_.load(std::memory_order_relaxed)));
+        const auto started = startedTicks_.load(std::memory_order_relaxed);
+        if (started == 0) {
+            return;
+        }
+        const auto finished = finishedTicks_.load(std::memory_order_relaxed);
+        const auto end = finished != 0 ? Clock::time_point(Clock::duration(finished)) : Clock::now();
+        out.family("urlshortener_warmup_seconds", "Time spent in the startup cache warm-up", "gauge");
+        out.sample("urlshortener_warmup_seconds", {},
+                   std::chrono::duration<double>(end - Clock::time_point(Clock::duration(started))).count());
+        out.family("urlshortener_warmup_outcome", "1 for how the startup cache warm-up ended", "gauge");
+        out.sample("urlshortener_warmup_outcome", {{"outcome", outcomeName(current)}}, 1.0);
+    });
+}
+
+CacheWarmer::~CacheWarmer() {
+    stop();
+}
+
+void CacheWarmer::start(std::function<void()> onDone) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (worker_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    outcome_.store(Outcome::Running, std::memory_order_release);
+    startedTicks_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    worker_ = std::thread([this, onDone = std::move(onDone)]() mutable { run(std::move(onDone)); });
+}
+
+void CacheWarmer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void CacheWarmer::run(std::function<void()> onDone) {
+    const auto started = Clock::now();
+    Outcome result;
+    try {
+        result = warm(started + options_.maxDuration);
+    } catch (const std::exception& e) {
+        LOG_WARN << "Cache warm-up gave up: " << e.what();
+        result = Outcome::Failed;
+    }
+    finishedTicks_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    outcome_.store(result, std::memory_order_release);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started);
+    LOG_INFO << "Cache warm-up " << outcomeName(result) << ": " << popularLoaded_.load() << " popular and "
+             << recentLoaded_.load() << " recent links, " << bytes_ << " bytes, " << elapsed.count() << " ms";
+    loaded_ = {};
+    if (onDone) {
+        onDone();
+    }
+}
+
+CacheWarmer::Outcome CacheWarmer::warm(Clock::time_point deadline) {
+    if (popular_ && options_.popularLinks > 0) {
+        const auto codes = fetchPopular(deadline);
+        popular_->trim();
+        for (size_t first = 0; first < codes.size(); first += options_.batchSize) {
+            if (auto reached = limitReached(deadline)) {
+                return *reached;
+            }
+            const auto last = std::min(codes.size(), first + options_.batchSize);
+            const std::vector<std::string> batch(codes.begin() + first, codes.begin() + last);
+            load(store_->lookupMappings(batch), Source::Popular, deadline);
+        }
+    }
+
+    std::optional<DataStore::UrlListKey> cursor;
+    size_t scanned = 0;
+    while (scanned < options_.recentLinks) {
+        if (auto reached = limitReached(deadline)) {
+            return *reached;
+        }
+        const auto limit = std::min(options_.batchSize, options_.recentLinks - scanned);
+        auto page = store_->listRecentMappings(cursor, limit);
+        scanned += page.size();
+        std::vector<DataStore::StoredMapping> rows;
+        rows.reserve(page.size());
+        for (auto& item : page) {
+            rows.push_back(DataStore::StoredMapping{item.code, std::move(item.url), item.expiresAt});
+        }
+        load(rows, Source::Recent, deadline);
+        if (page.size() < limit) {
+            break;
+        }
+        cursor = DataStore::UrlListKey{page.back().createdAt, page.back().code};
+    }
+    return budgetSpent_ ? Outcome::Budget : Outcome::Completed;
+}
+
+std::optional<CacheWarmer::Outcome> CacheWarmer::limitReached(Clock::time_point deadline) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return Outcome::Stopped;
+        }
+    }
+    if (budgetSpent_ || bytes_ >= options_.maxBytes) {
+        return Outcome::Budget;
+    }
+    if (Clock::now() >= deadline) {
+        return Outcome::Deadline;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> CacheWarmer::fetchPopular(Clock::time_point deadline) {
+    auto promise = std::make_shared<std::promise<std::vector<std::string>>>();
+    auto future = promise->get_future();
+    popular_->topAsync(
+        options_.popularLinks,
+        [promise](std::vector<std::string> codes) { promise->set_value(std::move(codes)); },
+        [promise](const drogon::nosql::RedisException& e) {
+            LOG_WARN << "Cannot read popular links, warming recent links only: " << e.what();
+            promise->set_value({});
+        });
+    if (future.wait_until(deadline) != std::future_status::ready) {
+        return {};
+    }
+    return future.get();
+}
+
+void CacheWarmer::load(const std::vector<DataStore::StoredMapping>& rows,
+                       Source source,
+                       Clock::time_point deadline) {
+    const auto now = DataStore::SystemClock::now();
+    auto writes = std::make_shared<PendingWrites>();
+    auto& counter = source == Source::Popular ? popularLoaded_ : recentLoaded_;
+    for (const auto& row : rows) {
+        auto ttl = options_.cacheTtl;
+        if (row.expiresAt) {
+            ttl = std::min(ttl, std::chrono::duration_cast<std::chrono::seconds>(*row.expiresAt - now));
+        }
+        if (ttl.count() <= 0 || loaded_.count(row.code) > 0) {
+            continue;
+        }
+        const auto cost = row.code.size() + row.url.size();
+        if (bytes_ + cost > options_.maxBytes) {
+            budgetSpent_ = true;
+            break;
+        }
+        bytes_ += cost;
+        loaded_.insert(row.code);
+        if (local_) {
+            local_->put(row.code, row.url, ttl);
+        }
+        {
+            std::lock_guard<std::mutex> lock(writes->mutex);
+            ++writes->pending;
+        }
+        // Failures are ignored: the link is simply not warm in Redis.
+        redis_->execCommandAsync(
+            [writes](const drogon::nosql::RedisResult&) { writes->finish(); },
+            [writes](const drogon::nosql::RedisException&) { writes->finish(); },
+            "set %s %s ex %d nx", row.code.c_str(), row.url.c_str(), static_cast<int>(ttl.count()));
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    bytesLoaded_.store(bytes_, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(writes->mutex);
+    writes->done.wait_until(lock, deadline, [&] { return writes->pending == 0; });
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "../services/DataStore.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+class LocalUrlCache;
+class PopularLinks;
+class RedisPool;
+
+// Loads links into Redis and the local cache before a new instance reports
+// ready, so its first redirects do not all miss through to Postgres. The
+// most redirected codes from PopularLinks go first, then the newest links.
+// Rows are read from Postgres batchSize at a time, with their expiry, and
+// each batch's Redis writes are issued together so they pipeline on the
+// pool's connections. SET NX leaves keys that are already cached untouched.
+//
+// Warm-up ends early once maxDuration has passed or the loaded code and URL
+// bytes reach maxBytes, and gives up if Postgres fails. Whatever the
+// outcome, onDone runs once on the warm-up thread.
+class CacheWarmer {
+public:
+    struct Options {
+        size_t recentLinks{50000};
+        size_t popularLinks{10000};
+        size_t batchSize{500};
+        std::chrono::seconds maxDuration{std::chrono::seconds{30}};
+        size_t maxBytes{32 * 1024 * 1024};
+        // Cache TTL for warmed links, capped by each link's own expiry.
+        std::chrono::seconds cacheTtl{std::chrono::seconds{300}};
+    };
+
+    enum class Outcome { Pending, Running, Completed, Deadline, Budget, Failed, Stopped };
+
+    // local and popular may be null.
+    CacheWarmer(std::shared_ptr<DataStore> store,
+                std::shared_ptr<RedisPool> redis,
+                std::shared_ptr<LocalUrlCache> local,
+                std::shared_ptr<PopularLinks> popular,
+                Options options);
+    ~CacheWarmer();
+
+    CacheWarmer(const CacheWarmer&) = delete;
+    CacheWarmer& operator=(const CacheWarmer&) = delete;
+
+    void start(std::function<void()> onDone);
+    // Abandons a warm-up in progress and joins its thread.
+    void stop();
+
+    Outcome outcome() const { return outcome_.load(std::memory_order_acquire); }
+    static const char* outcomeName(Outcome outcome);
+
+private:
+    enum class Source { Popular, Recent };
+
+    std::shared_ptr<DataStore> store_;
+    std::shared_ptr<RedisPool> redis_;
+    std::shared_ptr<LocalUrlCache> local_;
+    std::shared_ptr<PopularLinks> popular_;
+    Options options_;
+
+    std::mutex mutex_;
+    bool stopping_{false};
+    std::thread worker_;
+
+    // Only touched from the warm-up thread.
+    std::unordered_set<std::string> loaded_;
+    size_t bytes_{0};
+    bool budgetSpent_{false};
+
+    std::atomic<Outcome> outcome_{Outcome::Pending};
+    std::atomic<uint64_t> popularLoaded_{0};
+    std::atomic<uint64_t> recentLoaded_{0};
+    std::atomic<uint64_t> bytesLoaded_{0};
+    std::atomic<int64_t> startedTicks_{0};
+    std::atomic<int64_t> finishedTicks_{0};
+
+    void run(std::function<void()> onDone);
+    Outcome warm(std::chrono::steady_clock::time_point deadline);
+    std::optional<Outcome> limitReached(std::chrono::steady_clock::time_point deadline);
+    std::vector<std::string> fetchPopular(std::chrono::steady_clock::time_point deadline);
+    // Caches one batch and waits for its Redis writes, at most until the deadline.
+    void load(const std::vector<DataStore::StoredMapping>& rows,
+              Source source,
+              std::chrono::steady_clock::time_point deadline);
+};
@@ -0,0 +1,81 @@
+#include "CircuitBreaker.h"
+#include <algorithm>
+
+namespace {
+int64_t nowTicks() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+}  // namespace
+
+CircuitBreaker::CircuitBreaker(Options options)
+    : options_(options) {
+    options_.failureThreshold = std::max<uint32_t>(options_.failureThreshold, 1);
+}
+
+CircuitBreaker::Permit CircuitBreaker::allowRequest() {
+    const auto generation = generation_.load(std::memory_order_acquire);
+    const auto until = openUntil_.load(std::memory_order_acquire);
+    if (until == 0) {
+        return {true, false, generation};
+    }
+    if (nowTicks() < until) {
+        return {};
+    }
+    bool expected = false;
+    if (!probeInFlight_.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+        return {};
+    }
+    // Only the probe moves an open breaker on, so this is its generation.
+    return {true, true, generation_.load(std::memory_order_acquire)};
+}
+
+void CircuitBreaker::recordSuccess(const Permit& permit) {
+    if (permit.probe) {
+        if (advance(permit.generation)) {
+            consecutiveFailures_.store(0, std::memory_order_relaxed);
+            openUntil_.store(0, std::memory_order_release);
+            probeInFlight_.store(false, std::memory_order_release);
+        }
+        return;
+    }
+    if (permit.generation == generation_.load(std::memory_order_acquire)) {
+        consecutiveFailures_.store(0, std::memory_order_relaxed);
+    }
+}
+
+void CircuitBreaker::recordFailure(const Permit& permit) {
+    if (permit.probe) {
+        if (advance(permit.generation)) {
+            open();
+            probeInFlight_.store(false, std::memory_order_release);
+        }
+        return;
+    }
+    // Failures of calls admitted before the breaker last opened are ignored.
+    if (permit.generation != generation_.load(std::memory_order_acquire) ||
+        openUntil_.load(std::memory_order_acquire) != 0) {
+        return;
+    }
+    const auto failures = consecutiveFailures_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (failures >= options_.failureThreshold && advance(permit.generation)) {
+        open();
+    }
+}
+
+bool CircuitBreaker::advance(uint64_t generation) {
+    return generation_.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel);
+}
+
+void CircuitBreaker::open() {
+    const auto until = std::chrono::steady_clock::now() + options_.openDuration;
+    openUntil_.store(until.time_since_epoch().count(), std::memory_order_release);
+    trips_.fetch_add(1, std::memory_order_relaxed);
+}
+
+CircuitBreaker::State CircuitBreaker::state() const {
+    const auto until = openUntil_.load(std::memory_order_acquire);
+    if (until == 0) {
+        return State::Closed;
+    }
+    return nowTicks() < until ? State::Open : State::HalfOpen;
+}
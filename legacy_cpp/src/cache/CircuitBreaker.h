@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Consecutive-failure circuit breaker. After failureThreshold failures in a
+// row it opens and rejects calls for openDuration; then a single probe is
+// let through (half-open) and its outcome closes or re-opens the breaker.
+// Each call carries the generation it was admitted under (bumped on every
+// open and close), so a result that arrives after the breaker changed state
+// cannot count against a later period or stand in for the probe's own.
+// Lock-free, so it can sit in front of every Redis command.
+class CircuitBreaker {
+public:
+    enum class State { Closed = 0, HalfOpen = 1, Open = 2 };
+
+    struct Options {
+        uint32_t failureThreshold{5};
+        std::chrono::milliseconds openDuration{std::chrono::milliseconds{2000}};
+    };
+
+    struct Permit {
+        bool allowed{false};
+        bool probe{false};
+        uint64_t generation{0};
+
+        explicit operator bool() const { return allowed; }
+    };
+
+    explicit CircuitBreaker(Options options);
+
+    // Not allowed while open. In half-open only one caller at a time gets a
+    // probe permit and must report back through recordSuccess/recordFailure.
+    Permit allowRequest();
+    void recordSuccess(const Permit& permit);
+    void recordFailure(const Permit& permit);
+
+    State state() const;
+    uint64_t trips() const { return trips_.load(std::memory_order_relaxed); }
+
+private:
+    Options options_;
+    std::atomic<uint32_t> consecutiveFailures_{0};
+    // steady_clock ticks until which calls are rejected; 0 while closed
+    std::atomic<int64_t> openUntil_{0};
+    std::atomic<bool> probeInFlight_{false};
+    std::atomic<uint64_t> generation_{0};
+    std::atomic<uint64_t> trips_{0};
+
+    // Moves from generation to the next one; false if another call did first.
+    bool advance(uint64_t generation);
+    void open();
+};
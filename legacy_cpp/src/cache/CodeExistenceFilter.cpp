@@ -0,0 +1,171 @@
+#include "CodeExistenceFilter.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+constexpr std::chrono::seconds kRetryDelay{30};
+}
+
+CodeExistenceFilter::CodeExistenceFilter(std::shared_ptr<DataStore> store, Options options)
+    : store_(std::move(store)), options_(options) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (options_.scanBatchSize == 0) {
+        options_.scanBatchSize = 10000;
+    }
+}
+
+CodeExistenceFilter::~CodeExistenceFilter() {
+    stop();
+}
+
+void CodeExistenceFilter::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (worker_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    worker_ = std::thread([this] { run(); });
+}
+
+void CodeExistenceFilter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void CodeExistenceFilter::requestRebuild() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rebuildRequested_ = true;
+    }
+    wakeup_.notify_all();
+}
+
+bool CodeExistenceFilter::mightExist(std::string_view code) const {
+    auto filter = active_.load(std::memory_order_acquire);
+    if (!filter || filter->mightContain(code)) {
+        positives_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    negatives_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void CodeExistenceFilter::recordInsert(std::string_view code) {
+    // Read building_ before active_: rebuild() publishes the new filter to
+    // active_ before clearing building_, so the code always reaches the
+    // filter that ends up active.
+    auto building = building_.load(std::memory_order_acquire);
+    auto active = active_.load(std::memory_order_acquire);
+    if (building) {
+        building->add(code);
+    }
+    if (active && active != building) {
+        active->add(code);
+    }
+}
+
+void CodeExistenceFilter::recordFalsePositive() {
+    if (!active_.load(std::memory_order_acquire)) {
+        return;
+    }
+    falsePositives_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CodeExistenceFilter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (rebuildRequested_) {
+            rebuildRequested_ = false;
+            lock.unlock();
+            const bool ok = rebuild();
+            lock.lock();
+            if (ok) {
+                continue;
+            }
+            wakeup_.wait_for(lock, std::min<std::chrono::seconds>(kRetryDelay, options_.rebuildInterval),
+                             [this] { return stopping_ || rebuildRequested_; });
+            rebuildRequested_ = true;
+            continue;
+        }
+        auto requested = wakeup_.wait_for(lock, options_.rebuildInterval, [this] {
+            return stopping_ || rebuildRequested_;
+        });
+        if (!requested) {
+            rebuildRequested_ = true;
+        }
+    }
+}
+
+bool CodeExistenceFilter::rebuild() {
+    const auto started = std::chrono::steady_clock::now();
+    try {
+        // Leave headroom so the filter keeps its target rate while it grows
+        // between rebuilds.
+        const auto rows = store_->countMappings();
+        const auto capacity = std::max(options_.minCapacity, rows * 2);
+        auto next = std::make_shared<BloomFilter>(capacity, options_.falsePositiveRate);
+        building_.store(next, std::memory_order_release);
+
+        std::string cursor;
+        for (;;) {
+            auto codes = store_->listCodesAfter(cursor, options_.scanBatchSize);
+            for (const auto& code : codes) {
+                next->add(code);
+            }
+            if (codes.size() < options_.scanBatchSize) {
+                break;
+            }
+            cursor = codes.back();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                building_.store(nullptr, std::memory_order_release);
+                return true;
+            }
+        }
+
+        active_.store(next, std::memory_order_release);
+        building_.store(nullptr, std::memory_order_release);
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started);
+        lastRebuildMillis_.store(elapsed.count(), std::memory_order_relaxed);
+        rebuilds_.fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO << "Code filter rebuilt: " << next->insertedCount() << " codes, "
+                 << next->memoryBytes() << " bytes, est. FPR "
+                 << next->estimatedFalsePositiveRate() << ", " << elapsed.count() << " ms";
+        return true;
+    } catch (const std::exception& e) {
+        building_.store(nullptr, std::memory_order_release);
+        rebuildFailures_.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR << "Code filter rebuild failed: " << e.what();
+        return false;
+    }
+}
+
+CodeExistenceFilter::Stats CodeExistenceFilter::stats() const {
+    Stats s;
+    if (auto filter = active_.load(std::memory_order_acquire)) {
+        s.ready = true;
+        s.keys = filter->insertedCount();
+        s.bits = filter->bitCount();
+        s.hashes = filter->hashCount();
+        s.memoryBytes = filter->memoryBytes();
+        s.estimatedFalsePositiveRate = filter->estimatedFalsePositiveRate();
+    }
+    s.positives = positives_.load(std::memory_order_relaxed);
+    s.negatives = negatives_.load(std::memory_order_relaxed);
+    s.falsePositives = falsePositives_.load(std::memory_order_relaxed);
+    s.rebuilds = rebuilds_.load(std::memory_order_relaxed);
+    s.rebuildFailures = rebuildFailures_.load(std::memory_order_relaxed);
+    s.lastRebuildDuration = std::chrono::milliseconds{lastRebuildMillis_.load(std::memory_order_relaxed)};
+    return s;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "BloomFilter.h"
+#include "../services/DataStore.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+// Memory-resident set of every short code that exists in url_mapping, used to
+// answer lookups for unknown codes without touching Postgres. The Bloom filter
+// is (re)built from the table on a background thread and swapped in
+// atomically; inserts made while a rebuild is running land in both filters.
+class CodeExistenceFilter {
+public:
+    struct Options {
+        double falsePositiveRate{0.01};
+        size_t minCapacity{1000000};
+        std::chrono::seconds rebuildInterval{std::chrono::seconds{3600}};
+        size_t scanBatchSize{10000};
+    };
+
+    struct Stats {
+        bool ready{false};
+        uint64_t keys{0};
+        size_t bits{0};
+        size_t hashes{0};
+        size_t memoryBytes{0};
+        double estimatedFalsePositiveRate{0.0};
+        uint64_t positives{0};
+        uint64_t negatives{0};
+        uint64_t falsePositives{0};
+        uint64_t rebuilds{0};
+        uint64_t rebuildFailures{0};
+        std::chrono::milliseconds lastRebuildDuration{0};
+    };
+
+    CodeExistenceFilter(std::shared_ptr<DataStore> store, Options options);
+    ~CodeExistenceFilter();
+
+    CodeExistenceFilter(const CodeExistenceFilter&) = delete;
+    CodeExistenceFilter& operator=(const CodeExistenceFilter&) = delete;
+
+    // Starts the background thread; the first build begins immediately.
+    void start();
+    void stop();
+    void requestRebuild();
+
+    // False only when the code is definitely absent. Always true until the
+    // first build has completed.
+    bool mightExist(std::string_view code) const;
+
+    void recordInsert(std::string_view code);
+
+    // Called when mightExist() said yes but the database had no such code.
+    void recordFalsePositive();
+
+    Stats stats() const;
+
+private:
+    std::shared_ptr<DataStore> store_;
+    Options options_;
+
+    std::atomic<std::shared_ptr<BloomFilter>> active_;
+    std::atomic<std::shared_ptr<BloomFilter>> building_;
+
+    mutable std::atomic<uint64_t> positives_{0};
+    mutable std::atomic<uint64_t> negatives_{0};
+    std::atomic<uint64_t> falsePositives_{0};
+    std::atomic<uint64_t> rebuilds_{0};
+    std::atomic<uint64_t> rebuildFailures_{0};
+    std::atomic<int64_t> lastRebuildMillis_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_{false};
+    bool rebuildRequested_{true};
+    std::thread worker_;
+
+    void run();
+    bool rebuild();
+};
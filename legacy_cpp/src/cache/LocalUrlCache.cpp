@@ -0,0 +1,213 @@
+#include "LocalUrlCache.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// Rough per-entry bookkeeping on top of the URL bytes: the slot itself plus
+// an unordered_map node and bucket pointer.
+constexpr size_t kIndexOverhead = 48;
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+}  // namespace
+
+size_t LocalUrlCache::KeyHash::operator()(uint64_t key) const noexcept {
+    return static_cast<size_t>(mix64(key));
+}
+
+LocalUrlCache::LocalUrlCache(Options options)
+    : options_(options) {
+    if (options_.shards == 0) {
+        options_.shards = 1;
+    }
+    if (options_.defaultTtl.count() <= 0) {
+        throw std::runtime_error("local cache TTL must be positive");
+    }
+    shardCapacity_ = std::max<size_t>(options_.maxBytes / options_.shards, 1);
+    shards_ = std::make_unique<Shard[]>(options_.shards);
+}
+
+std::optional<uint64_t> LocalUrlCache::packCode(std::string_view code) {
+    if (code.empty() || code.size() > sizeof(uint64_t)) {
+        return std::nullopt;
+    }
+    uint64_t key = 0;
+    std::memcpy(&key, code.data(), code.size());
+    return key;
+}
+
+LocalUrlCache::Shard& LocalUrlCache::shardFor(uint64_t key) const {
+    // Use the high bits so shard choice is independent of the bucket index.
+    return shards_[(mix64(key) >> 32) % options_.shards];
+}
+
+size_t LocalUrlCache::entryCost(const std::string& url) {
+    return sizeof(Entry) + kIndexOverhead + url.capacity();
+}
+
+std::optional<std::string> LocalUrlCache::get(std::string_view code) {
+    auto key = packCode(code);
+    if (!key) {
+        return std::nullopt;
+    }
+    auto& shard = shardFor(*key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(*key);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return std::nullopt;
+    }
+    auto& entry = shard.slots[it->second];
+    if (entry.expiresAt <= Clock::now()) {
+        removeSlot(shard, it->second);
+        ++shard.expirations;
+        ++shard.misses;
+        return std::nullopt;
+    }
+    entry.referenced = true;
+    ++shard.hits;
+    return entry.url;
+}
+
+void LocalUrlCache::put(std::string_view code, std::string url) {
+    put(code, std::move(url), options_.defaultTtl);
+}
+
+void LocalUrlCache::put(std::string_view code, std::string url, std::chrono::seconds ttl) {
+    if (ttl.count() <= 0) {
+        return;
+    }
+    auto key = packCode(code);
+    if (!key) {
+        return;
+    }
+    const auto cost = entryCost(url);
+    if (cost > shardCapacity_) {
+        return;
+    }
+    const auto now = Clock::now();
+    const auto expiresAt = now + std::min(ttl, options_.defaultTtl);
+
+    auto& shard = shardFor(*key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(*key);
+    if (it != shard.index.end()) {
+        auto& entry = shard.slots[it->second];
+        shard.bytes -= entryCost(entry.url);
+        entry.url = std::move(url);
+        entry.expiresAt = expiresAt;
+        entry.referenced = true;
+        shard.bytes += entryCost(entry.url);
+        return;
+    }
+
+    while (shard.bytes + cost > shardCapacity_ && evictOne(shard, now)) {
+    }
+
+    uint32_t slot;
+    if (!shard.freeSlots.empty()) {
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(shard.slots.size());
+        shard.slots.emplace_back();
+    }
+    auto& entry = shard.slots[slot];
+    entry.key = *key;
+    entry.url = std::move(url);
+    entry.expiresAt = expiresAt;
+    entry.referenced = false;
+    entry.used = true;
+    shard.index.emplace(*key, slot);
+    shard.bytes += entryCost(entry.url);
+    ++shard.inserts;
+}
+
+void LocalUrlCache::erase(std::string_view code) {
+    auto key = packCode(code);
+    if (!key) {
+        return;
+    }
+    auto& shard = shardFor(*key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(*key);
+    if (it != shard.index.end()) {
+        removeSlot(shard, it->second);
+    }
+}
+
+void LocalUrlCache::clear() {
+    for (size_t i = 0; i < options_.shards; ++i) {
+        auto& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.slots.clear();
+        shard.freeSlots.clear();
+        shard.hand = 0;
+        shard.bytes = 0;
+    }
+}
+
+void LocalUrlCache::removeSlot(Shard& shard, uint32_t slot) {
+    auto& entry = shard.slots[slot];
+    shard.bytes -= entryCost(entry.url);
+    shard.index.erase(entry.key);
+    entry.used = false;
+    entry.referenced = false;
+    std::string().swap(entry.url);
+    shard.freeSlots.push_back(slot);
+}
+
+bool LocalUrlCache::evictOne(Shard& shard, Clock::time_point now) {
+    const auto size = shard.slots.size();
+    if (shard.index.empty() || size == 0) {
+        return false;
+    }
+    // Two full sweeps are enough: the first clears every reference bit.
+    for (size_t step = 0; step < 2 * size; ++step) {
+        if (shard.hand >= size) {
+            shard.hand = 0;
+        }
+        const auto slot = static_cast<uint32_t>(shard.hand++);
+        auto& entry = shard.slots[slot];
+        if (!entry.used) {
+            continue;
+        }
+        if (entry.expiresAt <= now) {
+            removeSlot(shard, slot);
+            ++shard.expirations;
+            return true;
+        }
+        if (entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+        removeSlot(shard, slot);
+        ++shard.evictions;
+        return true;
+    }
+    return false;
+}
+
+LocalUrlCache::Stats LocalUrlCache::stats() const {
+    Stats total;
+    for (size_t i = 0; i < options_.shards; ++i) {
+        const auto& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.inserts += shard.inserts;
+        total.evictions += shard.evictions;
+        total.expirations += shard.expirations;
+        total.entries += shard.index.size();
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
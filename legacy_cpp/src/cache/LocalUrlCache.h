@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bounded in-process code -> URL cache consulted before Redis.
+// Entries are spread over lock-striped shards and evicted with a CLOCK sweep
+// once a shard exceeds its share of the memory cap. Codes of up to 8 chars
+// are packed into a uint64_t key, so lookups never allocate for the key.
+class LocalUrlCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t maxBytes{64 * 1024 * 1024};
+        size_t shards{16};
+        std::chrono::seconds defaultTtl{std::chrono::seconds{300}};
+    };
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t inserts{0};
+        uint64_t evictions{0};
+        uint64_t expirations{0};
+        size_t entries{0};
+        size_t bytes{0};
+    };
+
+    explicit LocalUrlCache(Options options);
+
+    // Returns std::nullopt for codes that do not fit the inline key.
+    static std::optional<uint64_t> packCode(std::string_view code);
+
+    std::optional<std::string> get(std::string_view code);
+
+    // ttl is clamped to the configured default; non-positive values are ignored.
+    void put(std::string_view code, std::string url, std::chrono::seconds ttl);
+    void put(std::string_view code, std::string url);
+    void erase(std::string_view code);
+    // Drops every entry; hit and eviction counters are kept.
+    void clear();
+
+    Stats stats() const;
+    const Options& options() const { return options_; }
+
+private:
+    struct Entry {
+        uint64_t key{0};
+        std::string url;
+        Clock::time_point expiresAt;
+        bool referenced{false};
+        bool used{false};
+    };
+
+    struct KeyHash {
+        size_t operator()(uint64_t key) const noexcept;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, uint32_t, KeyHash> index;
+        std::vector<Entry> slots;
+        std::vector<uint32_t> freeSlots;
+        size_t hand{0};
+        size_t bytes{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t inserts{0};
+        uint64_t evictions{0};
+        uint64_t expirations{0};
+    };
+
+    Options options_;
+    size_t shardCapacity_;
+    std::unique_ptr<Shard[]> shards_;
+
+    Shard& shardFor(uint64_t key) const;
+    static size_t entryCost(const std::string& url);
+    void removeSlot(Shard& shard, uint32_t slot);
+    bool evictOne(Shard& shard, Clock::time_point now);
+};
@@ -0,0 +1,95 @@
+#include "PopularLinks.h"
+#include "RedisPool.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+// KEYS[1] scores, KEYS[2] decay marker; ARGV: half-life ms, codes kept.
+// A no-op unless the marker has expired, so the instances halve the scores
+// once per half-life between them.
+constexpr const char* kDecayScript =
+    "if not redis.call('SET', KEYS[2], '1', 'NX', 'PX', ARGV[1]) then return 0 end "
+    "redis.call('ZUNIONSTORE', KEYS[1], 1, KEYS[1], 'WEIGHTS', 0.5) "
+    "redis.call('ZREMRANGEBYSCORE', KEYS[1], '-inf', '(1') "
+    "local keep = tonumber(ARGV[2]) "
+    "if keep > 0 then redis.call('ZREMRANGEBYRANK', KEYS[1], 0, -keep - 1) end "
+    "return 1";
+}  // namespace
+
+PopularLinks::PopularLinks(std::shared_ptr<RedisPool> redis, Options options)
+    : redis_(std::move(redis)), options_(options) {
+    if (!redis_) {
+        throw std::runtime_error("RedisPool dependency missing");
+    }
+    options_.sampleEvery = std::max<uint32_t>(options_.sampleEvery, 1);
+}
+
+void PopularLinks::recordRedirect(std::string_view code) {
+    thread_local uint32_t redirects = 0;
+    if (++redirects < options_.sampleEvery) {
+        return;
+    }
+    redirects = 0;
+    const std::string member(code);
+    redis_->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [](const drogon::nosql::RedisException&) {},
+        "zincrby %s %u %s", kKey, options_.sampleEvery, member.c_str());
+    maybeDecay();
+}
+
+void PopularLinks::maybeDecay() {
+    if (options_.halfLife.count() <= 0) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    auto due = nextDecay_.load(std::memory_order_relaxed);
+    if (now.time_since_epoch().count() < due) {
+        return;
+    }
+    // Check again in a tenth of the half-life: another instance may hold the
+    // marker, and this one should take over soon after it expires.
+    const auto retry = std::max<std::chrono::steady_clock::duration>(options_.halfLife / 10, std::chrono::seconds{1});
+    const auto next = now + retry;
+    if (!nextDecay_.compare_exchange_strong(due, next.time_since_epoch().count(), std::memory_order_relaxed)) {
+        return;
+    }
+    const auto halfLifeMs =
+        std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(options_.halfLife).count());
+    const auto keep = std::to_string(options_.maxTracked);
+    redis_->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [](const drogon::nosql::RedisException&) {},
+        "eval %s 2 %s %s %s %s", kDecayScript, kKey, kDecayKey, halfLifeMs.c_str(), keep.c_str());
+}
+
+void PopularLinks::topAsync(size_t count,
+                            TopCallback&& callback,
+                            drogon::nosql::RedisExceptionCallback&& errorCallback) {
+    if (count == 0) {
+        callback({});
+        return;
+    }
+    redis_->execCommandAsync(
+        [callback = std::move(callback)](const drogon::nosql::RedisResult& result) {
+            std::vector<std::string> codes;
+            if (result.type() == drogon::nosql::RedisResultType::kArray) {
+                for (const auto& item : result.asArray()) {
+                    codes.push_back(item.asString());
+                }
+            }
+            callback(std::move(codes));
+        },
+        std::move(errorCallback),
+        "zrevrange %s 0 %lld", kKey, static_cast<long long>(count) - 1);
+}
+
+void PopularLinks::trim() {
+    if (options_.maxTracked == 0) {
+        return;
+    }
+    redis_->execCommandAsync(
+        [](const drogon::nosql::RedisResult&) {},
+        [](const drogon::nosql::RedisException&) {},
+        "zremrangebyrank %s 0 %lld", kKey, -static_cast<long long>(options_.maxTracked) - 1);
+}
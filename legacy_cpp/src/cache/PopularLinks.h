@@ -0,0 +1,57 @@
+#pragma once
+#include <drogon/nosql/RedisClient.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RedisPool;
+
+// Redirect counts per code in a Redis sorted set, shared by every instance
+// and kept across restarts, so a new instance knows which links to warm
+// first. Only one redirect in sampleEvery per IO thread is sent, weighted by
+// sampleEvery, which keeps the counts unbiased at a fraction of the writes.
+// Every halfLife one instance halves all scores and drops the codes left
+// below one redirect, so links that were hot long ago give way to the ones
+// that are hot now. A Redis key with the half-life as its TTL picks that
+// instance.
+class PopularLinks {
+public:
+    struct Options {
+        uint32_t sampleEvery{16};
+        // trim() keeps this many of the most redirected codes.
+        size_t maxTracked{100000};
+        // 0 never decays.
+        std::chrono::seconds halfLife{std::chrono::seconds{6 * 3600}};
+    };
+
+    // Not a valid short code, so it cannot collide with a cached link.
+    static constexpr const char* kKey = "urlshortener:popular";
+    static constexpr const char* kDecayKey = "urlshortener:popular:decayed";
+
+    using TopCallback = std::function<void(std::vector<std::string> codes)>;
+
+    PopularLinks(std::shared_ptr<RedisPool> redis, Options options);
+
+    void recordRedirect(std::string_view code);
+
+    // Most redirected first.
+    void topAsync(size_t count, TopCallback&& callback, drogon::nosql::RedisExceptionCallback&& errorCallback);
+
+    // Drops everything below the maxTracked highest counts.
+    void trim();
+
+    const Options& options() const { return options_; }
+
+private:
+    std::shared_ptr<RedisPool> redis_;
+    Options options_;
+    // steady_clock ticks of this instance's next decay attempt.
+    std::atomic<int64_t> nextDecay_{0};
+
+    void maybeDecay();
+};
@@ -0,0 +1,113 @@
+#include "RedisPool.h"
+#include "../metrics/Metrics.h"
+#include <drogon/drogon.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+int64_t nowTicks() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+}  // namespace
+
+RedisPool::RedisPool(const trantor::InetAddress& address,
+                     const std::string& password,
+                     Options options)
+    : options_(options),
+      breaker_(options.breaker) {
+    auto count = options_.connections;
+    if (count == 0) {
+        count = std::max<size_t>(drogon::app().getThreadNum(), 1);
+    }
+    options_.maxBackoff = std::max(options_.maxBackoff, options_.minBackoff);
+
+    auto& registry = MetricsRegistry::instance();
+    connections_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto connection = std::make_unique<Connection>();
+        connection->client = drogon::nosql::RedisClient::newRedisClient(address, 1, password);
+        if (!connection->client) {
+            throw std::runtime_error("Failed to create Redis client");
+        }
+        if (options_.commandTimeout.count() > 0) {
+            connection->client->setTimeout(static_cast<double>(options_.commandTimeout.count()) / 1000.0);
+        }
+        const auto* raw = connection.get();
+        const MetricLabels labels{{"connection", std::to_string(i)}};
+        registry.gauge("urlshortener_redis_inflight_commands",
+                       "Redis commands sent on a pooled connection and not yet answered", labels,
+                       [raw] { return static_cast<double>(raw->inflight.load(std::memory_order_relaxed)); });
+        registry.gauge("urlshortener_redis_connection_backoff",
+                       "1 while a pooled Redis connection is skipped after errors", labels,
+                       [raw] { return raw->backoffUntil.load(std::memory_order_relaxed) > nowTicks() ? 1.0 : 0.0; });
+        connections_.push_back(std::move(connection));
+    }
+
+    registry.addCollector([this](PrometheusWriter& out) {
+        out.family("urlshortener_redis_breaker_state", "Redis circuit breaker: 0 closed, 1 half-open, 2 open", "gauge");
+        out.sample("urlshortener_redis_breaker_state", {}, static_cast<double>(breaker_.state()));
+        out.family("urlshortener_redis_breaker_trips_total", "Times the Redis circuit breaker opened", "counter");
+        out.sample("urlshortener_redis_breaker_trips_total", {}, static_cast<double>(breaker_.trips()));
+    });
+}
+
+RedisPool::Connection* RedisPool::pick() {
+    // Start at a rotating offset so ties spread evenly.
+    const auto start = cursor_.fetch_add(1, std::memory_order_relaxed);
+    const auto now = nowTicks();
+    Connection* best = nullptr;
+    Connection* soonest = nullptr;
+    int64_t bestLoad = std::numeric_limits<int64_t>::max();
+    for (size_t i = 0; i < connections_.size(); ++i) {
+        auto* connection = connections_[(start + i) % connections_.size()].get();
+        const auto until = connection->backoffUntil.load(std::memory_order_relaxed);
+        if (until > now) {
+            if (!soonest || until < soonest->backoffUntil.load(std::memory_order_relaxed)) {
+                soonest = connection;
+            }
+            continue;
+        }
+        const auto load = connection->inflight.load(std::memory_order_relaxed);
+        if (load < bestLoad) {
+            best = connection;
+            bestLoad = load;
+            if (load == 0) {
+                break;
+            }
+        }
+    }
+    return best ? best : soonest;
+}
+
+void RedisPool::pingConnection(size_t index,
+                               std::function<void()>&& callback,
+                               drogon::nosql::RedisExceptionCallback&& exceptionCallback) {
+    connections_.at(index)->client->execCommandAsync(
+        [callback = std::move(callback)](const drogon::nosql::RedisResult&) { callback(); },
+        std::move(exceptionCallback),
+        "ping");
+}
+
+void RedisPool::onError(Connection& connection,
+                        const CircuitBreaker::Permit& permit,
+                        const drogon::nosql::RedisException& error) {
+    // An error reply (WRONGTYPE and friends) means the server is up.
+    if (error.code() == drogon::nosql::RedisErrorCode::kRedisError) {
+        breaker_.recordSuccess(permit);
+        return;
+    }
+    breaker_.recordFailure(permit);
+    const auto failures = std::min<uint32_t>(connection.failures.fetch_add(1, std::memory_order_relaxed), 16);
+    const auto backoff = std::min(options_.minBackoff * (int64_t{1} << failures), options_.maxBackoff);
+    const auto until = std::chrono::steady_clock::now() + backoff;
+    connection.backoffUntil.store(until.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void RedisPool::rejectOpen(const drogon::nosql::RedisExceptionCallback& exceptionCallback) {
+    static auto& rejected = MetricsRegistry::instance().counter(
+        "urlshortener_redis_breaker_rejected_total", "Redis commands failed fast while the circuit breaker was open");
+    rejected.inc();
+    exceptionCallback(drogon::nosql::RedisException(drogon::nosql::RedisErrorCode::kNoConnectionAvailable,
+                                                    "redis circuit breaker open"));
+}
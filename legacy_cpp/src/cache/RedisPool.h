@@ -0,0 +1,98 @@
+#pragma once
+#include "CircuitBreaker.h"
+#include <drogon/nosql/RedisClient.h>
+#include <trantor/net/InetAddress.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Spreads Redis commands over several independent connections. Each command
+// goes to the connection with the fewest outstanding commands; commands
+// queued on one connection are written back to back, so they pipeline.
+// A connection that errors is avoided for an exponentially growing backoff
+// while Drogon reconnects it, unless every connection is backing off.
+// Every command has a timeout, and a pool-wide circuit breaker fails
+// commands immediately once Redis keeps erroring, so callers can fall back
+// to Postgres without waiting.
+class RedisPool {
+public:
+    struct Options {
+        // 0 means one connection per IO thread.
+        size_t connections{0};
+        std::chrono::milliseconds minBackoff{std::chrono::milliseconds{100}};
+        std::chrono::milliseconds maxBackoff{std::chrono::milliseconds{5000}};
+        // 0 disables the per-command timeout.
+        std::chrono::milliseconds commandTimeout{std::chrono::milliseconds{50}};
+        CircuitBreaker::Options breaker;
+    };
+
+    RedisPool(const trantor::InetAddress& address,
+              const std::string& password,
+              Options options);
+
+    template <typename... Args>
+    void execCommandAsync(drogon::nosql::RedisResultCallback&& resultCallback,
+                          drogon::nosql::RedisExceptionCallback&& exceptionCallback,
+                          std::string_view command,
+                          Args&&... args) {
+        const auto permit = breaker_.allowRequest();
+        if (!permit) {
+            rejectOpen(exceptionCallback);
+            return;
+        }
+        auto* connection = pick();
+        connection->inflight.fetch_add(1, std::memory_order_relaxed);
+        connection->client->execCommandAsync(
+            [this, connection, permit, resultCallback = std::move(resultCallback)](
+                const drogon::nosql::RedisResult& result) {
+                connection->inflight.fetch_sub(1, std::memory_order_relaxed);
+                connection->failures.store(0, std::memory_order_relaxed);
+                connection->backoffUntil.store(0, std::memory_order_relaxed);
+                breaker_.recordSuccess(permit);
+                resultCallback(result);
+            },
+            [this, connection, permit, exceptionCallback = std::move(exceptionCallback)](
+                const drogon::nosql::RedisException& error) {
+                connection->inflight.fetch_sub(1, std::memory_order_relaxed);
+                onError(*connection, permit, error);
+                exceptionCallback(error);
+            },
+            command,
+            std::forward<Args>(args)...);
+    }
+
+    // PING on one specific connection, bypassing the breaker and the backoff
+    // so health probes see every connection's own state.
+    void pingConnection(size_t index,
+                        std::function<void()>&& callback,
+                        drogon::nosql::RedisExceptionCallback&& exceptionCallback);
+
+    size_t size() const { return connections_.size(); }
+    const CircuitBreaker& breaker() const { return breaker_; }
+
+private:
+    struct alignas(64) Connection {
+        drogon::nosql::RedisClientPtr client;
+        std::atomic<int64_t> inflight{0};
+        std::atomic<uint32_t> failures{0};
+        // steady_clock ticks; 0 when the connection is usable
+        std::atomic<int64_t> backoffUntil{0};
+    };
+
+    Options options_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::atomic<size_t> cursor_{0};
+    CircuitBreaker breaker_;
+
+    Connection* pick();
+    void onError(Connection& connection,
+                 const CircuitBreaker::Permit& permit,
+                 const drogon::nosql::RedisException& error);
+    void rejectOpen(const drogon::nosql::RedisExceptionCallback& exceptionCallback);
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Coalesces concurrent work for the same key: the first caller becomes the
+// leader and performs the work, later callers just park a waiter, and
+// complete() hands the leader's result to every waiter. Keys are striped
+// across independently locked shards.
+template <typename Result>
+class SingleFlight {
+public:
+    using Waiter = std::function<void(const Result&)>;
+
+    // Returns true when the caller is the leader and must eventually call
+    // complete() for this key.
+    bool join(const std::string& key, Waiter waiter) {
+        auto& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto [it, inserted] = shard.calls.try_emplace(key);
+        it->second.push_back(std::move(waiter));
+        if (!inserted) {
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return inserted;
+    }
+
+    void complete(const std::string& key, const Result& result) {
+        std::vector<Waiter> waiters;
+        {
+            auto& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.calls.find(key);
+            if (it == shard.calls.end()) {
+                return;
+            }
+            waiters = std::move(it->second);
+            shard.calls.erase(it);
+        }
+        // Run outside the lock so a waiter may start a new flight for the key.
+        for (auto& waiter : waiters) {
+            waiter(result);
+        }
+    }
+
+    size_t inflight() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.calls.size();
+        }
+        return total;
+    }
+
+    uint64_t coalesced() const {
+        return coalesced_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t kShards = 16;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::vector<Waiter>> calls;
+    };
+
+    Shard shards_[kShards];
+    std::atomic<uint64_t> coalesced_{0};
+
+    Shard& shardFor(const std::string& key) {
+        return shards_[std::hash<std::string>{}(key) % kShards];
+    }
+};
@@ -0,0 +1,111 @@
+#include "SnapshotReloader.h"
+#include "../metrics/Metrics.h"
+#include <trantor/utils/Logger.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+SnapshotReloader::SnapshotReloader(Options options)
+    : options_(std::move(options)) {
+    if (options_.path.empty()) {
+        throw std::runtime_error("snapshot path is required");
+    }
+    if (options_.interval.count() <= 0) {
+        throw std::runtime_error("snapshot reload interval must be positive");
+    }
+
+    MetricsRegistry::instance().addCollector([this](PrometheusWriter& out) {
+        auto snapshot = current();
+        out.family("urlshortener_snapshot_loaded", "1 while a URL snapshot is mapped", "gauge");
+        out.sample("urlshortener_snapshot_loaded", {}, snapshot ? 1.0 : 0.0);
+        out.family("urlshortener_snapshot_loads_total", "URL snapshot loads by outcome", "counter");
+        out.sample("urlshortener_snapshot_loads_total", {{"result", "ok"}},
+                   static_cast<double>(loads_.load(std::memory_order_relaxed)));
+        out.sample("urlshortener_snapshot_loads_total", {{"result", "error"}},
+                   static_cast<double>(loadFailures_.load(std::memory_order_relaxed)));
+        if (!snapshot) {
+            return;
+        }
+        out.family("urlshortener_snapshot_links", "Links in the mapped URL snapshot", "gauge");
+        out.sample("urlshortener_snapshot_links", {}, static_cast<double>(snapshot->size()));
+        out.family("urlshortener_snapshot_bytes", "Size of the mapped URL snapshot file", "gauge");
+        out.sample("urlshortener_snapshot_bytes", {}, static_cast<double>(snapshot->fileBytes()));
+        out.family("urlshortener_snapshot_age_seconds", "Time since the mapped URL snapshot was built", "gauge");
+        out.sample("urlshortener_snapshot_age_seconds", {},
+                   std::chrono::duration<double>(UrlSnapshot::SystemClock::now() - snapshot->builtAt()).count());
+    });
+}
+
+SnapshotReloader::~SnapshotReloader() {
+    stop();
+}
+
+void SnapshotReloader::start() {
+    reload();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (worker_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    worker_ = std::thread([this] { run(); });
+}
+
+void SnapshotReloader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+bool SnapshotReloader::reload() {
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    struct stat st{};
+    if (::stat(options_.path.c_str(), &st) != 0) {
+        if (errno != ENOENT) {
+            LOG_WARN << "Cannot stat URL snapshot " << options_.path << ": " << std::strerror(errno);
+        }
+        return false;
+    }
+    const FileIdentity identity{
+        static_cast<uint64_t>(st.st_dev),
+        static_cast<uint64_t>(st.st_ino),
+        static_cast<int64_t>(st.st_size),
+        static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+    };
+    if (identity == loaded_) {
+        return false;
+    }
+    bool swapped = false;
+    try {
+        auto snapshot = UrlSnapshot::open(options_.path);
+        LOG_INFO << "Mapped URL snapshot " << options_.path << ": " << snapshot->size() << " links, "
+                 << snapshot->fileBytes() << " bytes";
+        current_.store(std::move(snapshot), std::memory_order_release);
+        loads_.fetch_add(1, std::memory_order_relaxed);
+        swapped = true;
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Keeping the previous URL snapshot: " << e.what();
+        loadFailures_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Also recorded on failure so a broken file is reported once, not every poll.
+    loaded_ = identity;
+    return swapped;
+}
+
+void SnapshotReloader::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wakeup_.wait_for(lock, options_.interval, [this] { return stopping_; });
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+        reload();
+        lock.lock();
+    }
+}
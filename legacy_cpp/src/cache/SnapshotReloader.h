@@ -0,0 +1,69 @@
+#pragma once
+#include "UrlSnapshot.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Keeps the newest UrlSnapshot at a path mapped. A background thread checks
+// the file on an interval and, when a builder has renamed a new one into
+// place, maps it and swaps it in atomically. Requests holding the previous
+// snapshot keep it mapped until they drop it. A file that fails to open is
+// logged and the previous snapshot stays in service. Replace the file only
+// by renaming over it: truncating or rewriting a mapped file in place
+// crashes readers with SIGBUS.
+class SnapshotReloader {
+public:
+    struct Options {
+        std::string path;
+        std::chrono::seconds interval{std::chrono::seconds{30}};
+    };
+
+    explicit SnapshotReloader(Options options);
+    ~SnapshotReloader();
+
+    SnapshotReloader(const SnapshotReloader&) = delete;
+    SnapshotReloader& operator=(const SnapshotReloader&) = delete;
+
+    // Loads the current file, if any, before returning, then starts polling.
+    void start();
+    void stop();
+
+    // Null until a snapshot has been loaded.
+    std::shared_ptr<const UrlSnapshot> current() const {
+        return current_.load(std::memory_order_acquire);
+    }
+
+    // Maps the file now if it changed since the last load. True when a new
+    // snapshot was swapped in.
+    bool reload();
+
+private:
+    struct FileIdentity {
+        uint64_t device{0};
+        uint64_t inode{0};
+        int64_t size{0};
+        int64_t modifiedNanos{0};
+        bool operator==(const FileIdentity&) const = default;
+    };
+
+    Options options_;
+    std::atomic<std::shared_ptr<const UrlSnapshot>> current_;
+
+    std::mutex reloadMutex_;
+    FileIdentity loaded_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_{false};
+    std::thread worker_;
+
+    std::atomic<uint64_t> loads_{0};
+    std::atomic<uint64_t> loadFailures_{0};
+
+    void run();
+};
@@ -0,0 +1,270 @@
+#include "UrlSnapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::chrono;
+
+namespace {
+constexpr char kMagic[8] = {'U', 'R', 'L', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr uint32_t kVersion = 1;
+constexpr size_t kFanoutSlots = 65536;
+
+struct FileHeader {
+    char magic[8];
+    // Written in the builder's byte order; a mismatch means another architecture.
+    uint32_t byteOrder;
+    uint32_t version;
+    uint64_t count;
+    uint64_t heapOffset;
+    uint64_t heapSize;
+    // kFanoutSlots + 1 entry indexes: codes whose first two bytes are b live in
+    // [fanout[b], fanout[b + 1]).
+    uint64_t fanoutOffset;
+    uint64_t entriesOffset;
+    int64_t builtAtMicros;
+};
+static_assert(sizeof(FileHeader) == 64, "snapshot header layout changed");
+
+uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~uint64_t{7};
+}
+
+size_t fanoutSlot(uint64_t key) {
+    return static_cast<size_t>(key >> 48);
+}
+
+std::string errnoMessage(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + std::strerror(errno);
+}
+}  // namespace
+
+std::optional<uint64_t> UrlSnapshot::packCode(std::string_view code) {
+    if (code.empty() || code.size() > sizeof(uint64_t)) {
+        return std::nullopt;
+    }
+    uint64_t key = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+        key <<= 8;
+        if (i < code.size()) {
+            key |= static_cast<unsigned char>(code[i]);
+        }
+    }
+    return key;
+}
+
+std::shared_ptr<const UrlSnapshot> UrlSnapshot::open(const std::string& path) {
+    static_assert(sizeof(Entry) == 24, "snapshot entry layout changed");
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(errnoMessage("cannot open snapshot", path));
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        const auto message = errnoMessage("cannot stat snapshot", path);
+        ::close(fd);
+        throw std::runtime_error(message);
+    }
+    const auto length = static_cast<size_t>(st.st_size);
+    if (length < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("snapshot " + path + " is truncated");
+    }
+    void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file alive, even once a newer snapshot is renamed over it.
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error(errnoMessage("cannot map snapshot", path));
+    }
+
+    std::shared_ptr<UrlSnapshot> snapshot(new UrlSnapshot());
+    snapshot->path_ = path;
+    snapshot->base_ = static_cast<const unsigned char*>(mapped);
+    snapshot->length_ = length;
+
+    FileHeader header;
+    std::memcpy(&header, snapshot->base_, sizeof(header));
+    auto malformed = [&](const char* why) {
+        return std::runtime_error("snapshot " + path + " is malformed: " + why);
+    };
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        throw malformed("bad magic");
+    }
+    if (header.byteOrder != kByteOrderMark) {
+        throw malformed("built on a machine with another byte order");
+    }
+    if (header.version != kVersion) {
+        throw malformed("unsupported version");
+    }
+    const uint64_t fanoutBytes = (kFanoutSlots + 1) * sizeof(uint64_t);
+    if (header.heapOffset > length || header.heapSize > length - header.heapOffset ||
+        header.fanoutOffset % 8 != 0 || header.fanoutOffset > length || fanoutBytes > length - header.fanoutOffset ||
+        header.entriesOffset % 8 != 0 || header.entriesOffset > length ||
+        header.count > (length - header.entriesOffset) / sizeof(Entry)) {
+        throw malformed("section out of bounds");
+    }
+    snapshot->fanout_ = reinterpret_cast<const uint64_t*>(snapshot->base_ + header.fanoutOffset);
+    snapshot->entries_ = reinterpret_cast<const Entry*>(snapshot->base_ + header.entriesOffset);
+    snapshot->count_ = header.count;
+    snapshot->heap_ = reinterpret_cast<const char*>(snapshot->base_ + header.heapOffset);
+    snapshot->heapSize_ = header.heapSize;
+    snapshot->builtAt_ = TimePoint(duration_cast<SystemClock::duration>(microseconds(header.builtAtMicros)));
+
+    // Lookups trust the fanout for their search bounds.
+    if (snapshot->fanout_[0] != 0 || snapshot->fanout_[kFanoutSlots] != header.count) {
+        throw malformed("fanout does not cover the entries");
+    }
+    for (size_t i = 0; i < kFanoutSlots; ++i) {
+        if (snapshot->fanout_[i] > snapshot->fanout_[i + 1]) {
+            throw malformed("fanout is not monotonic");
+        }
+    }
+
+    // Redirect lookups touch a few scattered pages each; don't read ahead.
+    ::madvise(mapped, length, MADV_RANDOM);
+    return snapshot;
+}
+
+UrlSnapshot::~UrlSnapshot() {
+    if (base_) {
+        ::munmap(const_cast<unsigned char*>(base_), length_);
+    }
+}
+
+std::optional<UrlSnapshot::Hit> UrlSnapshot::find(std::string_view code) const {
+    const auto key = packCode(code);
+    if (!key) {
+        return std::nullopt;
+    }
+    const auto slot = fanoutSlot(*key);
+    const auto* first = entries_ + fanout_[slot];
+    const auto* last = entries_ + fanout_[slot + 1];
+    const auto* it = std::lower_bound(first, last, *key,
+                                      [](const Entry& entry, uint64_t k) { return entry.key < k; });
+    if (it == last || it->key != *key) {
+        return std::nullopt;
+    }
+    if (it->urlOffset > heapSize_ || it->urlLength > heapSize_ - it->urlOffset) {
+        return std::nullopt;
+    }
+    Hit hit;
+    hit.url = std::string_view(heap_ + it->urlOffset, it->urlLength);
+    if (it->expiresAtSeconds != 0) {
+        hit.expiresAt = TimePoint(seconds(it->expiresAtSeconds));
+    }
+    return hit;
+}
+
+UrlSnapshotWriter::UrlSnapshotWriter(std::string path)
+    : path_(std::move(path)),
+      tmpPath_(path_ + ".tmp") {
+    if (path_.empty()) {
+        throw std::runtime_error("snapshot path is required");
+    }
+    file_ = std::fopen(tmpPath_.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error(errnoMessage("cannot create", tmpPath_));
+    }
+    // Header is filled in by commit(); the URL heap follows it directly.
+    const FileHeader placeholder{};
+    write(&placeholder, sizeof(placeholder));
+}
+
+UrlSnapshotWriter::~UrlSnapshotWriter() {
+    if (file_) {
+        std::fclose(file_);
+    }
+    if (!committed_) {
+        std::remove(tmpPath_.c_str());
+    }
+}
+
+void UrlSnapshotWriter::write(const void* data, size_t size) {
+    if (size > 0 && std::fwrite(data, 1, size, file_) != size) {
+        throw std::runtime_error(errnoMessage("cannot write", tmpPath_));
+    }
+}
+
+bool UrlSnapshotWriter::add(std::string_view code,
+                            std::string_view url,
+                            std::optional<UrlSnapshot::TimePoint> expiresAt) {
+    if (committed_) {
+        throw std::logic_error("snapshot already committed");
+    }
+    const auto key = UrlSnapshot::packCode(code);
+    if (!key || url.size() > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    uint32_t expiresAtSeconds = 0;
+    if (expiresAt) {
+        const auto secs = duration_cast<seconds>(expiresAt->time_since_epoch()).count();
+        // Already expired links keep a nonzero stamp so they still read as expired.
+        expiresAtSeconds = static_cast<uint32_t>(
+            std::clamp<int64_t>(secs, 1, std::numeric_limits<uint32_t>::max()));
+    }
+    entries_.push_back(UrlSnapshot::Entry{*key, heapSize_, static_cast<uint32_t>(url.size()), expiresAtSeconds});
+    write(url.data(), url.size());
+    heapSize_ += url.size();
+    return true;
+}
+
+uint64_t UrlSnapshotWriter::commit() {
+    if (committed_) {
+        throw std::logic_error("snapshot already committed");
+    }
+    std::sort(entries_.begin(), entries_.end(),
+              [](const UrlSnapshot::Entry& a, const UrlSnapshot::Entry& b) { return a.key < b.key; });
+    const auto duplicate = std::adjacent_find(
+        entries_.begin(), entries_.end(),
+        [](const UrlSnapshot::Entry& a, const UrlSnapshot::Entry& b) { return a.key == b.key; });
+    if (duplicate != entries_.end()) {
+        throw std::runtime_error("snapshot rows contain a duplicate code");
+    }
+
+    std::vector<uint64_t> fanout(kFanoutSlots + 1, 0);
+    for (const auto& entry : entries_) {
+        ++fanout[fanoutSlot(entry.key) + 1];
+    }
+    for (size_t i = 1; i < fanout.size(); ++i) {
+        fanout[i] += fanout[i - 1];
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.byteOrder = kByteOrderMark;
+    header.version = kVersion;
+    header.count = entries_.size();
+    header.heapOffset = sizeof(FileHeader);
+    header.heapSize = heapSize_;
+    header.fanoutOffset = align8(header.heapOffset + heapSize_);
+    header.entriesOffset = header.fanoutOffset + fanout.size() * sizeof(uint64_t);
+    header.builtAtMicros = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+
+    const char padding[8] = {};
+    write(padding, header.fanoutOffset - (header.heapOffset + heapSize_));
+    write(fanout.data(), fanout.size() * sizeof(uint64_t));
+    write(entries_.data(), entries_.size() * sizeof(UrlSnapshot::Entry));
+    if (std::fseek(file_, 0, SEEK_SET) != 0) {
+        throw std::runtime_error(errnoMessage("cannot seek", tmpPath_));
+    }
+    write(&header, sizeof(header));
+    if (std::fflush(file_) != 0 || ::fsync(::fileno(file_)) != 0) {
+        throw std::runtime_error(errnoMessage("cannot flush", tmpPath_));
+    }
+    std::fclose(file_);
+    file_ = nullptr;
+    if (std::rename(tmpPath_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error(errnoMessage("cannot rename snapshot to", path_));
+    }
+    committed_ = true;
+    entries_.clear();
+    entries_.shrink_to_fit();
+    return header.count;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only, memory-mapped copy of url_mapping for answering redirects
+// without Redis or Postgres. The file is a header, a heap of URL bytes, a
+// 65536-way fanout table on the first two code bytes and an array of
+// fixed-size entries sorted by code, so a lookup is one fanout read plus a
+// short binary search, and opening a file of any size costs one mmap.
+//
+// Snapshots are point-in-time: a code that is missing may have been created
+// since, so only hits are answers. Codes longer than eight bytes are not
+// indexed. Expiry is stored rounded down to the second, so a snapshot never
+// serves a link after Postgres would have stopped serving it.
+class UrlSnapshot {
+public:
+    using SystemClock = std::chrono::system_clock;
+    using TimePoint = SystemClock::time_point;
+
+    struct Hit {
+        // Points into the mapping; valid while the snapshot is alive.
+        std::string_view url;
+        std::optional<TimePoint> expiresAt;
+    };
+
+    // Maps the file read-only. Throws std::runtime_error when it cannot be
+    // read or is not a well-formed snapshot.
+    static std::shared_ptr<const UrlSnapshot> open(const std::string& path);
+    ~UrlSnapshot();
+
+    UrlSnapshot(const UrlSnapshot&) = delete;
+    UrlSnapshot& operator=(const UrlSnapshot&) = delete;
+
+    std::optional<Hit> find(std::string_view code) const;
+
+    uint64_t size() const { return count_; }
+    size_t fileBytes() const { return length_; }
+    TimePoint builtAt() const { return builtAt_; }
+    const std::string& path() const { return path_; }
+
+    // Codes are packed big-endian so integer order is byte order.
+    static std::optional<uint64_t> packCode(std::string_view code);
+
+private:
+    friend class UrlSnapshotWriter;
+
+    struct Entry {
+        uint64_t key;
+        uint64_t urlOffset;
+        uint32_t urlLength;
+        // Seconds since the epoch, rounded down; 0 when the link never expires.
+        uint32_t expiresAtSeconds;
+    };
+
+    std::string path_;
+    const unsigned char* base_{nullptr};
+    size_t length_{0};
+    const uint64_t* fanout_{nullptr};
+    const Entry* entries_{nullptr};
+    uint64_t count_{0};
+    const char* heap_{nullptr};
+    uint64_t heapSize_{0};
+    TimePoint builtAt_;
+
+    UrlSnapshot() = default;
+};
+
+// Writes a snapshot to `path` + ".tmp" and renames it over `path` on commit,
+// so a server watching the path only ever sees complete files. URLs are
+// streamed to disk as they are added; the index costs 24 bytes per link in
+// memory until commit.
+class UrlSnapshotWriter {
+public:
+    explicit UrlSnapshotWriter(std::string path);
+    ~UrlSnapshotWriter();
+
+    UrlSnapshotWriter(const UrlSnapshotWriter&) = delete;
+    UrlSnapshotWriter& operator=(const UrlSnapshotWriter&) = delete;
+
+    // Rows may come in any order. False when the code cannot be indexed.
+    bool add(std::string_view code, std::string_view url, std::optional<UrlSnapshot::TimePoint> expiresAt);
+
+    // Returns the number of links written.
+    uint64_t commit();
+
+private:
+    std::string path_;
+    std::string tmpPath_;
+    std::FILE* file_{nullptr};
+    uint64_t heapSize_{0};
+    std::vector<UrlSnapshot::Entry> entries_;
+    bool committed_{false};
+
+    void write(const void* data, size_t size);
+};
@@ -2,9 +2,14 @@
 #include "../services/ServiceError.h"
 #include <drogon/drogon.h>
 #include <json/json.h>
+#include <stdexcept>
 
 AuthController::AuthController(std::shared_ptr<AuthService> authService)
-    : authService_(std::move(authService)) {}
+    : authService_(std::move(authService)) {
+    if (!authService_) {
+        throw std::runtime_error("AuthService dependency missing");
+    }
+}
 
 void AuthController::handleRegister(const drogon::HttpRequestPtr& req,
                                     std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
@@ -28,15 +33,11 @@ void AuthController::handleRegister(const drogon::HttpRequestPtr& req,
     auto name = (*body)["name"].asString();
     auto email = (*body)["email"].asString();
     auto password = (*body)["password"].asString();
-    try {
-        auto result = authService_->registerUser(name, email, password);
-        cb(successResponse(result));
-    } catch (const ServiceError& err) {
-        cb(errorResponse(err.status(), err.what()));
-    } catch (const drogon::orm::DrogonDbException& e) {
-        cb(errorResponse(drogon::k500InternalServerError,
-                         std::string("db error: ") + e.base().what()));
-    }
+    dispatch([authService = authService_, name = std::move(name), email = std::move(email),
+              password = std::move(password)] {
+                 return authService->registerUser(name, email, password);
+             },
+             std::move(cb));
 }
 
 void AuthController::handleLogin(const drogon::HttpRequestPtr& req,
@@ -56,15 +57,30 @@ void AuthController::handleLogin(const drogon::HttpRequestPtr& req,
     }
     auto email = (*body)["email"].asString();
     auto password = (*body)["password"].asString();
-    try {
-        auto result = authService_->login(email, password);
-        cb(successResponse(result));
-    } catch (const ServiceError& err) {
-        cb(errorResponse(err.status(), err.what()));
-    } catch (const drogon::orm::DrogonDbException& e) {
-        cb(errorResponse(drogon::k500InternalServerError,
-                         std::string("db error: ") + e.base().what()));
-    }
+    dispatch([authService = authService_, email = std::move(email), password = std::move(password)] {
+                 return authService->login(email, password);
+             },
+             std::move(cb));
+}
+
+void AuthController::dispatch(std::function<drogon::Task<AuthService::LoginResult>()> work,
+                              std::function<void(const drogon::HttpResponsePtr&)>&& cb) {
+    drogon::async_run([this, work = std::move(work), callback = std::move(cb)]() -> drogon::Task<> {
+        drogon::HttpResponsePtr resp;
+        try {
+            resp = successResponse(co_await work());
+        } catch (const ServiceError& err) {
+            resp = errorResponse(err.status(), err.what());
+            if (err.status() == drogon::k503ServiceUnavailable) {
+                resp->addHeader("Retry-After", "1");
+            }
+        } catch (const drogon::orm::DrogonDbException& e) {
+            resp = errorResponse(drogon::k500InternalServerError, std::string("db error: ") + e.base().what());
+        } catch (const std::exception& e) {
+            resp = errorResponse(drogon::k500InternalServerError, e.what());
+        }
+        callback(resp);
+    });
 }
 
 drogon::HttpResponsePtr AuthController::validationError(const std::string& message) const {
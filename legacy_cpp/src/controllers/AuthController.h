@@ -1,6 +1,7 @@
 #pragma once
 #include "../services/AuthService.h"
 #include <drogon/HttpController.h>
+#include <drogon/utils/coroutine.h>
 #include <functional>
 #include <memory>
 
@@ -17,6 +18,11 @@ public:
 private:
     std::shared_ptr<AuthService> authService_;
 
+    // Runs work as a coroutine and maps its outcome to a response; a
+    // saturated KDF pool answers 503 with Retry-After.
+    void dispatch(std::function<drogon::Task<AuthService::LoginResult>()> work,
+                  std::function<void(const drogon::HttpResponsePtr&)>&& cb);
+
     drogon::HttpResponsePtr validationError(const std::string& message) const;
     drogon::HttpResponsePtr errorResponse(drogon::HttpStatusCode status,
                                           const std::string& message) const;
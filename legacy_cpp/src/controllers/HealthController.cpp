@@ -0,0 +1,62 @@
+#include "HealthController.h"
+#include <drogon/drogon.h>
+#include <stdexcept>
+
+using namespace drogon;
+
+namespace {
+HttpResponsePtr textResponse(HttpStatusCode status, const char* body) {
+    auto resp = HttpResponse::newHttpResponse();
+    resp->setStatusCode(status);
+    resp->setContentTypeCode(CT_TEXT_PLAIN);
+    resp->setBody(body);
+    return resp;
+}
+}  // namespace
+
+HealthController::HealthController(std::shared_ptr<HealthMonitor> monitor)
+    : monitor_(std::move(monitor)) {
+    if (!monitor_) {
+        throw std::runtime_error("HealthMonitor dependency missing");
+    }
+}
+
+void HealthController::handleHealth(const HttpRequestPtr&,
+                                    std::function<void(const HttpResponsePtr&)>&& cb) const {
+    auto snapshot = monitor_->snapshot();
+    if (!snapshot) {
+        cb(textResponse(k503ServiceUnavailable, "starting"));
+    } else if (snapshot->warmingUp) {
+        cb(textResponse(k503ServiceUnavailable, "warming-up"));
+    } else if (!snapshot->ready()) {
+        cb(textResponse(k503ServiceUnavailable, "db-unavailable"));
+    } else if (snapshot->degraded()) {
+        cb(textResponse(k200OK, "degraded"));
+    } else {
+        cb(textResponse(k200OK, "ok"));
+    }
+}
+
+void HealthController::handleReady(const HttpRequestPtr&,
+                                   std::function<void(const HttpResponsePtr&)>&& cb) const {
+    auto snapshot = monitor_->snapshot();
+    auto resp = HttpResponse::newHttpResponse();
+    resp->setContentTypeCode(CT_APPLICATION_JSON);
+    if (!snapshot) {
+        resp->setStatusCode(k503ServiceUnavailable);
+        resp->setBody(R"({"status":"starting"})");
+    } else {
+        resp->setStatusCode(snapshot->ready() ? k200OK : k503ServiceUnavailable);
+        resp->setBody(snapshot->json);
+    }
+    cb(resp);
+}
+
+void HealthController::handleLive(const HttpRequestPtr&,
+                                  std::function<void(const HttpResponsePtr&)>&& cb) const {
+    if (monitor_->live()) {
+        cb(textResponse(k200OK, "ok"));
+    } else {
+        cb(textResponse(k503ServiceUnavailable, "health probes stalled"));
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "../services/HealthMonitor.h"
+#include <drogon/HttpController.h>
+#include <functional>
+#include <memory>
+
+// Health endpoints answered from HealthMonitor's latest snapshot; none of
+// them touches Postgres or Redis.
+//   /api/v1/health        readiness as plain text ("ok", "degraded", ...)
+//   /api/v1/health/ready  503 until Postgres answers; Redis loss only degrades
+//   /api/v1/health/live   503 only when the probe thread has stopped making progress
+class HealthController {
+public:
+    explicit HealthController(std::shared_ptr<HealthMonitor> monitor);
+
+    void handleHealth(const drogon::HttpRequestPtr& req,
+                      std::function<void(const drogon::HttpResponsePtr&)>&& cb) const;
+
+    void handleReady(const drogon::HttpRequestPtr& req,
+                     std::function<void(const drogon::HttpResponsePtr&)>&& cb) const;
+
+    void handleLive(const drogon::HttpRequestPtr& req,
+                    std::function<void(const drogon::HttpResponsePtr&)>&& cb) const;
+
+private:
+    std::shared_ptr<HealthMonitor> monitor_;
+};
@@ -0,0 +1,193 @@
+#include "AsyncLogSink.h"
+#include "../metrics/Metrics.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+constexpr size_t kBatchBytes = 64 * 1024;
+constexpr auto kFlushTimeout = std::chrono::milliseconds{200};
+
+size_t roundUpPow2(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+}  // namespace
+
+AsyncLogSink::AsyncLogSink(Options options)
+    : options_(options),
+      mask_(roundUpPow2(options.capacity) - 1),
+      slots_(std::make_unique<Slot[]>(mask_ + 1)),
+      written_(MetricsRegistry::instance().counter(
+          "urlshortener_log_records_total", "Log records by outcome", {{"result", "written"}})),
+      dropped_(MetricsRegistry::instance().counter(
+          "urlshortener_log_records_total", "Log records by outcome", {{"result", "dropped"}})),
+      truncated_(MetricsRegistry::instance().counter(
+          "urlshortener_log_records_truncated_total", "Log records cut to the ring's slot size")),
+      batch_(std::make_unique<char[]>(kBatchBytes)) {
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    MetricsRegistry::instance().gauge("urlshortener_log_queue_depth", "Log records waiting for the writer thread", {},
+                                      [this] { return static_cast<double>(depth()); });
+    writer_ = std::thread([this] { run(); });
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    stop();
+    if (installed_) {
+        trantor::Logger::setOutputFunction(
+            [](const char* msg, uint64_t len) { std::fwrite(msg, 1, len, stdout); },
+            [] { std::fflush(stdout); });
+    }
+}
+
+void AsyncLogSink::install() {
+    installed_ = true;
+    trantor::Logger::setOutputFunction(
+        [this](const char* msg, uint64_t len) { append(msg, static_cast<size_t>(len)); },
+        [this] { flush(); });
+}
+
+void AsyncLogSink::append(const char* data, size_t length) {
+    if (stopped_.load(std::memory_order_acquire)) {
+        writeAll(data, length);
+        return;
+    }
+
+    auto pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[pos & mask_];
+        const auto sequence = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<int64_t>(sequence - pos);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The writer has not released this slot yet: the ring is full.
+            dropped_.inc();
+            return;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (length > kRecordBytes) {
+        std::memcpy(slot->data, data, kRecordBytes - 1);
+        slot->data[kRecordBytes - 1] = '\n';
+        slot->length = kRecordBytes;
+        truncated_.inc();
+    } else {
+        std::memcpy(slot->data, data, length);
+        slot->length = static_cast<uint32_t>(length);
+    }
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void AsyncLogSink::flush() {
+    if (stopped_.load(std::memory_order_acquire)) {
+        return;
+    }
+    const auto target = tail_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    flushRequested_ = true;
+    wakeup_.notify_one();
+    drained_.wait_for(lock, kFlushTimeout, [&] {
+        return head_.load(std::memory_order_acquire) >= target || stopped_.load(std::memory_order_acquire);
+    });
+}
+
+void AsyncLogSink::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_.exchange(true)) {
+            return;
+        }
+    }
+    wakeup_.notify_all();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    // Appends racing the shutdown may have landed after the writer's last
+    // pass; the writer is gone, so this thread is now the only consumer.
+    stopped_.store(true, std::memory_order_release);
+    drain();
+    drained_.notify_all();
+}
+
+size_t AsyncLogSink::depth() const {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    const auto head = head_.load(std::memory_order_relaxed);
+    return tail > head ? static_cast<size_t>(tail - head) : 0;
+}
+
+void AsyncLogSink::run() {
+    for (;;) {
+        const auto drainedRecords = drain();
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (flushRequested_) {
+            flushRequested_ = false;
+            drained_.notify_all();
+        }
+        if (drainedRecords > 0) {
+            continue;
+        }
+        if (stopping_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        // Producers never signal, so an idle writer polls at flushInterval.
+        wakeup_.wait_for(lock, options_.flushInterval, [this] {
+            return flushRequested_ || stopping_.load(std::memory_order_relaxed);
+        });
+    }
+}
+
+size_t AsyncLogSink::drain() {
+    size_t records = 0;
+    size_t used = 0;
+    for (;;) {
+        const auto pos = head_.load(std::memory_order_relaxed);
+        auto& slot = slots_[pos & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+        if (used + slot.length > kBatchBytes) {
+            writeAll(batch_.get(), used);
+            used = 0;
+        }
+        std::memcpy(batch_.get() + used, slot.data, slot.length);
+        used += slot.length;
+        slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_release);
+        ++records;
+    }
+    if (used > 0) {
+        writeAll(batch_.get(), used);
+    }
+    if (records > 0) {
+        written_.inc(records);
+    }
+    return records;
+}
+
+void AsyncLogSink::writeAll(const char* data, size_t length) {
+    while (length > 0) {
+        const auto n = ::write(options_.fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nowhere left to report it; losing log output must not take the service down.
+            return;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+class Counter;
+
+// Output backend for trantor's logger. Formatted records are copied into a
+// fixed-size ring of slots and written out in batches by one writer thread,
+// so a request thread never takes a lock or waits on stdout. Producers claim
+// slots with a CAS on the ring's tail; when the ring is full the record is
+// dropped and counted rather than stalling the caller.
+class AsyncLogSink {
+public:
+    struct Options {
+        // Rounded up to a power of two.
+        size_t capacity{16384};
+        int fd{STDOUT_FILENO};
+        // Longest the writer sleeps while the ring is empty.
+        std::chrono::milliseconds flushInterval{20};
+    };
+
+    explicit AsyncLogSink(Options options);
+    ~AsyncLogSink();
+
+    AsyncLogSink(const AsyncLogSink&) = delete;
+    AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+    // Routes trantor::Logger (and so Drogon's LOG_* macros) through this sink
+    // until it is destroyed, when plain stdout output is restored.
+    void install();
+
+    // Never blocks. Records longer than a slot are cut short.
+    void append(const char* data, size_t length);
+
+    // Waits, bounded, until everything appended so far has been written.
+    // trantor calls this after error and fatal records.
+    void flush();
+
+    // Drains the ring, then joins the writer. Later appends go straight to fd.
+    void stop();
+
+    // Records published but not yet handed to the writer.
+    size_t depth() const;
+
+private:
+    static constexpr size_t kRecordBytes = 500;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{0};
+        uint32_t length{0};
+        char data[kRecordBytes];
+    };
+
+    Options options_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::atomic<uint64_t> head_{0};
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> stopped_{false};
+    Counter& written_;
+    Counter& dropped_;
+    Counter& truncated_;
+    std::unique_ptr<char[]> batch_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable drained_;
+    bool flushRequested_{false};
+    bool installed_{false};
+    std::thread writer_;
+
+    void run();
+    size_t drain();
+    void writeAll(const char* data, size_t length);
+};
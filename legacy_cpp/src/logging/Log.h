@@ -0,0 +1,51 @@
+#pragma once
+#include <trantor/utils/Logger.h>
+#include <atomic>
+#include <cstdint>
+
+// Lowest trantor level compiled into the binary. Statements below it are
+// dead code, arguments included, so release builds (NDEBUG) pay nothing for
+// TRACE and DEBUG lines on hot paths. Override with -DURL_SHORTENER_LOG_FLOOR=n.
+#ifndef URL_SHORTENER_LOG_FLOOR
+#ifdef NDEBUG
+#define URL_SHORTENER_LOG_FLOOR 2  // kInfo
+#else
+#define URL_SHORTENER_LOG_FLOOR 0  // kTrace
+#endif
+#endif
+
+namespace logging {
+// Sampled statements emit one in every N occurrences, counted per call site
+// and per thread. 1 logs everything.
+inline std::atomic<uint32_t>& sampleEvery() {
+    static std::atomic<uint32_t> every{1};
+    return every;
+}
+
+inline void setSampleEvery(uint32_t every) {
+    sampleEvery().store(every == 0 ? 1 : every, std::memory_order_relaxed);
+}
+
+inline bool sampleHit(uint32_t& counter) {
+    const auto every = sampleEvery().load(std::memory_order_relaxed);
+    return every <= 1 || counter++ % every == 0;
+}
+}  // namespace logging
+
+#define APP_LOG_ENABLED(level) \
+    (trantor::Logger::level >= URL_SHORTENER_LOG_FLOOR && trantor::Logger::logLevel() <= trantor::Logger::level)
+
+#define APP_LOG(level)               \
+    if (!APP_LOG_ENABLED(level)) {   \
+    } else                           \
+        trantor::Logger(__FILE__, __LINE__, trantor::Logger::level).stream()
+
+#define APP_LOG_TRACE APP_LOG(kTrace)
+#define APP_LOG_DEBUG APP_LOG(kDebug)
+
+// For per-request events: level check first, then the sampling counter.
+#define APP_LOG_SAMPLED(level)                                                                     \
+    if (!(APP_LOG_ENABLED(level) &&                                                                \
+          ::logging::sampleHit([]() -> uint32_t& { thread_local uint32_t n = 0; return n; }()))) { \
+    } else                                                                                         \
+        trantor::Logger(__FILE__, __LINE__, trantor::Logger::level).stream()
@@ -1,23 +1,43 @@
 #include "UrlShortenerService.h"
+#include "cache/CacheWarmer.h"
+#include "cache/CodeExistenceFilter.h"
+#include "cache/LocalUrlCache.h"
+#include "cache/PopularLinks.h"
+#include "cache/RedisPool.h"
+#include "cache/SnapshotReloader.h"
+#include "cache/UrlSnapshot.h"
 #include "controllers/AuthController.h"
+#include "controllers/HealthController.h"
+#include "logging/AsyncLogSink.h"
+#include "logging/Log.h"
+#include "metrics/HttpMetrics.h"
+#include "metrics/Metrics.h"
 #include "services/AuthService.h"
+#include "services/ChangeFeed.h"
+#include "services/ClickAnalytics.h"
 #include "services/DataStore.h"
+#include "services/HealthMonitor.h"
+#include "services/InsertBatcher.h"
+#include "services/KdfWorkerPool.h"
+#include "services/RateLimiter.h"
+#include "services/ShortCodeAllocator.h"
 #include "security/JwtService.h"
 #include <drogon/drogon.h>
-#include <drogon/nosql/RedisClient.h>
 #include <json/json.h>
 
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <iostream>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <string_view>
 #include <netdb.h>
 #include <unistd.h>
 #include <cstring>
 #include <thread>
-#include <iostream>
 // DNS resolution helper: tries to resolve hostname up to maxAttempts, logs each attempt, returns resolved IP string or empty string on failure
 std::string resolveHostnameWithRetry(const std::string& hostname, int maxAttempts = 20, int delayMs = 500) {
     char ipstr[INET6_ADDRSTRLEN] = {0};
@@ -38,17 +58,17 @@ std::string resolveHostnameWithRetry(const std::string& hostname, int maxAttempt
             }
             if (addr) {
                 inet_ntop(res->ai_family, addr, ipstr, sizeof(ipstr));
-                std::cout << "[DNS] Resolved '" << hostname << "' to IP: " << ipstr << " (attempt " << attempt << ")" << std::endl;
+                LOG_INFO << "Resolved '" << hostname << "' to " << ipstr << " (attempt " << attempt << ")";
                 freeaddrinfo(res);
                 return std::string(ipstr);
             }
             freeaddrinfo(res);
         } else {
-            std::cout << "[DNS] Attempt " << attempt << ": Failed to resolve '" << hostname << "' (" << gai_strerror(err) << ")" << std::endl;
+            LOG_WARN << "Attempt " << attempt << ": failed to resolve '" << hostname << "' (" << gai_strerror(err) << ")";
         }
         std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
     }
-    std::cerr << "[DNS] ERROR: Could not resolve '" << hostname << "' after " << maxAttempts << " attempts." << std::endl;
+    LOG_ERROR << "Could not resolve '" << hostname << "' after " << maxAttempts << " attempts";
     return std::string();
 }
 
@@ -60,8 +80,38 @@ struct AppSettings {
     std::string baseUrl;
     std::string dbUrl;
     size_t dbPoolSize{4};
+    DataStore::ReplicaOptions dbReplicas;
+    InsertBatcher::Options insertBatch;
+    ShortCodeAllocator::Options codeAllocator;
     std::string jwtSecret;
     std::chrono::seconds jwtTtl{std::chrono::seconds{3600}};
+    bool localCacheEnabled{true};
+    LocalUrlCache::Options localCache;
+    bool negativeCacheEnabled{true};
+    LocalUrlCache::Options negativeCache{8 * 1024 * 1024, 16, std::chrono::seconds{30}};
+    bool codeFilterEnabled{true};
+    CodeExistenceFilter::Options codeFilter;
+    bool snapshotEnabled{false};
+    SnapshotReloader::Options snapshot{"data/url_mapping.snap"};
+    bool changeFeedEnabled{true};
+    ChangeFeed::Options changeFeed;
+    bool warmUpEnabled{true};
+    CacheWarmer::Options warmUp;
+    PopularLinks::Options popularLinks;
+    bool clickAnalyticsEnabled{true};
+    ClickAnalytics::Options clickAnalytics;
+    KdfWorkerPool::Options kdfPool;
+    RedisPool::Options redisPool;
+    HealthMonitor::Options health;
+    bool rateLimitEnabled{false};
+    // Proxies in front of the service that append to X-Forwarded-For; 0
+    // ignores the header and limits by peer address.
+    size_t trustedProxyHops{0};
+    RateLimiter::Options rateLimit;
+    trantor::Logger::LogLevel logLevel{trantor::Logger::kInfo};
+    uint32_t logSampleEvery{100};
+    bool asyncLog{true};
+    AsyncLogSink::Options logSink;
 };
 
 std::optional<std::string> readString(const Json::Value& node, const char* field) {
@@ -74,6 +124,55 @@ std::optional<std::string> readString(const Json::Value& node, const char* field
     return std::nullopt;
 }
 
+// Accepts either a JSON number or a numeric string, like database.pool_size.
+std::optional<uint64_t> readUInt(const Json::Value& node, const char* field, const char* path) {
+    if (!node.isMember(field)) {
+        return std::nullopt;
+    }
+    const auto& value = node[field];
+    if (value.isUInt64()) {
+        return value.asUInt64();
+    }
+    if (value.isString()) {
+        try {
+            return std::stoull(value.asString());
+        } catch (...) {
+        }
+    }
+    throw std::runtime_error(std::string(path) + " must be numeric");
+}
+
+std::optional<double> readDouble(const Json::Value& node, const char* field, const char* path) {
+    if (!node.isMember(field)) {
+        return std::nullopt;
+    }
+    if (!node[field].isNumeric()) {
+        throw std::runtime_error(std::string(path) + " must be numeric");
+    }
+    return node[field].asDouble();
+}
+
+trantor::Logger::LogLevel parseLogLevel(const std::string& name) {
+    static const std::pair<const char*, trantor::Logger::LogLevel> kLevels[] = {
+        {"TRACE", trantor::Logger::kTrace}, {"DEBUG", trantor::Logger::kDebug},
+        {"INFO", trantor::Logger::kInfo},   {"WARN", trantor::Logger::kWarn},
+        {"ERROR", trantor::Logger::kError}, {"FATAL", trantor::Logger::kFatal},
+    };
+    for (const auto& [label, level] : kLevels) {
+        if (name == label) {
+            return level;
+        }
+    }
+    throw std::runtime_error("log.level must be one of TRACE, DEBUG, INFO, WARN, ERROR, FATAL");
+}
+
+std::optional<bool> readBool(const Json::Value& node, const char* field) {
+    if (node.isMember(field) && node[field].isBool()) {
+        return node[field].asBool();
+    }
+    return std::nullopt;
+}
+
 AppSettings loadSettings(const Json::Value& config) {
     AppSettings settings;
 
@@ -108,6 +207,42 @@ AppSettings loadSettings(const Json::Value& config) {
         } else if (db.isMember("pool_size") && db["pool_size"].isUInt()) {
             settings.dbPoolSize = db["pool_size"].asUInt();
         }
+        if (db.isMember("insert_batch") && db["insert_batch"].isObject()) {
+            const auto& batch = db["insert_batch"];
+            if (auto maxRows = readUInt(batch, "max_rows", "database.insert_batch.max_rows")) {
+                settings.insertBatch.maxBatchSize = *maxRows;
+            }
+            if (auto delay = readUInt(batch, "max_delay_us", "database.insert_batch.max_delay_us")) {
+                settings.insertBatch.maxDelay = std::chrono::microseconds{*delay};
+            }
+        }
+        if (db.isMember("replicas") && db["replicas"].isObject()) {
+            const auto& replicas = db["replicas"];
+            if (replicas.isMember("urls")) {
+                if (!replicas["urls"].isArray()) {
+                    throw std::runtime_error("database.replicas.urls must be an array of strings");
+                }
+                for (const auto& url : replicas["urls"]) {
+                    if (!url.isString() || url.asString().empty()) {
+                        throw std::runtime_error("database.replicas.urls must be an array of strings");
+                    }
+                    settings.dbReplicas.uris.push_back(url.asString());
+                }
+            }
+            if (auto poolSize = readUInt(replicas, "pool_size", "database.replicas.pool_size")) {
+                settings.dbReplicas.poolSize = *poolSize;
+            }
+            if (auto window = readUInt(replicas, "read_your_writes_ms", "database.replicas.read_your_writes_ms")) {
+                settings.dbReplicas.readYourWritesWindow = std::chrono::milliseconds{*window};
+            }
+            if (auto maxLag = readUInt(replicas, "max_lag_ms", "database.replicas.max_lag_ms")) {
+                settings.dbReplicas.maxLag = std::chrono::milliseconds{*maxLag};
+            }
+            if (auto silence = readUInt(replicas, "max_receiver_silence_ms",
+                                        "database.replicas.max_receiver_silence_ms")) {
+                settings.dbReplicas.maxReceiverSilence = std::chrono::milliseconds{*silence};
+            }
+        }
     }
 
     if (config.isMember("security") && config["security"].isObject()) {
@@ -126,6 +261,231 @@ AppSettings loadSettings(const Json::Value& config) {
         }
     }
 
+    if (config.isMember("redis") && config["redis"].isObject()) {
+        const auto& redis = config["redis"];
+        if (auto poolSize = readUInt(redis, "pool_size", "redis.pool_size")) {
+            settings.redisPool.connections = *poolSize;
+        }
+        if (auto backoff = readUInt(redis, "min_backoff_ms", "redis.min_backoff_ms")) {
+            settings.redisPool.minBackoff = std::chrono::milliseconds{*backoff};
+        }
+        if (auto backoff = readUInt(redis, "max_backoff_ms", "redis.max_backoff_ms")) {
+            settings.redisPool.maxBackoff = std::chrono::milliseconds{*backoff};
+        }
+        if (auto timeout = readUInt(redis, "timeout_ms", "redis.timeout_ms")) {
+            settings.redisPool.commandTimeout = std::chrono::milliseconds{*timeout};
+        }
+        if (auto threshold = readUInt(redis, "breaker_failure_threshold", "redis.breaker_failure_threshold")) {
+            settings.redisPool.breaker.failureThreshold = static_cast<uint32_t>(*threshold);
+        }
+        if (auto openMs = readUInt(redis, "breaker_open_ms", "redis.breaker_open_ms")) {
+            settings.redisPool.breaker.openDuration = std::chrono::milliseconds{*openMs};
+        }
+    }
+
+    if (config.isMember("health") && config["health"].isObject()) {
+        const auto& health = config["health"];
+        if (auto interval = readUInt(health, "interval_ms", "health.interval_ms")) {
+            settings.health.interval = std::chrono::milliseconds{*interval};
+        }
+        if (auto timeout = readUInt(health, "timeout_ms", "health.timeout_ms")) {
+            settings.health.timeout = std::chrono::milliseconds{*timeout};
+        }
+    }
+
+    if (config.isMember("log") && config["log"].isObject()) {
+        const auto& log = config["log"];
+        if (auto level = readString(log, "level")) {
+            settings.logLevel = parseLogLevel(*level);
+        }
+        if (auto every = readUInt(log, "sample_every", "log.sample_every")) {
+            settings.logSampleEvery = static_cast<uint32_t>(std::max<uint64_t>(*every, 1));
+        }
+        if (auto async = readBool(log, "async")) {
+            settings.asyncLog = *async;
+        }
+        if (auto capacity = readUInt(log, "queue_records", "log.queue_records")) {
+            settings.logSink.capacity = static_cast<size_t>(*capacity);
+        }
+    }
+
+    if (config.isMember("rate_limit") && config["rate_limit"].isObject()) {
+        const auto& rateLimit = config["rate_limit"];
+        settings.rateLimitEnabled = readBool(rateLimit, "enabled").value_or(true);
+        if (rateLimit.isMember("trust_forwarded_for")) {
+            throw std::runtime_error("rate_limit.trust_forwarded_for was replaced by rate_limit.trusted_proxy_hops");
+        }
+        if (auto hops = readUInt(rateLimit, "trusted_proxy_hops", "rate_limit.trusted_proxy_hops")) {
+            settings.trustedProxyHops = static_cast<size_t>(*hops);
+        }
+        if (rateLimit.isMember("rules") && rateLimit["rules"].isObject()) {
+            const auto& rules = rateLimit["rules"];
+            for (size_t i = 0; i < RateLimiter::kRuleCount; ++i) {
+                const auto* name = RateLimiter::ruleName(static_cast<RateLimiter::Rule>(i));
+                if (!rules.isMember(name) || !rules[name].isObject()) {
+                    continue;
+                }
+                const auto& rule = rules[name];
+                const auto path = std::string("rate_limit.rules.") + name;
+                auto& limit = settings.rateLimit.limits[i];
+                if (auto rate = readDouble(rule, "rate", (path + ".rate").c_str())) {
+                    limit.ratePerSecond = *rate;
+                }
+                if (auto burst = readDouble(rule, "burst", (path + ".burst").c_str())) {
+                    limit.burst = *burst;
+                }
+                if (auto distributed = readBool(rule, "distributed")) {
+                    limit.distributed = *distributed;
+                }
+            }
+        }
+    }
+
+    if (config.isMember("short_code") && config["short_code"].isObject()) {
+        const auto& shortCode = config["short_code"];
+        if (auto blockSize = readUInt(shortCode, "block_size", "short_code.block_size")) {
+            settings.codeAllocator.blockSize = std::max<uint64_t>(*blockSize, 1);
+        }
+        if (auto key = readUInt(shortCode, "scramble_key", "short_code.scramble_key")) {
+            settings.codeAllocator.scrambleKey = *key;
+        }
+    }
+
+    if (config.isMember("auth") && config["auth"].isObject()) {
+        const auto& auth = config["auth"];
+        if (auto threads = readUInt(auth, "kdf_threads", "auth.kdf_threads")) {
+            settings.kdfPool.threads = *threads;
+        }
+        if (auto queueLimit = readUInt(auth, "kdf_queue_limit", "auth.kdf_queue_limit")) {
+            settings.kdfPool.queueLimit = *queueLimit;
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("local") && config["cache"]["local"].isObject()) {
+        const auto& local = config["cache"]["local"];
+        if (auto enabled = readBool(local, "enabled")) {
+            settings.localCacheEnabled = *enabled;
+        }
+        if (auto maxBytes = readUInt(local, "max_bytes", "cache.local.max_bytes")) {
+            settings.localCache.maxBytes = *maxBytes;
+        }
+        if (auto shards = readUInt(local, "shards", "cache.local.shards")) {
+            settings.localCache.shards = *shards;
+        }
+        if (auto ttl = readUInt(local, "ttl_seconds", "cache.local.ttl_seconds")) {
+            settings.localCache.defaultTtl = std::chrono::seconds{*ttl};
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("negative") && config["cache"]["negative"].isObject()) {
+        const auto& negative = config["cache"]["negative"];
+        if (auto enabled = readBool(negative, "enabled")) {
+            settings.negativeCacheEnabled = *enabled;
+        }
+        if (auto maxBytes = readUInt(negative, "max_bytes", "cache.negative.max_bytes")) {
+            settings.negativeCache.maxBytes = *maxBytes;
+        }
+        if (auto ttl = readUInt(negative, "ttl_seconds", "cache.negative.ttl_seconds")) {
+            settings.negativeCache.defaultTtl = std::chrono::seconds{*ttl};
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("bloom") && config["cache"]["bloom"].isObject()) {
+        const auto& bloom = config["cache"]["bloom"];
+        if (auto enabled = readBool(bloom, "enabled")) {
+            settings.codeFilterEnabled = *enabled;
+        }
+        if (bloom.isMember("false_positive_rate")) {
+            if (!bloom["false_positive_rate"].isDouble()) {
+                throw std::runtime_error("cache.bloom.false_positive_rate must be numeric");
+            }
+            settings.codeFilter.falsePositiveRate = bloom["false_positive_rate"].asDouble();
+        }
+        if (auto capacity = readUInt(bloom, "min_capacity", "cache.bloom.min_capacity")) {
+            settings.codeFilter.minCapacity = *capacity;
+        }
+        if (auto interval = readUInt(bloom, "rebuild_interval_seconds", "cache.bloom.rebuild_interval_seconds")) {
+            settings.codeFilter.rebuildInterval = std::chrono::seconds{std::max<uint64_t>(*interval, 1)};
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("snapshot") && config["cache"]["snapshot"].isObject()) {
+        const auto& snapshot = config["cache"]["snapshot"];
+        if (auto enabled = readBool(snapshot, "enabled")) {
+            settings.snapshotEnabled = *enabled;
+        }
+        if (auto path = readString(snapshot, "path")) {
+            settings.snapshot.path = *path;
+        }
+        if (auto interval = readUInt(snapshot, "reload_interval_seconds", "cache.snapshot.reload_interval_seconds")) {
+            settings.snapshot.interval = std::chrono::seconds{std::max<uint64_t>(*interval, 1)};
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("change_feed") && config["cache"]["change_feed"].isObject()) {
+        const auto& changeFeed = config["cache"]["change_feed"];
+        if (auto enabled = readBool(changeFeed, "enabled")) {
+            settings.changeFeedEnabled = *enabled;
+        }
+        if (auto channel = readString(changeFeed, "channel")) {
+            settings.changeFeed.channel = *channel;
+        }
+    }
+
+    if (config.isMember("cache") && config["cache"].isObject() &&
+        config["cache"].isMember("warmup") && config["cache"]["warmup"].isObject()) {
+        const auto& warmUp = config["cache"]["warmup"];
+        if (auto enabled = readBool(warmUp, "enabled")) {
+            settings.warmUpEnabled = *enabled;
+        }
+        if (auto recent = readUInt(warmUp, "recent_links", "cache.warmup.recent_links")) {
+            settings.warmUp.recentLinks = *recent;
+        }
+        if (auto popular = readUInt(warmUp, "popular_links", "cache.warmup.popular_links")) {
+            settings.warmUp.popularLinks = *popular;
+        }
+        if (auto batch = readUInt(warmUp, "batch_size", "cache.warmup.batch_size")) {
+            settings.warmUp.batchSize = *batch;
+        }
+        if (auto seconds = readUInt(warmUp, "max_seconds", "cache.warmup.max_seconds")) {
+            settings.warmUp.maxDuration = std::chrono::seconds{std::max<uint64_t>(*seconds, 1)};
+        }
+        if (auto maxBytes = readUInt(warmUp, "max_bytes", "cache.warmup.max_bytes")) {
+            settings.warmUp.maxBytes = *maxBytes;
+        }
+        if (auto sampleEvery = readUInt(warmUp, "popularity_sample_every", "cache.warmup.popularity_sample_every")) {
+            settings.popularLinks.sampleEvery = static_cast<uint32_t>(std::clamp<uint64_t>(*sampleEvery, 1, 1000000));
+        }
+        if (auto tracked = readUInt(warmUp, "popularity_max_tracked", "cache.warmup.popularity_max_tracked")) {
+            settings.popularLinks.maxTracked = *tracked;
+        }
+        if (auto halfLife = readUInt(warmUp, "popularity_half_life_seconds",
+                                     "cache.warmup.popularity_half_life_seconds")) {
+            settings.popularLinks.halfLife = std::chrono::seconds{*halfLife};
+        }
+    }
+
+    if (config.isMember("analytics") && config["analytics"].isObject()) {
+        const auto& analytics = config["analytics"];
+        if (auto enabled = readBool(analytics, "enabled")) {
+            settings.clickAnalyticsEnabled = *enabled;
+        }
+        if (auto interval = readUInt(analytics, "flush_interval_ms", "analytics.flush_interval_ms")) {
+            settings.clickAnalytics.flushInterval = std::chrono::milliseconds{std::max<uint64_t>(*interval, 100)};
+        }
+        if (auto slots = readUInt(analytics, "table_slots", "analytics.table_slots")) {
+            settings.clickAnalytics.tableSlots = *slots;
+        }
+        if (auto rows = readUInt(analytics, "max_batch_rows", "analytics.max_batch_rows")) {
+            settings.clickAnalytics.maxBatchRows = *rows;
+        }
+    }
+
     if (settings.baseUrl.empty()) {
         if (const char* envBase = std::getenv("BASE_URL")) {
             settings.baseUrl = envBase;
@@ -138,6 +498,20 @@ AppSettings loadSettings(const Json::Value& config) {
         }
     }
 
+    // Comma-separated; replaces the configured list.
+    if (const char* envReplicas = std::getenv("DATABASE_REPLICA_URLS")) {
+        settings.dbReplicas.uris.clear();
+        std::string_view rest(envReplicas);
+        while (!rest.empty()) {
+            const auto comma = rest.find(',');
+            const auto url = rest.substr(0, comma);
+            if (!url.empty()) {
+                settings.dbReplicas.uris.emplace_back(url);
+            }
+            rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+        }
+    }
+
     if (settings.jwtSecret.empty()) {
         if (const char* envSecret = std::getenv("JWT_SECRET")) {
             settings.jwtSecret = envSecret;
@@ -156,27 +530,227 @@ AppSettings loadSettings(const Json::Value& config) {
         throw std::runtime_error("DATABASE_URL or database.url config must be set");
     }
 
-    if (settings.jwtSecret.empty()) {
-        throw std::runtime_error("JWT_SECRET or security.jwt_secret config must be set");
-    }
-
     if (settings.dbPoolSize == 0) {
         settings.dbPoolSize = 4;
     }
 
     return settings;
 }
+
+// Each trusted proxy appends the address it received the request from, so
+// the entry trustedProxyHops from the right is the last one a proxy we run
+// wrote. Everything left of it came from the client and can be anything.
+std::string clientAddress(const HttpRequestPtr& req, size_t trustedProxyHops) {
+    if (trustedProxyHops == 0) {
+        return req->peerAddr().toIp();
+    }
+    const auto& forwarded = req->getHeader("x-forwarded-for");
+    size_t end = forwarded.size();
+    for (size_t hop = 1; hop <= trustedProxyHops; ++hop) {
+        const auto comma = end == 0 ? std::string::npos : forwarded.rfind(',', end - 1);
+        const size_t start = comma == std::string::npos ? 0 : comma + 1;
+        if (hop == trustedProxyHops) {
+            auto entry = forwarded.substr(start, end - start);
+            entry.erase(0, entry.find_first_not_of(' '));
+            entry.erase(entry.find_last_not_of(' ') + 1);
+            if (!entry.empty()) {
+                return entry;
+            }
+            break;
+        }
+        if (comma == std::string::npos) {
+            // Fewer entries than proxies: the request skipped one of them.
+            break;
+        }
+        end = comma;
+    }
+    return req->peerAddr().toIp();
+}
+
+// Authenticated callers are limited per user, whichever token or API key they
+// present; everyone else per client address.
+std::string callerKey(const HttpRequestPtr& req, const AuthService& authService, size_t trustedProxyHops) {
+    if (auto user = authService.authenticate(req)) {
+        return "user:" + std::to_string(user->id);
+    }
+    return "ip:" + clientAddress(req, trustedProxyHops);
+}
+
+using ResponseCallback = function<void(const HttpResponsePtr&)>;
+
+// Runs handler when the caller is within the rule's limit, otherwise runs
+// onLimited (if any) and answers 429 with Retry-After.
+void withRateLimit(const std::shared_ptr<RateLimiter>& limiter,
+                   RateLimiter::Rule rule,
+                   const std::function<std::string()>& key,
+                   ResponseCallback&& callback,
+                   std::function<void(ResponseCallback&&)>&& handler,
+                   std::function<void()>&& onLimited = {}) {
+    if (!limiter || !limiter->enabled(rule)) {
+        handler(std::move(callback));
+        return;
+    }
+    limiter->check(rule, key(),
+        [callback = std::move(callback), handler = std::move(handler), onLimited = std::move(onLimited)](
+            RateLimiter::Decision decision) mutable {
+            if (decision.allowed) {
+                handler(std::move(callback));
+                return;
+            }
+            if (onLimited) {
+                onLimited();
+            }
+            Json::Value body;
+            body["error"] = "rate limit exceeded";
+            auto resp = HttpResponse::newHttpJsonResponse(body);
+            resp->setStatusCode(k429TooManyRequests);
+            resp->addHeader("Retry-After", std::to_string(decision.retryAfter.count()));
+            callback(resp);
+        });
 }
 
-int main() {
+void registerCacheMetrics(const UrlShortenerService::Caches& caches) {
+    auto& registry = MetricsRegistry::instance();
+    std::vector<std::pair<std::string, std::shared_ptr<LocalUrlCache>>> localCaches;
+    if (caches.local) {
+        localCaches.emplace_back("positive", caches.local);
+    }
+    if (caches.negative) {
+        localCaches.emplace_back("negative", caches.negative);
+    }
+    if (!localCaches.empty()) {
+        // One collector for both caches keeps each metric family contiguous.
+        registry.addCollector([localCaches](PrometheusWriter& out) {
+            std::vector<LocalUrlCache::Stats> stats;
+            for (const auto& entry : localCaches) {
+                stats.push_back(entry.second->stats());
+            }
+            auto emit = [&](const char* name, const char* help, const char* type, auto field) {
+                out.family(name, help, type);
+                for (size_t i = 0; i < stats.size(); ++i) {
+                    out.sample(name, {{"cache", localCaches[i].first}}, static_cast<double>(field(stats[i])));
+                }
+            };
+            emit("urlshortener_local_cache_hits_total", "In-process cache hits", "counter",
+                 [](const LocalUrlCache::Stats& st) { return st.hits; });
+            emit("urlshortener_local_cache_misses_total", "In-process cache misses", "counter",
+                 [](const LocalUrlCache::Stats& st) { return st.misses; });
+            emit("urlshortener_local_cache_evictions_total", "In-process cache CLOCK evictions", "counter",
+                 [](const LocalUrlCache::Stats& st) { return st.evictions; });
+            emit("urlshortener_local_cache_entries", "In-process cache entries", "gauge",
+                 [](const LocalUrlCache::Stats& st) { return st.entries; });
+            emit("urlshortener_local_cache_bytes", "In-process cache accounted bytes", "gauge",
+                 [](const LocalUrlCache::Stats& st) { return st.bytes; });
+        });
+    }
+
+    if (auto filter = caches.codeFilter) {
+        registry.addCollector([filter](PrometheusWriter& out) {
+            const auto stats = filter->stats();
+            out.family("urlshortener_code_filter_ready", "1 once the code Bloom filter has been built", "gauge");
+            out.sample("urlshortener_code_filter_ready", {}, stats.ready ? 1.0 : 0.0);
+            out.family("urlshortener_code_filter_keys", "Codes added to the active Bloom filter", "gauge");
+            out.sample("urlshortener_code_filter_keys", {}, static_cast<double>(stats.keys));
+            out.family("urlshortener_code_filter_bytes", "Bloom filter bit array size", "gauge");
+            out.sample("urlshortener_code_filter_bytes", {}, static_cast<double>(stats.memoryBytes));
+            out.family("urlshortener_code_filter_estimated_fpr", "Bloom filter false-positive rate estimated from fill", "gauge");
+            out.sample("urlshortener_code_filter_estimated_fpr", {}, stats.estimatedFalsePositiveRate);
+            out.family("urlshortener_code_filter_checks_total", "Bloom filter lookups by answer", "counter");
+            out.sample("urlshortener_code_filter_checks_total", {{"answer", "maybe"}}, static_cast<double>(stats.positives));
+            out.sample("urlshortener_code_filter_checks_total", {{"answer", "absent"}}, static_cast<double>(stats.negatives));
+            out.family("urlshortener_code_filter_false_positives_total", "Filter said maybe but the DB had no such code", "counter");
+            out.sample("urlshortener_code_filter_false_positives_total", {}, static_cast<double>(stats.falsePositives));
+            out.family("urlshortener_code_filter_rebuilds_total", "Bloom filter rebuilds by outcome", "counter");
+            out.sample("urlshortener_code_filter_rebuilds_total", {{"result", "ok"}}, static_cast<double>(stats.rebuilds));
+            out.sample("urlshortener_code_filter_rebuilds_total", {{"result", "error"}}, static_cast<double>(stats.rebuildFailures));
+            out.family("urlshortener_code_filter_rebuild_seconds", "Duration of the last Bloom filter rebuild", "gauge");
+            out.sample("urlshortener_code_filter_rebuild_seconds", {}, static_cast<double>(stats.lastRebuildDuration.count()) / 1000.0);
+        });
+    }
+}
+}
+
+// Pages through url_mapping in code order and writes a snapshot the servers
+// pick up on their next reload check.
+int buildSnapshot(const AppSettings& settings, const std::string& path) {
+    constexpr size_t kPageRows = 10000;
+    try {
+        DataStore store(settings.dbUrl, 1);
+        UrlSnapshotWriter writer(path);
+        std::string after;
+        uint64_t skipped = 0;
+        uint64_t scanned = 0;
+        uint64_t pages = 0;
+        for (;;) {
+            auto rows = store.listMappingsAfter(after, kPageRows);
+            for (const auto& row : rows) {
+                if (!writer.add(row.code, row.url, row.expiresAt)) {
+                    ++skipped;
+                }
+            }
+            scanned += rows.size();
+            if (rows.size() < kPageRows) {
+                break;
+            }
+            after = rows.back().code;
+            if (++pages % 100 == 0) {
+                LOG_INFO << "Snapshot: " << scanned << " links read";
+            }
+        }
+        const auto written = writer.commit();
+        LOG_INFO << "Wrote URL snapshot " << path << " with " << written << " links"
+                 << (skipped ? " (" + std::to_string(skipped) + " codes too long to index)" : std::string());
+        return 0;
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Snapshot build failed: " << e.what();
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::optional<std::string> buildSnapshotPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if (arg == "--build-snapshot") {
+            // Optional path; defaults to cache.snapshot.path.
+            buildSnapshotPath = (i + 1 < argc && argv[i + 1][0] != '-') ? std::string(argv[++i]) : std::string();
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--build-snapshot [path]]" << std::endl;
+            return 2;
+        }
+    }
+
     auto& app = drogon::app();
     app.loadConfigFile("config.json");
 
     auto settings = loadSettings(app.getCustomConfig());
 
-    auto dataStore = make_shared<DataStore>(settings.dbUrl, settings.dbPoolSize);
+    std::unique_ptr<AsyncLogSink> logSink;
+    if (settings.asyncLog) {
+        logSink = make_unique<AsyncLogSink>(settings.logSink);
+        logSink->install();
+    }
+    app.setLogLevel(settings.logLevel);
+    // Only handlers that take a RequestStreamPtr (bulk shorten) see the body
+    // unbuffered; everything else stays under client_max_body_size.
+    app.enableRequestStream();
+    logging::setSampleEvery(settings.logSampleEvery);
+
+    if (buildSnapshotPath) {
+        return buildSnapshot(settings, buildSnapshotPath->empty() ? settings.snapshot.path : *buildSnapshotPath);
+    }
+    if (settings.jwtSecret.empty()) {
+        throw std::runtime_error("JWT_SECRET or security.jwt_secret config must be set");
+    }
+
+    auto dataStore = make_shared<DataStore>(settings.dbUrl, settings.dbPoolSize, settings.dbReplicas);
+    if (dataStore->replicaCount() > 0) {
+        LOG_INFO << "Reads balanced over " << dataStore->replicaCount()
+                 << " Postgres replica(s) once health probes admit them";
+    }
     auto jwtService = make_shared<JwtService>(settings.jwtSecret, settings.jwtTtl);
-    auto authService = make_shared<AuthService>(dataStore, jwtService);
+    auto kdfPool = make_shared<KdfWorkerPool>(settings.kdfPool);
+    auto authService = make_shared<AuthService>(dataStore, jwtService, kdfPool);
     auto authController = make_shared<AuthController>(authService);
 
 
@@ -214,23 +788,108 @@ int main() {
         redisPassword = "UrlShortRedis2025";
     }
 
-    std::cout << "[DEBUG] Redis config: host=" << redisHost << ", port=" << redisPort << ", password=" << redisPassword << std::endl;
-
     // --- DNS resolution diagnostic ---
     std::string resolvedIp = resolveHostnameWithRetry(redisHost, 20, 500);
     if (resolvedIp.empty()) {
-        std::cerr << "[FATAL] Could not resolve Redis host '" << redisHost << "'. Exiting." << std::endl;
+        LOG_ERROR << "Could not resolve Redis host '" << redisHost << "'. Exiting.";
         return 1;
     }
-    std::cout << "[INFO] Redis hostname '" << redisHost << "' resolved to IP: " << resolvedIp << std::endl;
+    LOG_INFO << "Redis " << redisHost << ":" << redisPort << " resolved to " << resolvedIp;
     // --- End DNS resolution diagnostic ---
 
     // Use resolved IP for Redis connection to avoid IPv6/IPv4 ambiguity
-    std::cout << "[DEBUG] Using resolved IP: " << resolvedIp << " for Redis connection (Force IPv4)" << std::endl;
     trantor::InetAddress redisAddr(resolvedIp, redisPort, false);
-    auto redisClient = drogon::nosql::RedisClient::newRedisClient(redisAddr, 1, redisPassword);
+    auto redisPool = make_shared<RedisPool>(redisAddr, redisPassword, settings.redisPool);
+
+    auto healthMonitor = make_shared<HealthMonitor>(dataStore, redisPool, settings.health);
+    if (settings.warmUpEnabled) {
+        // Released by the cache warm-up below, however it ends.
+        healthMonitor->setWarmingUp(true);
+    }
+    healthMonitor->start();
+    auto healthController = make_shared<HealthController>(healthMonitor);
+
+    UrlShortenerService::Caches caches;
+    if (settings.localCacheEnabled && settings.localCache.maxBytes > 0) {
+        caches.local = make_shared<LocalUrlCache>(settings.localCache);
+    }
+    if (settings.negativeCacheEnabled && settings.negativeCache.maxBytes > 0) {
+        caches.negative = make_shared<LocalUrlCache>(settings.negativeCache);
+    }
+    if (settings.codeFilterEnabled) {
+        caches.codeFilter = make_shared<CodeExistenceFilter>(dataStore, settings.codeFilter);
+    }
+    std::shared_ptr<ChangeFeed> changeFeed;
+    if (settings.changeFeedEnabled) {
+        ChangeFeed::Handlers handlers;
+        handlers.onCodes = [filter = caches.codeFilter, negative = caches.negative](
+                               const std::vector<std::string>& codes) {
+            for (const auto& code : codes) {
+                if (filter) {
+                    filter->recordInsert(code);
+                }
+                if (negative) {
+                    negative->erase(code);
+                }
+            }
+        };
+        handlers.onResync = [filter = caches.codeFilter, negative = caches.negative] {
+            if (negative) {
+                negative->clear();
+            }
+            if (filter) {
+                filter->requestRebuild();
+            }
+        };
+        changeFeed = make_shared<ChangeFeed>(dataStore, settings.dbUrl, settings.changeFeed, std::move(handlers));
+        changeFeed->start();
+    }
+    // Listen first, so codes created while the filter is being built are not missed.
+    if (caches.codeFilter) {
+        caches.codeFilter->start();
+    }
+    if (settings.snapshotEnabled) {
+        caches.snapshot = make_shared<SnapshotReloader>(settings.snapshot);
+        caches.snapshot->start();
+    }
+
+    std::shared_ptr<CacheWarmer> cacheWarmer;
+    if (settings.warmUpEnabled) {
+        if (settings.warmUp.popularLinks > 0) {
+            caches.popular = make_shared<PopularLinks>(redisPool, settings.popularLinks);
+        }
+        cacheWarmer = make_shared<CacheWarmer>(dataStore, redisPool, caches.local, caches.popular, settings.warmUp);
+        cacheWarmer->start([healthMonitor] { healthMonitor->setWarmingUp(false); });
+    }
 
-    auto urlService = make_shared<UrlShortenerService>(dataStore, authService, settings.baseUrl, redisClient);
+    registerCacheMetrics(caches);
+
+    std::shared_ptr<RateLimiter> rateLimiter;
+    if (settings.rateLimitEnabled) {
+        rateLimiter = make_shared<RateLimiter>(settings.rateLimit, redisPool);
+    }
+    const size_t trustedProxyHops = settings.trustedProxyHops;
+
+    auto insertBatcher = make_shared<InsertBatcher>(dataStore, settings.insertBatch, changeFeed);
+    auto codeAllocator = make_shared<ShortCodeAllocator>(dataStore, settings.codeAllocator);
+    std::shared_ptr<ClickAnalytics> clickAnalytics;
+    if (settings.clickAnalyticsEnabled) {
+        clickAnalytics = make_shared<ClickAnalytics>(dataStore, settings.clickAnalytics);
+        clickAnalytics->start();
+    }
+    auto urlService = make_shared<UrlShortenerService>(dataStore, authService, settings.baseUrl, redisPool,
+                                                       insertBatcher, codeAllocator, caches, clickAnalytics);
+
+    const HandlerMetrics healthMetrics("health");
+    const HandlerMetrics readyMetrics("health_ready");
+    const HandlerMetrics liveMetrics("health_live");
+    const HandlerMetrics shortenMetrics("shorten");
+    const HandlerMetrics bulkShortenMetrics("shorten_bulk");
+    const HandlerMetrics listMetrics("list_urls");
+    const HandlerMetrics infoMetrics("info");
+    const HandlerMetrics resolveMetrics("resolve");
+    const HandlerMetrics registerMetrics("register");
+    const HandlerMetrics loginMetrics("login");
 
     app.registerHandler("/", [](const HttpRequestPtr&, function<void(const HttpResponsePtr&)>&& cb) {
         auto resp = HttpResponse::newFileResponse("public/index.html");
@@ -239,40 +898,95 @@ int main() {
         cb(resp);
     }, {Get});
 
+    // Scraped by k8s/monitoring/prometheus.yaml; rendering only sums per-thread slots
+    app.registerHandler("/actuator/prometheus",
+        [](const HttpRequestPtr&, function<void(const HttpResponsePtr&)>&& callback) {
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setStatusCode(k200OK);
+            resp->setContentTypeCode(CT_TEXT_PLAIN);
+            resp->setBody(MetricsRegistry::instance().renderPrometheus());
+            callback(resp);
+        }, {Get});
+
     app.registerHandler("/api/v1/health", 
-        [urlService](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
-            urlService->handleHealth(req, move(callback));
+        [healthController, healthMetrics](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            healthController->handleHealth(req, healthMetrics.wrap(move(callback)));
+        }, {Get});
+
+    app.registerHandler("/api/v1/health/ready",
+        [healthController, readyMetrics](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            healthController->handleReady(req, readyMetrics.wrap(move(callback)));
+        }, {Get});
+
+    app.registerHandler("/api/v1/health/live",
+        [healthController, liveMetrics](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            healthController->handleLive(req, liveMetrics.wrap(move(callback)));
         }, {Get});
 
     app.registerHandler("/api/v1/shorten",
-        [urlService](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
-            urlService->handleShorten(req, move(callback));
+        [urlService, authService, rateLimiter, trustedProxyHops, shortenMetrics](
+            const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            withRateLimit(rateLimiter, RateLimiter::Rule::Shorten,
+                [&] { return callerKey(req, *authService, trustedProxyHops); },
+                shortenMetrics.wrap(move(callback)),
+                [urlService, req](ResponseCallback&& cb) { urlService->handleShorten(req, move(cb)); });
+        }, {Post});
+
+    app.registerHandler("/api/v1/shorten/bulk",
+        [urlService, authService, rateLimiter, trustedProxyHops, bulkShortenMetrics](
+            const HttpRequestPtr& req, RequestStreamPtr&& stream, function<void(const HttpResponsePtr&)>&& callback) {
+            // One token per bulk request; rows inside it are bounded by the batcher window.
+            withRateLimit(rateLimiter, RateLimiter::Rule::Shorten,
+                [&] { return callerKey(req, *authService, trustedProxyHops); },
+                bulkShortenMetrics.wrap(move(callback)),
+                [urlService, req, stream](ResponseCallback&& cb) {
+                    urlService->handleShortenBulk(req, stream, move(cb));
+                },
+                [stream] { UrlShortenerService::discardBulkBody(stream); });
         }, {Post});
 
     app.registerHandler("/api/v1/urls",
-        [urlService](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
-            urlService->handleListUserUrls(req, move(callback));
+        [urlService, listMetrics](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            urlService->handleListUserUrls(req, listMetrics.wrap(move(callback)));
         }, {Get});
 
     app.registerHandler("/api/v1/info/{1}",
-        [urlService](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback, const string& code) {
-            urlService->handleInfo(req, move(callback), code);
+        [urlService, infoMetrics](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback, const string& code) {
+            urlService->handleInfo(req, infoMetrics.wrap(move(callback)), code);
         }, {Get});
 
     app.registerHandler("/{1}",
-        [urlService](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback, const string& code) {
-            urlService->handleResolve(req, move(callback), code);
+        [urlService, rateLimiter, trustedProxyHops, resolveMetrics](
+            const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback, const string& code) {
+            withRateLimit(rateLimiter, RateLimiter::Rule::Resolve,
+                [&] { return "ip:" + clientAddress(req, trustedProxyHops); },
+                resolveMetrics.wrap(move(callback)),
+                [urlService, req, code](ResponseCallback&& cb) { urlService->handleResolve(req, move(cb), code); });
         }, {Get});
 
     app.registerHandler("/api/v1/register",
-        [authController](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
-            authController->handleRegister(req, move(callback));
+        [authController, rateLimiter, trustedProxyHops, registerMetrics](
+            const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            withRateLimit(rateLimiter, RateLimiter::Rule::Register,
+                [&] { return "ip:" + clientAddress(req, trustedProxyHops); },
+                registerMetrics.wrap(move(callback)),
+                [authController, req](ResponseCallback&& cb) { authController->handleRegister(req, move(cb)); });
         }, {Post});
 
     app.registerHandler("/api/v1/login",
-        [authController](const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
-            authController->handleLogin(req, move(callback));
+        [authController, rateLimiter, trustedProxyHops, loginMetrics](
+            const HttpRequestPtr& req, function<void(const HttpResponsePtr&)>&& callback) {
+            withRateLimit(rateLimiter, RateLimiter::Rule::Login,
+                [&] { return "ip:" + clientAddress(req, trustedProxyHops); },
+                loginMetrics.wrap(move(callback)),
+                [authController, req](ResponseCallback&& cb) { authController->handleLogin(req, move(cb)); });
         }, {Post});
 
     app.run();
+
+    // The handlers keep urlService alive past this point, so flush the
+    // clicks counted since the last interval here.
+    if (clickAnalytics) {
+        clickAnalytics->stop();
+    }
 }
@@ -0,0 +1,28 @@
+#include "HttpMetrics.h"
+#include <chrono>
+
+HandlerMetrics::HandlerMetrics(const std::string& handler) {
+    auto& registry = MetricsRegistry::instance();
+    latency_ = &registry.histogram("urlshortener_http_request_duration_seconds",
+                                   "Time from routing to response per handler",
+                                   {{"handler", handler}});
+    static const char* kClasses[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+    for (size_t i = 0; i < responses_.size(); ++i) {
+        responses_[i] = &registry.counter("urlshortener_http_responses_total",
+                                          "Responses per handler and status class",
+                                          {{"handler", handler}, {"code", kClasses[i]}});
+    }
+}
+
+std::function<void(const drogon::HttpResponsePtr&)> HandlerMetrics::wrap(
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback) const {
+    return [latency = latency_, responses = responses_, started = std::chrono::steady_clock::now(),
+            callback = std::move(callback)](const drogon::HttpResponsePtr& resp) {
+        latency->observe(std::chrono::steady_clock::now() - started);
+        const auto cls = static_cast<size_t>(resp ? resp->statusCode() / 100 : 5);
+        if (cls >= 1 && cls <= responses.size()) {
+            responses[cls - 1]->inc();
+        }
+        callback(resp);
+    };
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "Metrics.h"
+#include <drogon/HttpResponse.h>
+#include <array>
+#include <functional>
+#include <string>
+
+// Latency histogram and per-status-class response counters for one handler.
+class HandlerMetrics {
+public:
+    explicit HandlerMetrics(const std::string& handler);
+
+    // Wraps a response callback so the time until it fires and the
+    // response's status class are recorded.
+    std::function<void(const drogon::HttpResponsePtr&)> wrap(
+        std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+
+private:
+    Histogram* latency_;
+    std::array<Counter*, 5> responses_;
+};
@@ -0,0 +1,254 @@
+#include "Metrics.h"
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace metrics_detail {
+size_t threadSlot() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t slot = next.fetch_add(1, std::memory_order_relaxed) % kSlots;
+    return slot;
+}
+}  // namespace metrics_detail
+
+namespace {
+const char* kindName(bool histogram, bool gauge) {
+    if (histogram) {
+        return "histogram";
+    }
+    return gauge ? "gauge" : "counter";
+}
+
+std::string formatValue(double value) {
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char buffer[32];
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    }
+    return buffer;
+}
+
+void appendEscaped(std::string& out, const std::string& value) {
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out.push_back(c);
+        }
+    }
+}
+}  // namespace
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto& cell : cells_) {
+        total += cell.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t Histogram::bucketFor(uint64_t micros) {
+    if (micros < 4) {
+        return static_cast<size_t>(micros);
+    }
+    const auto exponent = static_cast<size_t>(std::bit_width(micros) - 1);
+    const auto sub = static_cast<size_t>((micros >> (exponent - 2)) & 3);
+    const auto index = (exponent - 1) * 4 + sub;
+    return index < kBuckets ? index : kBuckets - 1;
+}
+
+uint64_t Histogram::bucketLowerBound(size_t index) {
+    if (index < 4) {
+        return index;
+    }
+    const auto exponent = index / 4 + 1;
+    const auto sub = index % 4;
+    return (uint64_t{4} + sub) << (exponent - 2);
+}
+
+void Histogram::observe(std::chrono::nanoseconds elapsed) {
+    const auto nanos = static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0));
+    auto& slot = slots_[metrics_detail::threadSlot()];
+    slot.buckets[bucketFor(nanos / 1000)].fetch_add(1, std::memory_order_relaxed);
+    slot.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    uint64_t sumNanos = 0;
+    for (const auto& slot : slots_) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            const auto n = slot.buckets[i].load(std::memory_order_relaxed);
+            snap.buckets[i] += n;
+            snap.count += n;
+        }
+        sumNanos += slot.sumNanos.load(std::memory_order_relaxed);
+    }
+    snap.sumSeconds = static_cast<double>(sumNanos) / 1e9;
+    return snap;
+}
+
+void PrometheusWriter::family(const std::string& name, const std::string& help, const char* type) {
+    out_ += "# HELP ";
+    out_ += name;
+    out_.push_back(' ');
+    out_ += help;
+    out_ += "\n# TYPE ";
+    out_ += name;
+    out_.push_back(' ');
+    out_ += type;
+    out_.push_back('\n');
+}
+
+void PrometheusWriter::appendLabels(const MetricLabels& labels, const char* extraKey, const std::string& extraValue) {
+    if (labels.empty() && !extraKey) {
+        return;
+    }
+    out_.push_back('{');
+    bool first = true;
+    for (const auto& [key, value] : labels) {
+        if (!first) {
+            out_.push_back(',');
+        }
+        first = false;
+        out_ += key;
+        out_ += "=\"";
+        appendEscaped(out_, value);
+        out_.push_back('"');
+    }
+    if (extraKey) {
+        if (!first) {
+            out_.push_back(',');
+        }
+        out_ += extraKey;
+        out_ += "=\"";
+        out_ += extraValue;
+        out_.push_back('"');
+    }
+    out_.push_back('}');
+}
+
+void PrometheusWriter::sample(const std::string& name, const MetricLabels& labels, double value) {
+    out_ += name;
+    appendLabels(labels);
+    out_.push_back(' ');
+    out_ += formatValue(value);
+    out_.push_back('\n');
+}
+
+void PrometheusWriter::histogram(const std::string& name, const MetricLabels& labels,
+                                 const Histogram::Snapshot& snapshot) {
+    // Export every other internal bucket: 52 boundaries from 2us to ~67s.
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+        cumulative += snapshot.buckets[i];
+        if (i % 2 == 0 || i + 1 == Histogram::kBuckets) {
+            continue;
+        }
+        const auto upperSeconds = static_cast<double>(Histogram::bucketLowerBound(i + 1)) / 1e6;
+        out_ += name;
+        out_ += "_bucket";
+        appendLabels(labels, "le", formatValue(upperSeconds));
+        out_.push_back(' ');
+        out_ += formatValue(static_cast<double>(cumulative));
+        out_.push_back('\n');
+    }
+    out_ += name;
+    out_ += "_bucket";
+    appendLabels(labels, "le", "+Inf");
+    out_.push_back(' ');
+    out_ += formatValue(static_cast<double>(snapshot.count));
+    out_.push_back('\n');
+    sample(name + "_sum", labels, snapshot.sumSeconds);
+    sample(name + "_count", labels, static_cast<double>(snapshot.count));
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Series& MetricsRegistry::series(const std::string& name, const std::string& help,
+                                                 Kind kind, const MetricLabels& labels) {
+    auto [it, inserted] = families_.try_emplace(name);
+    auto& family = it->second;
+    if (inserted) {
+        family.help = help;
+        family.kind = kind;
+    } else if (family.kind != kind) {
+        throw std::runtime_error("metric " + name + " registered with conflicting types");
+    }
+    for (auto& existing : family.series) {
+        if (existing->labels == labels) {
+            return *existing;
+        }
+    }
+    family.series.push_back(std::make_unique<Series>());
+    family.series.back()->labels = labels;
+    return *family.series.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = series(name, help, Kind::Counter, labels);
+    if (!s.counter) {
+        s.counter = std::make_unique<Counter>();
+    }
+    return *s.counter;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = series(name, help, Kind::Histogram, labels);
+    if (!s.histogram) {
+        s.histogram = std::make_unique<Histogram>();
+    }
+    return *s.histogram;
+}
+
+void MetricsRegistry::gauge(const std::string& name, const std::string& help, const MetricLabels& labels,
+                            std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    series(name, help, Kind::Gauge, labels).gauge = std::move(read);
+}
+
+void MetricsRegistry::addCollector(Collector collector) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectors_.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::renderPrometheus() const {
+    PrometheusWriter writer;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [name, family] : families_) {
+        writer.family(name, family.help, kindName(family.kind == Kind::Histogram, family.kind == Kind::Gauge));
+        for (const auto& s : family.series) {
+            switch (family.kind) {
+            case Kind::Counter:
+                writer.sample(name, s->labels, static_cast<double>(s->counter->value()));
+                break;
+            case Kind::Histogram:
+                writer.histogram(name, s->labels, s->histogram->snapshot());
+                break;
+            case Kind::Gauge:
+                writer.sample(name, s->labels, s->gauge ? s->gauge() : 0.0);
+                break;
+            }
+        }
+    }
+    for (const auto& collector : collectors_) {
+        collector(writer);
+    }
+    return writer.take();
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal Prometheus-style metrics. Counters and histograms are striped over
+// cache-line aligned per-thread slots updated with relaxed atomics, so the
+// request path never takes a lock; a scrape just sums the slots.
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+namespace metrics_detail {
+constexpr size_t kSlots = 16;
+
+// Stable slot for the calling thread, assigned round-robin on first use.
+size_t threadSlot();
+}  // namespace metrics_detail
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) {
+        cells_[metrics_detail::threadSlot()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Cell, metrics_detail::kSlots> cells_;
+};
+
+// HDR-style log-linear latency histogram with microsecond resolution: four
+// sub-buckets per power of two, from 1us up to ~67s.
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 104;
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> buckets{};
+        uint64_t count{0};
+        double sumSeconds{0.0};
+    };
+
+    void observe(std::chrono::nanoseconds elapsed);
+    Snapshot snapshot() const;
+
+    static size_t bucketFor(uint64_t micros);
+    // Inclusive lower bound of a bucket, in microseconds.
+    static uint64_t bucketLowerBound(size_t index);
+
+private:
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+        std::atomic<uint64_t> sumNanos{0};
+    };
+    std::array<Slot, metrics_detail::kSlots> slots_;
+};
+
+// Times a scope into a histogram.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        histogram_.observe(std::chrono::steady_clock::now() - started_);
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Accumulates the text exposition format; used by the registry and by
+// collectors that export several values from one stats() call.
+class PrometheusWriter {
+public:
+    void family(const std::string& name, const std::string& help, const char* type);
+    void sample(const std::string& name, const MetricLabels& labels, double value);
+    void histogram(const std::string& name, const MetricLabels& labels, const Histogram::Snapshot& snapshot);
+    std::string take() { return std::move(out_); }
+
+private:
+    std::string out_;
+    void appendLabels(const MetricLabels& labels, const char* extraKey = nullptr, const std::string& extraValue = {});
+};
+
+class MetricsRegistry {
+public:
+    using Collector = std::function<void(PrometheusWriter&)>;
+
+    static MetricsRegistry& instance();
+
+    // Registration is idempotent per (name, labels); the returned references
+    // stay valid for the life of the process.
+    Counter& counter(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    Histogram& histogram(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    void gauge(const std::string& name, const std::string& help, const MetricLabels& labels,
+               std::function<double()> read);
+
+    // For subsystems that keep their own counters and export them at scrape time.
+    void addCollector(Collector collector);
+
+    std::string renderPrometheus() const;
+
+private:
+    enum class Kind { Counter, Histogram, Gauge };
+
+    struct Series {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> gauge;
+    };
+
+    struct Family {
+        std::string help;
+        Kind kind;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+    std::vector<Collector> collectors_;
+
+    Series& series(const std::string& name, const std::string& help, Kind kind, const MetricLabels& labels);
+};
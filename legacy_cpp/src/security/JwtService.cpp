@@ -1,13 +1,91 @@
 #include "JwtService.h"
 #include <json/json.h>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+#include <array>
+#include <atomic>
 #include <memory>
 #include <stdexcept>
 
 namespace {
+constexpr size_t kSignatureBytes = 32;
+// Decoded header/payload up to this size stay on the stack
+constexpr size_t kInlineSegmentBytes = 1024;
+constexpr size_t kCacheEntries = 64;
+
+constexpr char kEncodeTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Maps base64url (and plain base64 '+' '/') characters to 6-bit values; 0xff marks invalid input.
+constexpr std::array<uint8_t, 256> makeDecodeTable() {
+    std::array<uint8_t, 256> table{};
+    for (auto& v : table) {
+        v = 0xff;
+    }
+    for (uint8_t i = 0; i < 64; ++i) {
+        table[static_cast<uint8_t>(kEncodeTable[i])] = i;
+    }
+    table[static_cast<uint8_t>('+')] = 62;
+    table[static_cast<uint8_t>('/')] = 63;
+    return table;
+}
+constexpr auto kDecodeTable = makeDecodeTable();
+
+constexpr size_t decodedSize(size_t encoded) {
+    return encoded / 4 * 3 + (encoded % 4 == 0 ? 0 : encoded % 4 - 1);
+}
+
+// Decodes unpadded (or '='-padded) base64url into out; returns the number of
+// bytes written, or std::nullopt on malformed input or insufficient space.
+std::optional<size_t> decodeBase64Url(std::string_view in, unsigned char* out, size_t capacity) {
+    while (!in.empty() && in.back() == '=') {
+        in.remove_suffix(1);
+    }
+    if (in.size() % 4 == 1) {
+        return std::nullopt;
+    }
+    const auto needed = decodedSize(in.size());
+    if (needed > capacity) {
+        return std::nullopt;
+    }
+    const auto* src = reinterpret_cast<const unsigned char*>(in.data());
+    size_t i = 0;
+    size_t o = 0;
+    for (; i + 4 <= in.size(); i += 4) {
+        const uint32_t a = kDecodeTable[src[i]];
+        const uint32_t b = kDecodeTable[src[i + 1]];
+        const uint32_t c = kDecodeTable[src[i + 2]];
+        const uint32_t d = kDecodeTable[src[i + 3]];
+        if ((a | b | c | d) & 0x80) {
+            return std::nullopt;
+        }
+        const uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+        out[o++] = static_cast<unsigned char>(triple >> 16);
+        out[o++] = static_cast<unsigned char>(triple >> 8);
+        out[o++] = static_cast<unsigned char>(triple);
+    }
+    const auto rest = in.size() - i;
+    if (rest >= 2) {
+        const uint32_t a = kDecodeTable[src[i]];
+        const uint32_t b = kDecodeTable[src[i + 1]];
+        const uint32_t c = rest == 3 ? kDecodeTable[src[i + 2]] : 0;
+        if ((a | b | c) & 0x80) {
+            return std::nullopt;
+        }
+        const uint32_t triple = (a << 18) | (b << 12) | (c << 6);
+        out[o++] = static_cast<unsigned char>(triple >> 16);
+        if (rest == 3) {
+            out[o++] = static_cast<unsigned char>(triple >> 8);
+        }
+    }
+    return o;
+}
+
 std::string compactJson(const Json::Value& value) {
     Json::StreamWriterBuilder builder;
     builder["indentation"] = "";
@@ -17,25 +95,109 @@ std::string compactJson(const Json::Value& value) {
 std::chrono::system_clock::time_point fromEpochSeconds(long long seconds) {
     return std::chrono::system_clock::time_point{std::chrono::seconds{seconds}};
 }
+
+long long nowEpochSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool parseJson(const char* begin, const char* end, Json::Value& target) {
+    thread_local std::unique_ptr<Json::CharReader> reader = [] {
+        Json::CharReaderBuilder builder;
+        return std::unique_ptr<Json::CharReader>(builder.newCharReader());
+    }();
+    std::string errors;
+    return reader->parse(begin, end, &target, &errors);
+}
+
+// Decoded segment, on the stack unless unusually large
+class SegmentBuffer {
+public:
+    bool decode(std::string_view encoded) {
+        const auto needed = decodedSize(encoded.size()) + 1;
+        unsigned char* out = inline_;
+        if (needed > sizeof(inline_)) {
+            heap_.reset(new unsigned char[needed]);
+            out = heap_.get();
+        }
+        auto len = decodeBase64Url(encoded, out, needed);
+        if (!len) {
+            return false;
+        }
+        data_ = reinterpret_cast<const char*>(out);
+        size_ = *len;
+        return true;
+    }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+private:
+    unsigned char inline_[kInlineSegmentBytes];
+    std::unique_ptr<unsigned char[]> heap_;
+    const char* data_{nullptr};
+    size_t size_{0};
+};
+
+struct CacheEntry {
+    uint64_t owner{0};
+    long long expEpoch{0};
+    std::string token;
+    JwtService::Claims claims;
+};
+
+size_t cacheSlot(std::string_view token) {
+    // The signature is the tail of the token and already uniformly random.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const auto tail = token.substr(token.size() > 16 ? token.size() - 16 : 0);
+    for (unsigned char c : tail) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return static_cast<size_t>(h % kCacheEntries);
+}
+
+std::array<CacheEntry, kCacheEntries>& verifiedCache() {
+    thread_local std::array<CacheEntry, kCacheEntries> cache;
+    return cache;
+}
+
+std::atomic<uint64_t> nextInstanceId{1};
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+struct MacContext {
+    uint64_t owner{0};
+    EVP_MAC_CTX* ctx{nullptr};
+    ~MacContext() {
+        EVP_MAC_CTX_free(ctx);
+    }
+};
+
+EVP_MAC* hmacAlgorithm() {
+    static EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    return mac;
+}
+#endif
 }  // namespace
 
 JwtService::JwtService(std::string secret, std::chrono::seconds ttl)
-    : secret_(std::move(secret)), ttl_(ttl) {
+    : secret_(std::move(secret)),
+      ttl_(ttl),
+      instanceId_(nextInstanceId.fetch_add(1, std::memory_order_relaxed)) {
     if (secret_.empty()) {
         throw std::runtime_error("JWT secret must not be empty");
     }
     if (ttl_.count() <= 0) {
         throw std::runtime_error("JWT TTL must be positive");
     }
+    Json::Value header;
+    header["alg"] = "HS256";
+    header["typ"] = "JWT";
+    canonicalHeader_ = base64UrlEncode(compactJson(header));
 }
 
 std::string JwtService::issueToken(long userId,
                                    std::string_view name,
                                    std::string_view email) const {
-    Json::Value header;
-    header["alg"] = "HS256";
-    header["typ"] = "JWT";
-
     const auto now = std::chrono::system_clock::now();
     const auto expires = now + ttl_;
     const auto nowEpoch = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
@@ -48,21 +210,43 @@ std::string JwtService::issueToken(long userId,
     payload["iat"] = static_cast<Json::Int64>(nowEpoch);
     payload["exp"] = static_cast<Json::Int64>(expEpoch);
 
-    const auto encodedHeader = base64UrlEncode(compactJson(header));
     const auto encodedPayload = base64UrlEncode(compactJson(payload));
-    const auto signingInput = encodedHeader + "." + encodedPayload;
-    const auto signature = base64UrlEncode(hmacSha256(signingInput));
+    const auto signingInput = canonicalHeader_ + "." + encodedPayload;
+    unsigned char signature[kSignatureBytes];
+    hmacSha256(signingInput, signature);
+
+    return signingInput + "." +
+           base64UrlEncode(std::string_view(reinterpret_cast<const char*>(signature), sizeof(signature)));
+}
+
+std::optional<JwtService::Claims> JwtService::verify(std::string_view token) const {
+    auto& entry = verifiedCache()[cacheSlot(token)];
+    if (entry.owner == instanceId_ && entry.token == token) {
+        if (entry.expEpoch > nowEpochSeconds()) {
+            return entry.claims;
+        }
+        entry.owner = 0;
+        return std::nullopt;
+    }
 
-    return signingInput + "." + signature;
+    auto claims = verifyUncached(token);
+    if (claims) {
+        entry.owner = instanceId_;
+        entry.token.assign(token.data(), token.size());
+        entry.claims = *claims;
+        entry.expEpoch = std::chrono::duration_cast<std::chrono::seconds>(
+            claims->expiresAt.time_since_epoch()).count();
+    }
+    return claims;
 }
 
-std::optional<JwtService::Claims> JwtService::verify(const std::string& token) const {
-    auto firstDot = token.find('.');
-    if (firstDot == std::string::npos) {
+std::optional<JwtService::Claims> JwtService::verifyUncached(std::string_view token) const {
+    const auto firstDot = token.find('.');
+    if (firstDot == std::string_view::npos) {
         return std::nullopt;
     }
-    auto secondDot = token.find('.', firstDot + 1);
-    if (secondDot == std::string::npos) {
+    const auto secondDot = token.find('.', firstDot + 1);
+    if (secondDot == std::string_view::npos) {
         return std::nullopt;
     }
 
@@ -70,52 +254,41 @@ std::optional<JwtService::Claims> JwtService::verify(const std::string& token) c
     const auto payloadPart = token.substr(firstDot + 1, secondDot - firstDot - 1);
     const auto signaturePart = token.substr(secondDot + 1);
 
-    const auto headerRaw = base64UrlDecode(headerPart);
-    const auto payloadRaw = base64UrlDecode(payloadPart);
-    const auto signatureRaw = base64UrlDecode(signaturePart);
-    if (!headerRaw || !payloadRaw || !signatureRaw) {
+    // Check the signature before parsing anything attacker-controlled.
+    unsigned char provided[kSignatureBytes + 1];
+    auto providedLen = decodeBase64Url(signaturePart, provided, sizeof(provided));
+    if (!providedLen || *providedLen != kSignatureBytes) {
         return std::nullopt;
     }
-
-    Json::Value headerJson;
-    Json::Value payloadJson;
-    Json::CharReaderBuilder builder;
-    const auto parseJson = [&builder](const std::string& raw, Json::Value& target) {
-        std::string errors;
-        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-        return reader->parse(raw.data(), raw.data() + raw.size(), &target, &errors);
-    };
-    if (!parseJson(*headerRaw, headerJson) || !parseJson(*payloadRaw, payloadJson)) {
+    unsigned char expected[kSignatureBytes];
+    hmacSha256(token.substr(0, secondDot), expected);
+    if (CRYPTO_memcmp(expected, provided, kSignatureBytes) != 0) {
         return std::nullopt;
     }
 
-    if (!headerJson.isMember("alg") || headerJson["alg"].asString() != "HS256") {
-        return std::nullopt;
+    // Tokens we issued carry a fixed header; anything else must still be HS256.
+    if (headerPart != canonicalHeader_) {
+        SegmentBuffer header;
+        Json::Value headerJson;
+        if (!header.decode(headerPart) || !parseJson(header.begin(), header.end(), headerJson)) {
+            return std::nullopt;
+        }
+        if (!headerJson.isObject() || !headerJson.isMember("alg") || headerJson["alg"].asString() != "HS256") {
+            return std::nullopt;
+        }
     }
 
-    const auto signingInput = headerPart + "." + payloadPart;
-    const auto expectedSignature = hmacSha256(signingInput);
-    const auto& providedSignature = *signatureRaw;
-
-    if (expectedSignature.size() != providedSignature.size()) {
-        return std::nullopt;
-    }
-    unsigned char diff = 0;
-    for (size_t i = 0; i < expectedSignature.size(); ++i) {
-        diff |= static_cast<unsigned char>(expectedSignature[i] ^ providedSignature[i]);
-    }
-    if (diff != 0) {
+    SegmentBuffer payload;
+    Json::Value payloadJson;
+    if (!payload.decode(payloadPart) || !parseJson(payload.begin(), payload.end(), payloadJson)) {
         return std::nullopt;
     }
-
-    if (!payloadJson.isMember("sub") || !payloadJson.isMember("exp")) {
+    if (!payloadJson.isObject() || !payloadJson.isMember("sub") || !payloadJson.isMember("exp")) {
         return std::nullopt;
     }
 
     const auto expEpoch = payloadJson["exp"].asInt64();
-    const auto nowEpoch = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
-    if (expEpoch <= nowEpoch) {
+    if (expEpoch <= nowEpochSeconds()) {
         return std::nullopt;
     }
 
@@ -127,84 +300,89 @@ std::optional<JwtService::Claims> JwtService::verify(const std::string& token) c
     return claims;
 }
 
-std::string JwtService::hmacSha256(const std::string& data) const {
+void JwtService::hmacSha256(std::string_view data, unsigned char* out) const {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // One keyed context per thread; EVP_MAC_init with a null key restarts it
+    // with the key already set.
+    thread_local MacContext mac;
+    if (mac.owner != instanceId_ || !mac.ctx) {
+        EVP_MAC_CTX_free(mac.ctx);
+        mac.ctx = EVP_MAC_CTX_new(hmacAlgorithm());
+        if (!mac.ctx) {
+            throw std::runtime_error("failed to allocate HMAC context");
+        }
+        char digest[] = "SHA256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+            OSSL_PARAM_construct_end(),
+        };
+        if (EVP_MAC_init(mac.ctx,
+                         reinterpret_cast<const unsigned char*>(secret_.data()),
+                         secret_.size(),
+                         params) != 1) {
+            EVP_MAC_CTX_free(mac.ctx);
+            mac.ctx = nullptr;
+            throw std::runtime_error("failed to initialise HMAC");
+        }
+        mac.owner = instanceId_;
+    } else if (EVP_MAC_init(mac.ctx, nullptr, 0, nullptr) != 1) {
+        throw std::runtime_error("failed to reset HMAC");
+    }
+    size_t len = 0;
+    if (EVP_MAC_update(mac.ctx, reinterpret_cast<const unsigned char*>(data.data()), data.size()) != 1 ||
+        EVP_MAC_final(mac.ctx, out, &len, kSignatureBytes) != 1 || len != kSignatureBytes) {
+        throw std::runtime_error("failed to compute HMAC");
+    }
+#else
     unsigned int len = 0;
-    unsigned char result[EVP_MAX_MD_SIZE];
     auto digest = HMAC(EVP_sha256(),
                        secret_.data(),
                        static_cast<int>(secret_.size()),
                        reinterpret_cast<const unsigned char*>(data.data()),
                        data.size(),
-                       result,
+                       out,
                        &len);
-    if (digest == nullptr) {
+    if (digest == nullptr || len != kSignatureBytes) {
         throw std::runtime_error("failed to compute HMAC");
     }
-    return std::string(reinterpret_cast<char*>(result), len);
-}
-
-std::string JwtService::base64UrlEncode(const std::string& data) {
-    BIO* base64 = BIO_new(BIO_f_base64());
-    if (!base64) {
-        throw std::runtime_error("failed to allocate base64 BIO");
-    }
-    BIO* memory = BIO_new(BIO_s_mem());
-    if (!memory) {
-        BIO_free(base64);
-        throw std::runtime_error("failed to allocate memory BIO");
-    }
-    BIO_set_flags(base64, BIO_FLAGS_BASE64_NO_NL);
-    BIO* bio = BIO_push(base64, memory);
-    BIO_write(bio, data.data(), static_cast<int>(data.size()));
-    BIO_flush(bio);
-    BUF_MEM* bufferPtr = nullptr;
-    BIO_get_mem_ptr(bio, &bufferPtr);
-    std::string encoded(bufferPtr->data, bufferPtr->length);
-    BIO_free_all(bio);
-
-    for (char& c : encoded) {
-        if (c == '+') {
-            c = '-';
-        } else if (c == '/') {
-            c = '_';
-        }
-    }
-    while (!encoded.empty() && encoded.back() == '=') {
-        encoded.pop_back();
-    }
-    return encoded;
+#endif
 }
 
-std::optional<std::string> JwtService::base64UrlDecode(const std::string& input) {
-    std::string data = input;
-    for (char& c : data) {
-        if (c == '-') {
-            c = '+';
-        } else if (c == '_') {
-            c = '/';
-        }
+std::string JwtService::base64UrlEncode(std::string_view data) {
+    std::string encoded;
+    encoded.resize((data.size() + 2) / 3 * 4);
+    const auto* src = reinterpret_cast<const unsigned char*>(data.data());
+    size_t o = 0;
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        const uint32_t triple = (uint32_t{src[i]} << 16) | (uint32_t{src[i + 1]} << 8) | src[i + 2];
+        encoded[o++] = kEncodeTable[(triple >> 18) & 0x3f];
+        encoded[o++] = kEncodeTable[(triple >> 12) & 0x3f];
+        encoded[o++] = kEncodeTable[(triple >> 6) & 0x3f];
+        encoded[o++] = kEncodeTable[triple & 0x3f];
     }
-    while (data.size() % 4 != 0) {
-        data.push_back('=');
+    const auto rest = data.size() - i;
+    if (rest > 0) {
+        uint32_t triple = uint32_t{src[i]} << 16;
+        if (rest == 2) {
+            triple |= uint32_t{src[i + 1]} << 8;
+        }
+        encoded[o++] = kEncodeTable[(triple >> 18) & 0x3f];
+        encoded[o++] = kEncodeTable[(triple >> 12) & 0x3f];
+        if (rest == 2) {
+            encoded[o++] = kEncodeTable[(triple >> 6) & 0x3f];
+        }
     }
+    encoded.resize(o);
+    return encoded;
+}
 
-    BIO* base64 = BIO_new(BIO_f_base64());
-    if (!base64) {
-        return std::nullopt;
-    }
-    BIO* source = BIO_new_mem_buf(data.data(), static_cast<int>(data.size()));
-    if (!source) {
-        BIO_free(base64);
-        return std::nullopt;
-    }
-    BIO_set_flags(base64, BIO_FLAGS_BASE64_NO_NL);
-    BIO* bio = BIO_push(base64, source);
-    std::string decoded(data.size(), '\0');
-    const int len = BIO_read(bio, decoded.data(), static_cast<int>(decoded.size()));
-    BIO_free_all(bio);
-    if (len <= 0) {
+std::optional<std::string> JwtService::base64UrlDecode(std::string_view input) {
+    std::string decoded(decodedSize(input.size()) + 1, '\0');
+    auto len = decodeBase64Url(input, reinterpret_cast<unsigned char*>(decoded.data()), decoded.size());
+    if (!len || (*len == 0 && !input.empty())) {
         return std::nullopt;
     }
-    decoded.resize(static_cast<size_t>(len));
+    decoded.resize(*len);
     return decoded;
 }
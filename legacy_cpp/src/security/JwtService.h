@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -20,13 +21,23 @@ public:
                            std::string_view name,
                            std::string_view email) const;
 
-    std::optional<Claims> verify(const std::string& token) const;
+    // Decodes into stack buffers and reuses a per-thread HMAC context.
+    // Recently verified tokens are served from a small per-thread cache
+    // until their exp passes.
+    std::optional<Claims> verify(std::string_view token) const;
+
+    // Unpadded base64url as used by JWT segments
+    static std::string base64UrlEncode(std::string_view data);
+    static std::optional<std::string> base64UrlDecode(std::string_view input);
 
 private:
     std::string secret_;
     std::chrono::seconds ttl_;
+    // Tags per-thread cache and HMAC state so instances never share it
+    uint64_t instanceId_;
+    std::string canonicalHeader_;
 
-    static std::string base64UrlEncode(const std::string& data);
-    static std::optional<std::string> base64UrlDecode(const std::string& input);
-    std::string hmacSha256(const std::string& data) const;
+    std::optional<Claims> verifyUncached(std::string_view token) const;
+    // Writes the 32-byte HMAC-SHA256 of data into out.
+    void hmacSha256(std::string_view data, unsigned char* out) const;
 };
@@ -9,52 +9,67 @@
 using drogon::HttpStatusCode;
 
 AuthService::AuthService(std::shared_ptr<DataStore> store,
-                         std::shared_ptr<JwtService> jwtService)
+                         std::shared_ptr<JwtService> jwtService,
+                         std::shared_ptr<KdfWorkerPool> kdfPool)
     : store_(std::move(store)),
-      jwtService_(std::move(jwtService)) {
+      jwtService_(std::move(jwtService)),
+      kdfPool_(std::move(kdfPool)) {
     if (!store_) {
         throw std::runtime_error("DataStore dependency missing");
     }
     if (!jwtService_) {
         throw std::runtime_error("JwtService dependency missing");
     }
+    if (!kdfPool_) {
+        throw std::runtime_error("KdfWorkerPool dependency missing");
+    }
 }
 
-AuthService::LoginResult AuthService::registerUser(const std::string& name,
-                                                    const std::string& email,
-                                                    const std::string& password) {
+drogon::Task<AuthService::LoginResult> AuthService::registerUser(std::string name,
+                                                                  std::string email,
+                                                                  std::string password) {
     ensureName(name);
     ensureEmailAndPassword(email, password);
     auto normalizedEmail = normalizeEmail(email);
     validatePassword(password);
 
-    if (store_->findUserByEmail(normalizedEmail)) {
+    if (co_await store_->findUserByEmailCoro(normalizedEmail)) {
         throw ServiceError(HttpStatusCode::k409Conflict, "email already exists");
     }
 
     auto cleanedName = trim(name);
+    co_await moveToKdfPool();
     auto hashed = PasswordHasher::hash(password);
-    auto userId = store_->createUser(cleanedName, normalizedEmail, hashed);
+    auto userId = co_await store_->createUserCoro(cleanedName, normalizedEmail, std::move(hashed));
     UserContext ctx{userId, cleanedName, normalizedEmail};
     auto token = jwtService_->issueToken(userId, ctx.name, ctx.email);
 
-    return LoginResult{ctx, token};
+    co_return LoginResult{ctx, token};
 }
 
-AuthService::LoginResult AuthService::login(const std::string& email,
-                                            const std::string& password) {
+drogon::Task<AuthService::LoginResult> AuthService::login(std::string email,
+                                                           std::string password) {
     ensureEmailAndPassword(email, password);
     auto normalized = normalizeEmail(email);
-    auto user = store_->findUserByEmail(normalized);
+    auto user = co_await store_->findUserByEmailCoro(normalized);
     if (!user) {
         throw ServiceError(HttpStatusCode::k401Unauthorized, "invalid credentials");
     }
+    co_await moveToKdfPool();
     if (!PasswordHasher::verify(password, user->passwordHash)) {
         throw ServiceError(HttpStatusCode::k401Unauthorized, "invalid credentials");
     }
     auto token = jwtService_->issueToken(user->id, user->name, user->email);
     UserContext ctx{user->id, user->name, user->email};
-    return LoginResult{ctx, token};
+    co_return LoginResult{ctx, token};
+}
+
+drogon::Task<> AuthService::moveToKdfPool() const {
+    try {
+        co_await kdfPool_->schedule();
+    } catch (const KdfWorkerPool::Saturated&) {
+        throw ServiceError(HttpStatusCode::k503ServiceUnavailable, "authentication busy, retry shortly");
+    }
 }
 
 std::optional<AuthService::UserContext> AuthService::authenticate(
@@ -69,7 +84,7 @@ std::optional<AuthService::UserContext> AuthService::authenticate(
         return std::nullopt;
     }
     if (rawToken) {
-        *rawToken = *token;
+        rawToken->assign(token->data(), token->size());
     }
     return UserContext{claims->userId, claims->name, claims->email};
 }
@@ -112,29 +127,29 @@ void AuthService::ensureName(const std::string& name) {
     }
 }
 
-std::optional<std::string> AuthService::extractToken(
+std::optional<std::string_view> AuthService::extractToken(
     const drogon::HttpRequestPtr& request) const {
-    auto header = request->getHeader("authorization");
+    // Views point into the request's own header/parameter storage.
+    const auto& header = request->getHeader("authorization");
     if (!header.empty()) {
-        if (header.rfind("Bearer ", 0) == 0) {
-            return header.substr(7);
+        std::string_view value(header);
+        if (value.rfind("Bearer ", 0) == 0) {
+            return value.substr(7);
         }
-        if (header.rfind("Token ", 0) == 0) {
-            return header.substr(6);
+        if (value.rfind("Token ", 0) == 0) {
+            return value.substr(6);
         }
-        return header;
-    }
-    auto apiKey = request->getHeader("x-api-key");
-    if (!apiKey.empty()) {
-        return apiKey;
+        return value;
     }
-    apiKey = request->getHeader("x-api-token");
-    if (!apiKey.empty()) {
-        return apiKey;
+    for (const char* name : {"x-api-key", "x-api-token"}) {
+        const auto& apiKey = request->getHeader(name);
+        if (!apiKey.empty()) {
+            return std::string_view(apiKey);
+        }
     }
-    auto queryToken = request->getParameter("api_key");
+    const auto& queryToken = request->getParameter("api_key");
     if (!queryToken.empty()) {
-        return queryToken;
+        return std::string_view(queryToken);
     }
     return std::nullopt;
 }
@@ -1,10 +1,13 @@
 #pragma once
 #include "DataStore.h"
+#include "KdfWorkerPool.h"
 #include "ServiceError.h"
 #include <drogon/HttpRequest.h>
+#include <drogon/utils/coroutine.h>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 
 class JwtService;
 
@@ -22,14 +25,18 @@ public:
     };
 
     AuthService(std::shared_ptr<DataStore> store,
-                std::shared_ptr<JwtService> jwtService);
+                std::shared_ptr<JwtService> jwtService,
+                std::shared_ptr<KdfWorkerPool> kdfPool);
 
-    LoginResult registerUser(const std::string& name,
-                             const std::string& email,
-                             const std::string& password);
+    // Queries run without blocking the calling loop; password hashing hops
+    // to kdfPool, so the task completes on a worker or DB client thread.
+    // A saturated pool is reported as ServiceError 503.
+    drogon::Task<LoginResult> registerUser(std::string name,
+                                           std::string email,
+                                           std::string password);
 
-    LoginResult login(const std::string& email,
-                      const std::string& password);
+    drogon::Task<LoginResult> login(std::string email,
+                                    std::string password);
 
     std::optional<UserContext> authenticate(
         const drogon::HttpRequestPtr& request,
@@ -38,6 +45,9 @@ public:
 private:
     std::shared_ptr<DataStore> store_;
     std::shared_ptr<JwtService> jwtService_;
+    std::shared_ptr<KdfWorkerPool> kdfPool_;
+
+    drogon::Task<> moveToKdfPool() const;
 
     static std::string normalizeEmail(std::string email);
     static std::string trim(std::string value);
@@ -46,6 +56,6 @@ private:
                                        const std::string& password);
     static void ensureName(const std::string& name);
 
-    std::optional<std::string> extractToken(
+    std::optional<std::string_view> extractToken(
         const drogon::HttpRequestPtr& request) const;
 };
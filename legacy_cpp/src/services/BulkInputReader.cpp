@@ -0,0 +1,160 @@
+#include "BulkInputReader.h"
+
+namespace {
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && isBlank(value.front())) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && isBlank(value.back())) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+constexpr size_t kIncomplete = std::string_view::npos;
+
+// Length of the JSON value at the start of input, 0 if there is none, or
+// kIncomplete if it may continue past the end of input. Only brackets and
+// string escapes are tracked; the item parser validates the rest.
+size_t valueLength(std::string_view input, bool final) {
+    int depth = 0;
+    bool inString = false;
+    for (size_t i = 0; i < input.size(); ++i) {
+        const char c = input[i];
+        if (inString) {
+            if (c == '\\') {
+                ++i;
+            } else if (c == '"') {
+                inString = false;
+                if (depth == 0) {
+                    return i + 1;
+                }
+            }
+            continue;
+        }
+        switch (c) {
+        case '"':
+            inString = true;
+            break;
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0) {
+                return i;
+            }
+            if (--depth == 0) {
+                return i + 1;
+            }
+            break;
+        case ',':
+            if (depth == 0) {
+                return i;
+            }
+            break;
+        default:
+            if (depth == 0 && isBlank(c)) {
+                return i;
+            }
+            break;
+        }
+    }
+    // A bare scalar may still be growing until the body ends.
+    return final && depth == 0 && !inString ? input.size() : kIncomplete;
+}
+}  // namespace
+
+void BulkInputReader::append(std::string_view data) {
+    // Drop handed-out bytes once they are at least half the buffer, so the
+    // copy stays proportional to what is consumed.
+    if (offset_ > 0 && offset_ * 2 >= buffer_.size()) {
+        buffer_.erase(0, offset_);
+        offset_ = 0;
+    }
+    buffer_.append(data);
+}
+
+void BulkInputReader::skipBlanks() {
+    while (offset_ < buffer_.size() && isBlank(buffer_[offset_])) {
+        ++offset_;
+    }
+}
+
+BulkInputReader::Status BulkInputReader::next(std::string_view& item) {
+    if (format_ == Format::Unknown) {
+        skipBlanks();
+        if (offset_ == buffer_.size()) {
+            return finished_ ? Status::End : Status::NeedMore;
+        }
+        if (buffer_[offset_] == '[') {
+            format_ = Format::Array;
+            ++offset_;
+        } else {
+            format_ = Format::Lines;
+        }
+    }
+    return format_ == Format::Array ? nextElement(item) : nextLine(item);
+}
+
+BulkInputReader::Status BulkInputReader::nextLine(std::string_view& item) {
+    for (;;) {
+        const auto input = rest();
+        if (input.empty()) {
+            return finished_ ? Status::End : Status::NeedMore;
+        }
+        const auto newline = input.find('\n');
+        if (newline == std::string_view::npos && !finished_) {
+            return Status::NeedMore;
+        }
+        const auto line = trim(input.substr(0, newline));
+        offset_ += newline == std::string_view::npos ? input.size() : newline + 1;
+        if (!line.empty()) {
+            item = line;
+            return Status::Item;
+        }
+    }
+}
+
+BulkInputReader::Status BulkInputReader::nextElement(std::string_view& item) {
+    skipBlanks();
+    if (closed_) {
+        if (offset_ < buffer_.size()) {
+            return Status::Malformed;
+        }
+        return finished_ ? Status::End : Status::NeedMore;
+    }
+    if (offset_ == buffer_.size()) {
+        return finished_ ? Status::Malformed : Status::NeedMore;
+    }
+    if (buffer_[offset_] == ']') {
+        ++offset_;
+        closed_ = true;
+        return nextElement(item);
+    }
+    if (afterItem_) {
+        if (buffer_[offset_] != ',') {
+            return Status::Malformed;
+        }
+        ++offset_;
+        afterItem_ = false;
+        return nextElement(item);
+    }
+    const auto input = rest();
+    const auto length = valueLength(input, finished_);
+    if (length == kIncomplete) {
+        return Status::NeedMore;
+    }
+    if (length == 0) {
+        return Status::Malformed;
+    }
+    item = input.substr(0, length);
+    offset_ += length;
+    afterItem_ = true;
+    return Status::Item;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Splits a bulk shorten body into items one at a time without parsing the
+// whole document: either NDJSON (one value per line) or a top-level JSON
+// array, detected from the first non-blank character. The body is fed in
+// chunks as it arrives; only the bytes not yet handed out as items are kept.
+// Items are views into that buffer, valid until the next append().
+class BulkInputReader {
+public:
+    // NeedMore: the next item is not complete yet; append() or finish() first.
+    enum class Status { Item, NeedMore, End, Malformed };
+
+    void append(std::string_view data);
+    // No more data will follow.
+    void finish() { finished_ = true; }
+
+    Status next(std::string_view& item);
+
+    bool isArray() const { return format_ == Format::Array; }
+    // Bytes received but not yet handed out as items.
+    size_t buffered() const { return buffer_.size() - offset_; }
+
+private:
+    enum class Format { Unknown, Lines, Array };
+
+    std::string buffer_;
+    size_t offset_{0};
+    Format format_{Format::Unknown};
+    bool finished_{false};
+    bool afterItem_{false};
+    bool closed_{false};
+
+    std::string_view rest() const { return std::string_view(buffer_).substr(offset_); }
+    void skipBlanks();
+    Status nextLine(std::string_view& item);
+    Status nextElement(std::string_view& item);
+};
@@ -0,0 +1,219 @@
+#include "ChangeFeed.h"
+#include "../metrics/Metrics.h"
+#include <trantor/utils/Logger.h>
+#include <charconv>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+namespace {
+// Payload: "1 <source> <sequence> <code> <code> ..."
+constexpr std::string_view kPayloadVersion = "1";
+// Room for the version, a 16-digit source id and a 20-digit sequence.
+constexpr size_t kHeaderReserve = 64;
+
+Counter& sentCounter(const char* result) {
+    return MetricsRegistry::instance().counter(
+        "urlshortener_change_feed_sent_total", "Change notifications sent by outcome", {{"result", result}});
+}
+
+Counter& receivedCounter(const char* result) {
+    return MetricsRegistry::instance().counter(
+        "urlshortener_change_feed_received_total", "Change notifications from other instances by outcome",
+        {{"result", result}});
+}
+
+std::string randomSourceId() {
+    std::random_device device;
+    const uint64_t id = (static_cast<uint64_t>(device()) << 32) | device();
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(id));
+    return buffer;
+}
+
+std::vector<std::string_view> splitFields(std::string_view payload) {
+    std::vector<std::string_view> fields;
+    size_t start = 0;
+    while (start < payload.size()) {
+        auto end = payload.find(' ', start);
+        if (end == std::string_view::npos) {
+            end = payload.size();
+        }
+        if (end > start) {
+            fields.push_back(payload.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return fields;
+}
+}  // namespace
+
+ChangeFeed::ChangeFeed(std::shared_ptr<DataStore> store, std::string listenUri, Options options, Handlers handlers)
+    : store_(std::move(store)),
+      listenUri_(std::move(listenUri)),
+      options_(std::move(options)),
+      handlers_(std::move(handlers)),
+      sourceId_(randomSourceId()),
+      published_(sentCounter("ok")),
+      publishFailed_(sentCounter("error")),
+      publishDropped_(MetricsRegistry::instance().counter(
+          "urlshortener_change_feed_dropped_codes_total", "Codes dropped while change notifications could not be sent")),
+      receivedApplied_(receivedCounter("applied")),
+      receivedDuplicate_(receivedCounter("duplicate")),
+      receivedGap_(receivedCounter("gap")),
+      receivedMalformed_(receivedCounter("malformed")),
+      codesApplied_(MetricsRegistry::instance().counter(
+          "urlshortener_change_feed_codes_applied_total", "Codes from other instances applied to local caches")) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (options_.channel.empty()) {
+        throw std::runtime_error("change feed channel is required");
+    }
+    if (options_.maxPayloadBytes <= kHeaderReserve || options_.maxPayloadBytes >= 8000) {
+        throw std::runtime_error("change feed payload limit must be between 64 and 8000 bytes");
+    }
+}
+
+ChangeFeed::~ChangeFeed() {
+    stop();
+}
+
+void ChangeFeed::start() {
+    std::lock_guard<std::mutex> lock(listenerMutex_);
+    if (listener_) {
+        return;
+    }
+    // The listener owns its connection and loop thread, and re-LISTENs after reconnecting.
+    listener_ = drogon::orm::DbListener::newPgListener(listenUri_);
+    if (!listener_) {
+        throw std::runtime_error("Postgres LISTEN is not available in this Drogon build");
+    }
+    listener_->listen(options_.channel, [this](std::string, std::string message) { onMessage(message); });
+    LOG_INFO << "Listening for link changes on '" << options_.channel << "' as source " << sourceId_;
+}
+
+void ChangeFeed::stop() {
+    std::lock_guard<std::mutex> lock(listenerMutex_);
+    if (!listener_) {
+        return;
+    }
+    listener_->unlisten(options_.channel);
+    listener_.reset();
+}
+
+void ChangeFeed::publish(const std::vector<std::string>& codes) {
+    std::unique_lock<std::mutex> lock(publishMutex_);
+    if (pending_.size() + codes.size() > options_.maxPendingCodes) {
+        // Skipping a sequence number tells every receiver to resync.
+        publishDropped_.inc(pending_.size() + codes.size());
+        pending_.clear();
+        ++nextSequence_;
+        return;
+    }
+    for (const auto& code : codes) {
+        if (code.empty() || code.size() + kHeaderReserve > options_.maxPayloadBytes ||
+            code.find(' ') != std::string::npos) {
+            continue;
+        }
+        pending_.push_back(code);
+    }
+    if (!sending_ && !pending_.empty()) {
+        sendNextLocked(lock);
+    }
+}
+
+void ChangeFeed::sendNextLocked(std::unique_lock<std::mutex>& lock) {
+    std::string payload;
+    payload.reserve(options_.maxPayloadBytes);
+    payload.append(kPayloadVersion);
+    payload += ' ';
+    payload += sourceId_;
+    payload += ' ';
+    payload += std::to_string(nextSequence_++);
+    size_t taken = 0;
+    while (taken < pending_.size() && payload.size() + 1 + pending_[taken].size() <= options_.maxPayloadBytes) {
+        payload += ' ';
+        payload += pending_[taken];
+        ++taken;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + static_cast<std::ptrdiff_t>(taken));
+    sending_ = true;
+    lock.unlock();
+
+    // A failed send is not retried: its sequence number never arrives, so
+    // receivers resync on the next one.
+    auto sent = [this] {
+        std::unique_lock<std::mutex> relock(publishMutex_);
+        sending_ = false;
+        if (!pending_.empty()) {
+            sendNextLocked(relock);
+        }
+    };
+    try {
+        store_->notifyAsync(
+            options_.channel, payload,
+            [this, sent] {
+                published_.inc();
+                sent();
+            },
+            [this, sent](const std::exception& e) {
+                publishFailed_.inc();
+                LOG_WARN << "Change notification failed: " << e.what();
+                sent();
+            });
+    } catch (const std::exception& e) {
+        publishFailed_.inc();
+        LOG_WARN << "Change notification failed: " << e.what();
+        sent();
+    }
+}
+
+void ChangeFeed::onMessage(std::string_view payload) {
+    const auto fields = splitFields(payload);
+    uint64_t sequence = 0;
+    if (fields.size() < 3 || fields[0] != kPayloadVersion ||
+        std::from_chars(fields[2].data(), fields[2].data() + fields[2].size(), sequence).ec != std::errc()) {
+        receivedMalformed_.inc();
+        return;
+    }
+    const auto source = fields[1];
+    if (source == sourceId_) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    auto it = sources_.find(std::string(source));
+    bool gap = false;
+    if (it == sources_.end()) {
+        for (auto idle = sources_.begin(); idle != sources_.end();) {
+            idle = now - idle->second.lastSeen > options_.sourceIdleTimeout ? sources_.erase(idle) : std::next(idle);
+        }
+        it = sources_.emplace(std::string(source), SourceState{}).first;
+    } else if (sequence <= it->second.lastSequence) {
+        it->second.lastSeen = now;
+        receivedDuplicate_.inc();
+        return;
+    } else {
+        gap = sequence != it->second.lastSequence + 1;
+    }
+    const auto previous = it->second.lastSequence;
+    it->second.lastSequence = sequence;
+    it->second.lastSeen = now;
+
+    if (fields.size() > 3 && handlers_.onCodes) {
+        std::vector<std::string> codes(fields.begin() + 3, fields.end());
+        handlers_.onCodes(codes);
+        codesApplied_.inc(codes.size());
+    }
+    if (!gap) {
+        receivedApplied_.inc();
+        return;
+    }
+    receivedGap_.inc();
+    LOG_WARN << "Change feed from " << source << " jumped from " << previous << " to " << sequence
+             << "; resyncing local caches";
+    if (handlers_.onResync) {
+        handlers_.onResync();
+    }
+}
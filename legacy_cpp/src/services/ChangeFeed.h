@@ -0,0 +1,102 @@
+#pragma once
+#include "DataStore.h"
+#include <drogon/orm/DbListener.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class Counter;
+
+// Tells every instance about links the others create, so in-process layers
+// that cache absence (the code filter and the negative cache) do not turn
+// away a new link until their next rebuild or expiry. Once an insert batch
+// commits, its codes are sent with pg_notify; every instance LISTENs on the
+// primary and hands codes from other instances to onCodes.
+//
+// Each instance publishes under a random source id with a sequence number
+// that goes up by one per notification, and keeps at most one notification
+// in flight, so codes committed meanwhile go out together in the next one.
+// Notifications sent while a listener is reconnecting are lost; the
+// receiver sees the skipped sequence number on that source's next
+// notification and calls onResync so the caches are rebuilt from Postgres.
+// The first notification seen from a source is taken as its starting point.
+//
+// Only codes travel: mappings are never rewritten after insert, and each
+// cached entry already carries its own expiry.
+class ChangeFeed {
+public:
+    struct Options {
+        std::string channel{"url_mapping_changes"};
+        // Kept under Postgres' 8000-byte NOTIFY limit.
+        size_t maxPayloadBytes{7000};
+        // Codes queued while Postgres is unreachable; past this they are
+        // dropped and a sequence number is skipped so receivers resync.
+        size_t maxPendingCodes{65536};
+        // Sources silent for this long are forgotten.
+        std::chrono::seconds sourceIdleTimeout{std::chrono::seconds{3600}};
+    };
+
+    struct Handlers {
+        // Codes another instance inserted. Runs on the listener's loop thread.
+        std::function<void(const std::vector<std::string>& codes)> onCodes;
+        // Notifications were lost; cached absence can no longer be trusted.
+        std::function<void()> onResync;
+    };
+
+    // listenUri must point at the primary: standbys do not deliver NOTIFY.
+    ChangeFeed(std::shared_ptr<DataStore> store, std::string listenUri, Options options, Handlers handlers);
+    ~ChangeFeed();
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    void start();
+    void stop();
+
+    // Queues codes this instance has just committed.
+    void publish(const std::vector<std::string>& codes);
+
+    const std::string& sourceId() const { return sourceId_; }
+
+private:
+    struct SourceState {
+        uint64_t lastSequence{0};
+        std::chrono::steady_clock::time_point lastSeen;
+    };
+
+    std::shared_ptr<DataStore> store_;
+    std::string listenUri_;
+    Options options_;
+    Handlers handlers_;
+    std::string sourceId_;
+
+    std::mutex listenerMutex_;
+    drogon::orm::DbListenerPtr listener_;
+
+    std::mutex publishMutex_;
+    std::vector<std::string> pending_;
+    bool sending_{false};
+    uint64_t nextSequence_{1};
+
+    // Only touched from the listener's loop thread.
+    std::unordered_map<std::string, SourceState> sources_;
+
+    Counter& published_;
+    Counter& publishFailed_;
+    Counter& publishDropped_;
+    Counter& receivedApplied_;
+    Counter& receivedDuplicate_;
+    Counter& receivedGap_;
+    Counter& receivedMalformed_;
+    Counter& codesApplied_;
+
+    // Takes the next payload off pending_ and sends it; publishMutex_ held.
+    void sendNextLocked(std::unique_lock<std::mutex>& lock);
+    void onMessage(std::string_view payload);
+};
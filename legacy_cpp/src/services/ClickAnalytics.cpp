@@ -0,0 +1,278 @@
+#include "ClickAnalytics.h"
+#include "../metrics/Metrics.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <time.h>
+
+namespace {
+std::atomic<uint64_t> nextInstanceId{1};
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Codes with a NUL byte would not survive unpacking; they take the long path.
+std::optional<uint64_t> packCode(std::string_view code) {
+    if (code.empty() || code.size() > sizeof(uint64_t) || code.find('\0') != std::string_view::npos) {
+        return std::nullopt;
+    }
+    uint64_t key = 0;
+    std::memcpy(&key, code.data(), code.size());
+    return key;
+}
+
+std::string unpackCode(uint64_t key) {
+    char bytes[sizeof(uint64_t)];
+    std::memcpy(bytes, &key, sizeof(bytes));
+    return std::string(bytes, strnlen(bytes, sizeof(bytes)));
+}
+
+// The coarse clock is read from the vDSO without a syscall; its few
+// milliseconds of resolution are plenty for a last-click time.
+int64_t coarseNowMicros() {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t roundUpToPowerOfTwo(size_t n) {
+    size_t capacity = 64;
+    while (capacity < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+Counter& flushCounter(const char* result) {
+    return MetricsRegistry::instance().counter(
+        "urlshortener_click_flushes_total", "Click count flushes to Postgres by outcome", {{"result", result}});
+}
+}  // namespace
+
+bool ClickAnalytics::Table::add(std::string_view code, int64_t atMicros) {
+    const auto key = packCode(code);
+    if (!key) {
+        longCodes[std::string(code)].add(1, atMicros);
+        return true;
+    }
+    // New codes stop at seven eighths full, so every probe ends at a free slot.
+    const size_t mask = slots.size() - 1;
+    for (size_t i = mix64(*key) & mask;; i = (i + 1) & mask) {
+        auto& slot = slots[i];
+        if (slot.key == *key) {
+            ++slot.clicks;
+            slot.lastClickMicros = std::max(slot.lastClickMicros, atMicros);
+            return true;
+        }
+        if (slot.key == 0) {
+            if (used * 8 >= slots.size() * 7) {
+                return false;
+            }
+            slot.key = *key;
+            slot.clicks = 1;
+            slot.lastClickMicros = atMicros;
+            ++used;
+            return true;
+        }
+    }
+}
+
+void ClickAnalytics::Table::clear() {
+    if (used > 0) {
+        std::fill(slots.begin(), slots.end(), Slot{});
+        used = 0;
+    }
+    longCodes.clear();
+}
+
+ClickAnalytics::ClickAnalytics(std::shared_ptr<DataStore> store, Options options)
+    : store_(std::move(store)),
+      options_(options),
+      instanceId_(nextInstanceId.fetch_add(1, std::memory_order_relaxed)),
+      flushes_(flushCounter("ok")),
+      flushFailures_(flushCounter("error")),
+      rowsWritten_(MetricsRegistry::instance().counter(
+          "urlshortener_click_rows_written_total", "Per-link click totals added to url_click_stats")),
+      dropped_(MetricsRegistry::instance().counter(
+          "urlshortener_clicks_dropped_total", "Clicks not counted because a buffer was full")) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (options_.flushInterval.count() <= 0) {
+        throw std::runtime_error("click flush interval must be positive");
+    }
+    options_.tableSlots = roundUpToPowerOfTwo(options_.tableSlots);
+    options_.maxBatchRows = std::max<size_t>(options_.maxBatchRows, 1);
+}
+
+ClickAnalytics::~ClickAnalytics() {
+    stop();
+}
+
+void ClickAnalytics::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (flusher_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    flusher_ = std::thread([this] { run(); });
+}
+
+void ClickAnalytics::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+        flush();
+    }
+}
+
+ClickAnalytics::ThreadTable& ClickAnalytics::localTable() {
+    thread_local uint64_t owner = 0;
+    thread_local ThreadTable* table = nullptr;
+    if (owner != instanceId_) {
+        auto created = std::make_unique<ThreadTable>();
+        created->active = std::make_unique<Table>(options_.tableSlots);
+        created->spare = std::make_unique<Table>(options_.tableSlots);
+        table = created.get();
+        std::lock_guard<std::mutex> lock(tablesMutex_);
+        tables_.push_back(std::move(created));
+        owner = instanceId_;
+    }
+    return *table;
+}
+
+void ClickAnalytics::record(std::string_view code) {
+    if (code.empty()) {
+        return;
+    }
+    auto& table = localTable();
+    const auto now = coarseNowMicros();
+    bool counted;
+    bool filling;
+    {
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto& active = *table.active;
+        counted = active.add(code, now);
+        filling = active.used * 4 >= active.slots.size() * 3;
+    }
+    if (!counted) {
+        dropped_.inc();
+    }
+    if (filling && !earlyFlushRequested_.exchange(true, std::memory_order_relaxed)) {
+        requestFlush();
+    }
+}
+
+void ClickAnalytics::requestFlush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushRequested_ = true;
+    }
+    wakeup_.notify_all();
+}
+
+void ClickAnalytics::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wakeup_.wait_for(lock, options_.flushInterval, [this] { return stopping_ || flushRequested_; });
+        flushRequested_ = false;
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+void ClickAnalytics::collect() {
+    std::vector<ThreadTable*> tables;
+    {
+        std::lock_guard<std::mutex> lock(tablesMutex_);
+        tables.reserve(tables_.size());
+        for (const auto& table : tables_) {
+            tables.push_back(table.get());
+        }
+    }
+    uint64_t dropped = 0;
+    auto merge = [&](std::string code, uint64_t clicks, int64_t atMicros) {
+        auto it = pending_.find(code);
+        if (it == pending_.end()) {
+            if (pending_.size() >= options_.maxPendingCodes) {
+                dropped += clicks;
+                return;
+            }
+            it = pending_.emplace(std::move(code), Totals{}).first;
+        }
+        it->second.add(clicks, atMicros);
+    };
+    for (auto* table : tables) {
+        {
+            std::lock_guard<std::mutex> lock(table->mutex);
+            std::swap(table->active, table->spare);
+        }
+        auto& filled = *table->spare;
+        for (const auto& slot : filled.slots) {
+            if (slot.key != 0) {
+                merge(unpackCode(slot.key), slot.clicks, slot.lastClickMicros);
+            }
+        }
+        for (auto& [code, totals] : filled.longCodes) {
+            merge(code, totals.clicks, totals.lastClickMicros);
+        }
+        filled.clear();
+    }
+    earlyFlushRequested_.store(false, std::memory_order_relaxed);
+    if (dropped > 0) {
+        dropped_.inc(dropped);
+    }
+}
+
+void ClickAnalytics::flush() {
+    collect();
+    if (pending_.empty()) {
+        return;
+    }
+    std::vector<DataStore::ClickDelta> deltas;
+    deltas.reserve(pending_.size());
+    for (auto& [code, totals] : pending_) {
+        deltas.push_back(DataStore::ClickDelta{
+            code, totals.clicks,
+            DataStore::TimePoint(std::chrono::duration_cast<DataStore::SystemClock::duration>(
+                std::chrono::microseconds(totals.lastClickMicros)))});
+    }
+    pending_.clear();
+
+    for (size_t first = 0; first < deltas.size(); first += options_.maxBatchRows) {
+        const auto last = std::min(deltas.size(), first + options_.maxBatchRows);
+        const std::vector<DataStore::ClickDelta> batch(deltas.begin() + first, deltas.begin() + last);
+        try {
+            store_->addClickStats(batch);
+            flushes_.inc();
+            rowsWritten_.inc(batch.size());
+        } catch (const std::exception& e) {
+            flushFailures_.inc();
+            LOG_WARN << "Click count flush failed, keeping " << deltas.size() - first << " codes for the next one: "
+                     << e.what();
+            // The upsert is one statement, so a failed batch added nothing.
+            for (size_t i = first; i < deltas.size(); ++i) {
+                const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    deltas[i].lastClickAt.time_since_epoch()).count();
+                pending_[deltas[i].code].add(deltas[i].clicks, micros);
+            }
+            return;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "DataStore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Counter;
+
+// Per-link click counts and last-click times without a write per redirect.
+// Each IO thread counts into its own open-addressing table keyed by the
+// packed code, behind a mutex only the flusher ever contends for, so a
+// click costs an uncontended lock, a hash and a probe. Every flushInterval
+// the flusher swaps each thread's table for an empty one, merges them and
+// adds the totals to url_click_stats with one upsert per maxBatchRows codes.
+// A failed flush keeps its totals for the next attempt, up to
+// maxPendingCodes; the rest are dropped and counted.
+//
+// Counts read back from Postgres trail the redirects by up to one flush.
+class ClickAnalytics {
+public:
+    struct Options {
+        std::chrono::milliseconds flushInterval{std::chrono::milliseconds{5000}};
+        // Per IO thread; rounded up to a power of two. A table three
+        // quarters full asks for an early flush.
+        size_t tableSlots{16384};
+        size_t maxBatchRows{1000};
+        size_t maxPendingCodes{1000000};
+    };
+
+    ClickAnalytics(std::shared_ptr<DataStore> store, Options options);
+    ~ClickAnalytics();
+
+    ClickAnalytics(const ClickAnalytics&) = delete;
+    ClickAnalytics& operator=(const ClickAnalytics&) = delete;
+
+    void start();
+    // Flushes what has been counted so far and joins the flusher.
+    void stop();
+
+    // Redirect path. Never blocks on the database.
+    void record(std::string_view code);
+
+private:
+    struct Totals {
+        uint64_t clicks{0};
+        int64_t lastClickMicros{0};
+
+        void add(uint64_t count, int64_t atMicros) {
+            clicks += count;
+            lastClickMicros = std::max(lastClickMicros, atMicros);
+        }
+    };
+
+    // Codes of up to eight bytes are packed into key; 0 marks a free slot.
+    struct Slot {
+        uint64_t key{0};
+        uint32_t clicks{0};
+        int64_t lastClickMicros{0};
+    };
+
+    struct Table {
+        std::vector<Slot> slots;
+        size_t used{0};
+        // Longer codes are rare; they take the allocating path.
+        std::unordered_map<std::string, Totals> longCodes;
+
+        explicit Table(size_t capacity) : slots(capacity) {}
+        // False when the table is too full to take a new code.
+        bool add(std::string_view code, int64_t atMicros);
+        void clear();
+    };
+
+    struct alignas(64) ThreadTable {
+        std::mutex mutex;
+        std::unique_ptr<Table> active;
+        // Swapped in by the flusher; only the flusher touches it.
+        std::unique_ptr<Table> spare;
+    };
+
+    std::shared_ptr<DataStore> store_;
+    Options options_;
+    // Tells this instance's thread-local tables from a destroyed one's.
+    const uint64_t instanceId_;
+
+    std::mutex tablesMutex_;
+    std::vector<std::unique_ptr<ThreadTable>> tables_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_{false};
+    bool flushRequested_{false};
+    // Set by the first IO thread to find its table filling up, so the rest
+    // do not all take mutex_ to ask again.
+    std::atomic<bool> earlyFlushRequested_{false};
+    std::thread flusher_;
+
+    // Only touched from the flusher thread (or stop() once it has joined).
+    std::unordered_map<std::string, Totals> pending_;
+
+    Counter& flushes_;
+    Counter& flushFailures_;
+    Counter& rowsWritten_;
+    Counter& dropped_;
+
+    ThreadTable& localTable();
+    void requestFlush();
+    void run();
+    void flush();
+    void collect();
+};
@@ -1,83 +1,250 @@
 #include "DataStore.h"
+#include "SqlStatements.h"
+#include "../metrics/Metrics.h"
 #include <drogon/orm/Exception.h>
 #include <trantor/utils/Date.h>
+#include <trantor/utils/Logger.h>
+#include <array>
+#include <limits>
 #include <stdexcept>
 
 using namespace std::chrono;
 
 namespace {
 constexpr size_t kDefaultPoolSize = 4;
+
+std::optional<trantor::Date> toDbDate(const std::optional<DataStore::TimePoint>& when) {
+    if (!when) {
+        return std::nullopt;
+    }
+    return trantor::Date(duration_cast<microseconds>(when->time_since_epoch()).count());
 }
 
-DataStore::DataStore(const std::string& uri, size_t poolSize) {
-    if (uri.empty()) {
-        throw std::runtime_error("Database URI is required");
+// Howard Hinnant's days_from_civil.
+int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const auto yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+bool readDigits(std::string_view text, size_t& pos, size_t count, int64_t& out) {
+    if (pos + count > text.size()) {
+        return false;
     }
-    const auto pool = poolSize == 0 ? kDefaultPoolSize : poolSize;
-    client_ = drogon::orm::DbClient::newPgClient(uri, pool);
-    if (!client_) {
-        throw std::runtime_error("Failed to create Drogon DbClient");
+    out = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char c = text[pos + i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        out = out * 10 + (c - '0');
+    }
+    pos += count;
+    return true;
+}
+
+bool expect(std::string_view text, size_t& pos, char c) {
+    if (pos < text.size() && text[pos] == c) {
+        ++pos;
+        return true;
+    }
+    return false;
+}
+
+std::optional<DataStore::TimePoint> timestampColumn(const drogon::orm::Field& field) {
+    if (field.isNull()) {
+        return std::nullopt;
+    }
+    auto parsed = DataStore::parseTimestamp(field.as<std::string_view>());
+    if (!parsed) {
+        throw std::runtime_error("unexpected timestamp format from Postgres");
+    }
+    return parsed;
+}
+
+std::string buildInsertMappingsSql(size_t rows) {
+    std::string sql = "INSERT INTO url_mapping(code,url,expires_at,user_id) VALUES ";
+    sql.reserve(sql.size() + rows * 24 + 48);
+    for (size_t i = 0; i < rows; ++i) {
+        const auto base = i * 4;
+        if (i > 0) {
+            sql += ',';
+        }
+        sql += "($" + std::to_string(base + 1) + ",$" + std::to_string(base + 2) + ",$" +
+               std::to_string(base + 3) + ",$" + std::to_string(base + 4) + ")";
+    }
+    sql += " ON CONFLICT DO NOTHING RETURNING code";
+    return sql;
+}
+
+struct StatementMetrics {
+    Histogram& latency;
+    Counter& errors;
+};
+
+// Latency is measured from submission to result, so time spent queued for a
+// pooled connection is included; its _count is the execution count.
+StatementMetrics statementMetrics(const char* name) {
+    auto& registry = MetricsRegistry::instance();
+    return StatementMetrics{
+        registry.histogram("urlshortener_db_query_duration_seconds",
+                           "Postgres query latency including connection pool wait", {{"query", name}}),
+        registry.counter("urlshortener_db_query_errors_total", "Postgres queries that failed", {{"query", name}}),
+    };
+}
+
+StatementMetrics statementMetrics(const SqlStatement& statement) {
+    return statementMetrics(statement.name);
+}
+
+// Where a replica-eligible read went. Retries on the primary after a replica
+// miss or error are counted on top of the replica read.
+enum class ReadRoute { Replica, PrimaryRecentWrite, PrimaryNoReplica, PrimaryAfterMiss, PrimaryAfterError };
+
+Counter& readRouteCounter(ReadRoute route) {
+    static constexpr const char* kNames[] = {
+        "replica", "primary_recent_write", "primary_no_replica", "primary_after_miss", "primary_after_error"};
+    static const auto counters = [] {
+        std::array<Counter*, std::size(kNames)> out{};
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = &MetricsRegistry::instance().counter(
+                "urlshortener_db_reads_total", "Replica-eligible reads by where they were sent",
+                {{"route", kNames[i]}});
+        }
+        return out;
+    }();
+    return *counters[static_cast<size_t>(route)];
+}
+
+// Holds one unit of a replica's in-flight count for the read balancer.
+class InflightScope {
+public:
+    explicit InflightScope(std::atomic<int64_t>& counter) : counter_(counter) {
+        counter_.fetch_add(1, std::memory_order_relaxed);
     }
+    ~InflightScope() { counter_.fetch_sub(1, std::memory_order_relaxed); }
+    InflightScope(const InflightScope&) = delete;
+    InflightScope& operator=(const InflightScope&) = delete;
+
+private:
+    std::atomic<int64_t>& counter_;
+};
+
+int64_t steadyTicks() {
+    return steady_clock::now().time_since_epoch().count();
 }
 
-bool DataStore::ping() const {
+// Runs a registered statement without blocking. onResult runs on a DB client
+// loop thread and must not throw.
+template <typename OnResult, typename... Args>
+void execAsync(const drogon::orm::DbClientPtr& client,
+               const SqlStatement& statement,
+               const StatementMetrics& metrics,
+               OnResult&& onResult,
+               DataStore::ErrorCallback&& errorCallback,
+               Args&&... args) {
+    const auto started = steady_clock::now();
+    client->execSqlAsync(
+        statement.sql,
+        [onResult = std::forward<OnResult>(onResult), &latency = metrics.latency, started](
+            const drogon::orm::Result& res) mutable {
+            latency.observe(steady_clock::now() - started);
+            onResult(res);
+        },
+        [errorCallback = std::move(errorCallback), &metrics, started](const drogon::orm::DrogonDbException& e) {
+            metrics.latency.observe(steady_clock::now() - started);
+            metrics.errors.inc();
+            errorCallback(e.base());
+        },
+        std::forward<Args>(args)...);
+}
+
+// Coroutine counterpart of execAsync. Statement and metrics have static
+// storage, so holding references to them across the suspension is safe.
+template <typename... Args>
+drogon::Task<drogon::orm::Result> execCoro(drogon::orm::DbClientPtr client,
+                                           const SqlStatement& statement,
+                                           const StatementMetrics& metrics,
+                                           Args... args) {
+    ScopedTimer timer(metrics.latency);
     try {
-        auto r = client_->execSqlSync("SELECT 1");
-        return !r.empty();
+        co_return co_await client->execSqlCoro(statement.sql, std::move(args)...);
     } catch (...) {
-        return false;
+        metrics.errors.inc();
+        throw;
     }
 }
 
-bool DataStore::insertMapping(const std::string& code,
-                              const std::string& url,
-                              const std::optional<TimePoint>& expiresAt,
-                              const std::optional<long>& userId) {
-    std::optional<trantor::Date> expiresArg;
-    if (expiresAt) {
-        auto micros = duration_cast<microseconds>(expiresAt->time_since_epoch()).count();
-        expiresArg = trantor::Date(micros);
+template <typename... Args>
+drogon::orm::Result execSync(const drogon::orm::DbClientPtr& client,
+                             const SqlStatement& statement,
+                             const StatementMetrics& metrics,
+                             Args&&... args) {
+    ScopedTimer timer(metrics.latency);
+    try {
+        return client->execSqlSync(statement.sql, std::forward<Args>(args)...);
+    } catch (...) {
+        metrics.errors.inc();
+        throw;
     }
-    auto result = client_->execSqlSync(
-        "INSERT INTO url_mapping(code,url,expires_at,user_id) VALUES($1,$2,$3,$4) ON CONFLICT DO NOTHING",
-        code,
-        url,
-        expiresArg,
-        userId);
-    return result.affectedRows() > 0;
 }
 
-std::optional<std::string> DataStore::resolveUrl(const std::string& code) const {
-    auto res = client_->execSqlSync(
-        "SELECT url FROM url_mapping WHERE code=$1 AND (expires_at IS NULL OR expires_at > NOW())",
-        code);
+// The multi-row insert goes through the SQL binder, which has no awaitable
+// form, so the coroutine API suspends on the callback version instead. The
+// binder hands back the exception it raised, which is rethrown as is.
+class InsertMappingsAwaiter : public drogon::CallbackAwaiter<std::vector<std::string>> {
+public:
+    using Issue = std::function<void(DataStore::InsertedCallback&&,
+                                     std::function<void(const std::exception_ptr&)>&&)>;
+
+    explicit InsertMappingsAwaiter(Issue issue) : issue_(std::move(issue)) {}
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        issue_(
+            [this, handle](std::vector<std::string> inserted) {
+                setValue(std::move(inserted));
+                handle.resume();
+            },
+            [this, handle](const std::exception_ptr& e) {
+                setException(e);
+                handle.resume();
+            });
+    }
+
+private:
+    Issue issue_;
+};
+
+std::optional<DataStore::ResolvedUrl> decodeResolved(const drogon::orm::Result& res) {
     if (res.empty()) {
         return std::nullopt;
     }
-    return res[0]["url"].as<std::string>();
+    DataStore::ResolvedUrl resolved;
+    resolved.url = res[0]["url"].as<std::string>();
+    resolved.expiresAt = timestampColumn(res[0]["expires_at"]);
+    return resolved;
 }
 
-std::optional<DataStore::UrlInfo> DataStore::getUrlInfo(const std::string& code) const {
-    auto res = client_->execSqlSync(
-        "SELECT url, (expires_at IS NOT NULL) as ttl_active FROM url_mapping WHERE code=$1 AND (expires_at IS NULL OR expires_at > NOW())",
-        code);
+std::optional<DataStore::UrlInfo> decodeUrlInfo(const drogon::orm::Result& res) {
     if (res.empty()) {
         return std::nullopt;
     }
-    UrlInfo info;
+    DataStore::UrlInfo info;
     info.url = res[0]["url"].as<std::string>();
     info.ttlActive = res[0]["ttl_active"].as<bool>();
+    info.clicks = static_cast<uint64_t>(res[0]["clicks"].as<long long>());
+    info.lastClickAt = timestampColumn(res[0]["last_click_at"]);
     return info;
 }
 
-std::optional<DataStore::UserRecord> DataStore::findUserByEmail(const std::string& email) const {
-    auto res = client_->execSqlSync(
-        "SELECT id,name,email,password_hash FROM app_user WHERE email=$1",
-        email);
+std::optional<DataStore::UserRecord> decodeUser(const drogon::orm::Result& res) {
     if (res.empty()) {
         return std::nullopt;
     }
-    UserRecord user;
+    DataStore::UserRecord user;
     user.id = res[0]["id"].as<long>();
     user.name = res[0]["name"].as<std::string>();
     user.email = res[0]["email"].as<std::string>();
@@ -85,45 +252,640 @@ std::optional<DataStore::UserRecord> DataStore::findUserByEmail(const std::strin
     return user;
 }
 
-long DataStore::createUser(const std::string& name,
-                           const std::string& email,
-                           const std::string& passwordHash) {
-    auto res = client_->execSqlSync(
-        "INSERT INTO app_user(name,email,password_hash) VALUES($1,$2,$3) RETURNING id",
-        name,
-        email,
-        passwordHash);
-    return res[0]["id"].as<long>();
-}
-
-std::vector<DataStore::UrlListItem> DataStore::listUrlsForUser(long userId,
-                                                               size_t limit) const {
-    auto res = client_->execSqlSync(
-        R"SQL(
-        SELECT code,
-               url,
-               EXTRACT(EPOCH FROM created_at)::bigint AS created_epoch,
-               EXTRACT(EPOCH FROM expires_at)::bigint AS expires_epoch
-          FROM url_mapping
-         WHERE user_id=$1
-         ORDER BY created_at DESC
-         LIMIT $2
-        )SQL",
-        userId,
-        static_cast<long>(limit));
-    std::vector<UrlListItem> items;
+std::vector<DataStore::StoredMapping> decodeStoredMappings(const drogon::orm::Result& res) {
+    std::vector<DataStore::StoredMapping> rows;
+    rows.reserve(res.size());
+    for (const auto& row : res) {
+        DataStore::StoredMapping mapping;
+        mapping.code = row["code"].as<std::string>();
+        mapping.url = row["url"].as<std::string>();
+        mapping.expiresAt = timestampColumn(row["expires_at"]);
+        rows.push_back(std::move(mapping));
+    }
+    return rows;
+}
+
+std::vector<DataStore::UrlListItem> decodeListItems(const drogon::orm::Result& res) {
+    std::vector<DataStore::UrlListItem> items;
     items.reserve(res.size());
     for (const auto& row : res) {
-        UrlListItem item;
+        DataStore::UrlListItem item;
         item.code = row["code"].as<std::string>();
         item.url = row["url"].as<std::string>();
-        auto createdEpoch = row["created_epoch"].as<long long>();
-        item.createdAt = TimePoint(seconds(createdEpoch));
-        if (!row["expires_epoch"].isNull()) {
-            auto expiresEpoch = row["expires_epoch"].as<long long>();
-            item.expiresAt = TimePoint(seconds(expiresEpoch));
-        }
+        item.createdAt = *timestampColumn(row["created_at"]);
+        item.expiresAt = timestampColumn(row["expires_at"]);
         items.push_back(std::move(item));
     }
     return items;
 }
+
+// The per-user list also carries click counts.
+std::vector<DataStore::UrlListItem> decodeUserListItems(const drogon::orm::Result& res) {
+    auto items = decodeListItems(res);
+    for (size_t i = 0; i < items.size(); ++i) {
+        items[i].clicks = static_cast<uint64_t>(res[i]["clicks"].as<long long>());
+        items[i].lastClickAt = timestampColumn(res[i]["last_click_at"]);
+    }
+    return items;
+}
+
+// Postgres array literal with every element quoted.
+std::string textArrayLiteral(const std::vector<std::string>& values) {
+    std::string array = "{";
+    for (const auto& value : values) {
+        if (array.size() > 1) {
+            array += ',';
+        }
+        array += '"';
+        for (const char c : value) {
+            if (c == '"' || c == '\\') {
+                array += '\\';
+            }
+            array += c;
+        }
+        array += '"';
+    }
+    array += '}';
+    return array;
+}
+
+std::vector<std::string> decodeCodes(const drogon::orm::Result& res) {
+    std::vector<std::string> codes;
+    codes.reserve(res.size());
+    for (const auto& row : res) {
+        codes.push_back(row["code"].as<std::string>());
+    }
+    return codes;
+}
+
+void resolveOn(const drogon::orm::DbClientPtr& client,
+               const std::string& code,
+               DataStore::ResolveCallback&& callback,
+               DataStore::ErrorCallback&& errorCallback) {
+    static const auto metrics = statementMetrics(sql::kResolveUrl);
+    execAsync(client, sql::kResolveUrl, metrics,
+              [callback = std::move(callback), errorCallback](const drogon::orm::Result& res) {
+                  std::optional<DataStore::ResolvedUrl> resolved;
+                  try {
+                      resolved = decodeResolved(res);
+                  } catch (const std::exception& e) {
+                      errorCallback(e);
+                      return;
+                  }
+                  callback(std::move(resolved));
+              },
+              DataStore::ErrorCallback(errorCallback),
+              code);
+}
+
+uint64_t decodeLeasedBlock(const drogon::orm::Result& res) {
+    if (res.empty()) {
+        throw std::runtime_error("short_code_allocator is not initialised");
+    }
+    return res[0]["first_id"].as<int64_t>();
+}
+}
+
+DataStore::DataStore(const std::string& uri, size_t poolSize)
+    : DataStore(uri, poolSize, ReplicaOptions{}) {}
+
+DataStore::DataStore(const std::string& uri, size_t poolSize, ReplicaOptions replicas)
+    : replicaOptions_(std::move(replicas)) {
+    if (uri.empty()) {
+        throw std::runtime_error("Database URI is required");
+    }
+    poolSize_ = poolSize == 0 ? kDefaultPoolSize : poolSize;
+    client_ = drogon::orm::DbClient::newPgClient(uri, poolSize_);
+    if (!client_) {
+        throw std::runtime_error("Failed to create Drogon DbClient");
+    }
+    MetricsRegistry::instance().gauge(
+        "urlshortener_db_pool_available",
+        "1 when the Postgres pool has an idle connection",
+        {},
+        [client = client_] { return client->hasAvailableConnections() ? 1.0 : 0.0; });
+    // Export every statement's series from startup, not from its first use.
+    for (const auto* statement : sql::kAll) {
+        statementMetrics(*statement);
+    }
+    statementMetrics(sql::kInsertMappingsBatchName);
+
+    if (replicaOptions_.uris.empty()) {
+        return;
+    }
+    const auto replicaPoolSize = replicaOptions_.poolSize == 0 ? poolSize_ : replicaOptions_.poolSize;
+    for (size_t i = 0; i < replicaOptions_.uris.size(); ++i) {
+        if (replicaOptions_.uris[i].empty()) {
+            throw std::runtime_error("Replica database URI is empty");
+        }
+        auto replica = std::make_unique<Replica>();
+        // URIs carry credentials, so endpoints are named by position.
+        replica->name = "replica-" + std::to_string(i);
+        replica->client = drogon::orm::DbClient::newPgClient(replicaOptions_.uris[i], replicaPoolSize);
+        if (!replica->client) {
+            throw std::runtime_error("Failed to create Drogon DbClient for " + replica->name);
+        }
+        replicas_.push_back(std::move(replica));
+    }
+    recentWrites_ = std::make_unique<std::array<std::atomic<int64_t>, kRecentWriteSlots>>();
+    for (auto& slot : *recentWrites_) {
+        slot.store(0, std::memory_order_relaxed);
+    }
+
+    auto& registry = MetricsRegistry::instance();
+    for (const auto& replica : replicas_) {
+        const auto* r = replica.get();
+        const MetricLabels labels{{"endpoint", r->name}};
+        registry.gauge("urlshortener_db_replica_usable", "1 while reads may be sent to the replica", labels,
+                       [r] { return r->usable.load(std::memory_order_relaxed) ? 1.0 : 0.0; });
+        registry.gauge("urlshortener_db_replica_lag_seconds",
+                       "Replay lag from the last replica probe; -1 when unknown", labels, [r] {
+                           const auto micros = r->lagMicros.load(std::memory_order_relaxed);
+                           return micros < 0 ? -1.0 : static_cast<double>(micros) / 1e6;
+                       });
+        registry.gauge("urlshortener_db_replica_inflight", "Reads outstanding on the replica", labels,
+                       [r] { return static_cast<double>(r->inflight.load(std::memory_order_relaxed)); });
+    }
+    for (auto route : {ReadRoute::Replica, ReadRoute::PrimaryRecentWrite, ReadRoute::PrimaryNoReplica,
+                       ReadRoute::PrimaryAfterMiss, ReadRoute::PrimaryAfterError}) {
+        readRouteCounter(route);
+    }
+}
+
+DataStore::~DataStore() = default;
+
+uint64_t DataStore::codeKey(std::string_view code) {
+    return std::hash<std::string_view>{}(code);
+}
+
+uint64_t DataStore::userKey(long userId) {
+    // std::hash<long> is the identity; spread ids so they do not line up with code hashes.
+    return (static_cast<uint64_t>(userId) + 1) * 0x9E3779B97F4A7C15ull;
+}
+
+void DataStore::noteWrite(uint64_t key) {
+    if (recentWrites_) {
+        (*recentWrites_)[key % kRecentWriteSlots].store(steadyTicks(), std::memory_order_relaxed);
+    }
+}
+
+DataStore::Replica* DataStore::readReplica(uint64_t key) const {
+    if (replicas_.empty()) {
+        return nullptr;
+    }
+    const auto now = steadyTicks();
+    const auto written = (*recentWrites_)[key % kRecentWriteSlots].load(std::memory_order_relaxed);
+    const auto window = duration_cast<steady_clock::duration>(replicaOptions_.readYourWritesWindow).count();
+    if (written != 0 && now - written < window) {
+        readRouteCounter(ReadRoute::PrimaryRecentWrite).inc();
+        return nullptr;
+    }
+    // Least outstanding reads, starting at a rotating offset so ties spread evenly.
+    const auto start = replicaCursor_.fetch_add(1, std::memory_order_relaxed);
+    Replica* best = nullptr;
+    int64_t bestLoad = std::numeric_limits<int64_t>::max();
+    for (size_t i = 0; i < replicas_.size(); ++i) {
+        auto* replica = replicas_[(start + i) % replicas_.size()].get();
+        if (!replica->usable.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        const auto load = replica->inflight.load(std::memory_order_relaxed);
+        if (load < bestLoad) {
+            best = replica;
+            bestLoad = load;
+            if (load == 0) {
+                break;
+            }
+        }
+    }
+    readRouteCounter(best ? ReadRoute::Replica : ReadRoute::PrimaryNoReplica).inc();
+    return best;
+}
+
+void DataStore::probeReplicaAsync(size_t index, LagCallback&& callback, ErrorCallback&& errorCallback) const {
+    static const auto metrics = statementMetrics(sql::kReplicaLag);
+    auto* replica = replicas_.at(index).get();
+    const auto maxSilenceMs = static_cast<int64_t>(replicaOptions_.maxReceiverSilence.count());
+    execAsync(replica->client, sql::kReplicaLag, metrics,
+              [replica, callback = std::move(callback), errorCallback](const drogon::orm::Result& res) {
+                  std::optional<microseconds> lag;
+                  auto receiver = Receiver::Unknown;
+                  try {
+                      if (!res.empty()) {
+                          const auto state = res[0]["receiver"].as<std::string>();
+                          receiver = state == "streaming"     ? Receiver::Streaming
+                                     : state == "not_standby" ? Receiver::NotStandby
+                                     : state == "silent"      ? Receiver::Silent
+                                     : state == "hidden"      ? Receiver::Hidden
+                                                              : Receiver::NotStreaming;
+                      }
+                      if (receiver == Receiver::Streaming && !res[0]["lag_seconds"].isNull()) {
+                          const auto seconds = std::max(res[0]["lag_seconds"].as<double>(), 0.0);
+                          lag = microseconds(static_cast<int64_t>(seconds * 1e6));
+                      }
+                  } catch (const std::exception& e) {
+                      errorCallback(e);
+                      return;
+                  }
+                  replica->receiver.store(receiver, std::memory_order_relaxed);
+                  callback(lag);
+              },
+              ErrorCallback(errorCallback), maxSilenceMs);
+}
+
+void DataStore::setReplicaState(size_t index, bool reachable, std::optional<microseconds> lag) {
+    auto& replica = *replicas_.at(index);
+    const bool usable = reachable && lag && *lag <= replicaOptions_.maxLag;
+    replica.lagMicros.store(reachable && lag ? lag->count() : -1, std::memory_order_relaxed);
+    if (replica.usable.exchange(usable, std::memory_order_relaxed) == usable) {
+        return;
+    }
+    if (usable) {
+        LOG_INFO << "Reads resume on " << replica.name;
+    } else if (!reachable) {
+        LOG_WARN << "Reads leave " << replica.name << ": probe failed";
+    } else if (!lag) {
+        switch (replica.receiver.load(std::memory_order_relaxed)) {
+            case Receiver::NotStandby:
+                LOG_WARN << "Reads leave " << replica.name << ": not a standby";
+                break;
+            case Receiver::NotStreaming:
+                LOG_WARN << "Reads leave " << replica.name << ": WAL receiver is not streaming";
+                break;
+            case Receiver::Silent:
+                LOG_WARN << "Reads leave " << replica.name << ": no WAL or keepalive from the primary in "
+                         << replicaOptions_.maxReceiverSilence.count() << " ms";
+                break;
+            case Receiver::Hidden:
+                LOG_WARN << "Reads leave " << replica.name
+                         << ": cannot see pg_stat_wal_receiver; grant pg_read_all_stats to the replica user";
+                break;
+            default:
+                LOG_WARN << "Reads leave " << replica.name << ": no replay lag reported";
+                break;
+        }
+    } else {
+        LOG_WARN << "Reads leave " << replica.name << ": replay lag " << lag->count() / 1000 << " ms";
+    }
+}
+
+std::vector<DataStore::ReplicaStatus> DataStore::replicaStatus() const {
+    std::vector<ReplicaStatus> out;
+    out.reserve(replicas_.size());
+    for (const auto& replica : replicas_) {
+        ReplicaStatus status;
+        status.name = replica->name;
+        status.usable = replica->usable.load(std::memory_order_relaxed);
+        status.lag = microseconds(replica->lagMicros.load(std::memory_order_relaxed));
+        status.inflight = replica->inflight.load(std::memory_order_relaxed);
+        out.push_back(std::move(status));
+    }
+    return out;
+}
+
+void DataStore::pingAsync(DoneCallback&& callback, ErrorCallback&& errorCallback) const {
+    static const auto metrics = statementMetrics(sql::kPing);
+    execAsync(client_, sql::kPing, metrics,
+              [callback = std::move(callback)](const drogon::orm::Result&) { callback(); },
+              std::move(errorCallback));
+}
+
+void DataStore::notifyAsync(const std::string& channel,
+                            const std::string& payload,
+                            DoneCallback&& callback,
+                            ErrorCallback&& errorCallback) {
+    static const auto metrics = statementMetrics(sql::kNotify);
+    execAsync(client_, sql::kNotify, metrics,
+              [callback = std::move(callback)](const drogon::orm::Result&) { callback(); },
+              std::move(errorCallback), channel, payload);
+}
+
+void DataStore::insertMappingsAsync(const std::vector<NewMapping>& rows,
+                                    InsertedCallback&& callback,
+                                    ErrorCallback&& errorCallback) {
+    insertMappings(rows, std::move(callback), [errorCallback = std::move(errorCallback)](const std::exception_ptr& e) {
+        try {
+            std::rethrow_exception(e);
+        } catch (const drogon::orm::DrogonDbException& dbError) {
+            errorCallback(dbError.base());
+        } catch (const std::exception& error) {
+            errorCallback(error);
+        }
+    });
+}
+
+void DataStore::insertMappings(const std::vector<NewMapping>& rows,
+                               InsertedCallback&& callback,
+                               std::function<void(const std::exception_ptr&)>&& errorCallback) {
+    if (rows.empty()) {
+        callback({});
+        return;
+    }
+    if (rows.size() > kMaxInsertBatchRows) {
+        throw std::invalid_argument("insert batch exceeds the bind parameter limit");
+    }
+    static const auto metrics = statementMetrics(sql::kInsertMappingsBatchName);
+    std::vector<uint64_t> writeKeys;
+    if (!replicas_.empty()) {
+        writeKeys.reserve(rows.size() * 2);
+        for (const auto& row : rows) {
+            writeKeys.push_back(codeKey(row.code));
+            if (row.userId) {
+                writeKeys.push_back(userKey(*row.userId));
+            }
+        }
+    }
+    const auto started = steady_clock::now();
+    // The binder copies every parameter and runs the statement when it goes out of scope.
+    auto binder = *client_ << buildInsertMappingsSql(rows.size());
+    for (const auto& row : rows) {
+        binder << row.code << row.url << toDbDate(row.expiresAt) << row.userId;
+    }
+    binder >> [this, callback = std::move(callback), writeKeys = std::move(writeKeys), started](
+                  const drogon::orm::Result& res) {
+        metrics.latency.observe(steady_clock::now() - started);
+        // Stamped on commit: the caller learns of the new codes only after this.
+        for (const auto key : writeKeys) {
+            noteWrite(key);
+        }
+        std::vector<std::string> inserted;
+        inserted.reserve(res.size());
+        for (const auto& row : res) {
+            inserted.push_back(row["code"].as<std::string>());
+        }
+        callback(std::move(inserted));
+    };
+    binder >> [errorCallback = std::move(errorCallback), started](const std::exception_ptr& e) {
+        metrics.latency.observe(steady_clock::now() - started);
+        metrics.errors.inc();
+        errorCallback(e);
+    };
+    binder.exec();
+}
+
+void DataStore::leaseIdBlockAsync(uint64_t size,
+                                  LeaseCallback&& callback,
+                                  ErrorCallback&& errorCallback) {
+    static const auto metrics = statementMetrics(sql::kLeaseIdBlock);
+    execAsync(client_, sql::kLeaseIdBlock, metrics,
+              [callback = std::move(callback), errorCallback](const drogon::orm::Result& res) {
+                  uint64_t firstId;
+                  try {
+                      firstId = decodeLeasedBlock(res);
+                  } catch (const std::exception& e) {
+                      errorCallback(e);
+                      return;
+                  }
+                  callback(firstId);
+              },
+              ErrorCallback(errorCallback),
+              static_cast<int64_t>(size));
+}
+
+void DataStore::resolveUrlAsync(const std::string& code,
+                                ResolveCallback&& callback,
+                                ErrorCallback&& errorCallback) const {
+    auto* replica = readReplica(codeKey(code));
+    if (!replica) {
+        resolveOn(client_, code, std::move(callback), std::move(errorCallback));
+        return;
+    }
+    auto retryOnPrimary = [client = client_, code, callback, errorCallback](ReadRoute reason) mutable {
+        readRouteCounter(reason).inc();
+        resolveOn(client, code, std::move(callback), std::move(errorCallback));
+    };
+    replica->inflight.fetch_add(1, std::memory_order_relaxed);
+    resolveOn(replica->client, code,
+              [replica, callback = std::move(callback), retryOnPrimary](std::optional<ResolvedUrl> resolved) mutable {
+                  replica->inflight.fetch_sub(1, std::memory_order_relaxed);
+                  if (!resolved) {
+                      retryOnPrimary(ReadRoute::PrimaryAfterMiss);
+                      return;
+                  }
+                  callback(std::move(resolved));
+              },
+              [replica, retryOnPrimary](const std::exception&) mutable {
+                  replica->inflight.fetch_sub(1, std::memory_order_relaxed);
+                  retryOnPrimary(ReadRoute::PrimaryAfterError);
+              });
+}
+
+std::optional<DataStore::TimePoint> DataStore::parseTimestamp(std::string_view text) {
+    size_t pos = 0;
+    int64_t year, month, day, hour, minute, second;
+    if (!readDigits(text, pos, 4, year) || !expect(text, pos, '-') ||
+        !readDigits(text, pos, 2, month) || !expect(text, pos, '-') ||
+        !readDigits(text, pos, 2, day) || !(expect(text, pos, ' ') || expect(text, pos, 'T')) ||
+        !readDigits(text, pos, 2, hour) || !expect(text, pos, ':') ||
+        !readDigits(text, pos, 2, minute) || !expect(text, pos, ':') ||
+        !readDigits(text, pos, 2, second)) {
+        return std::nullopt;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return std::nullopt;
+    }
+    int64_t micros = 0;
+    if (expect(text, pos, '.')) {
+        size_t digits = 0;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            if (digits < 6) {
+                micros = micros * 10 + (text[pos] - '0');
+            }
+            ++digits;
+            ++pos;
+        }
+        if (digits == 0) {
+            return std::nullopt;
+        }
+        for (; digits < 6; ++digits) {
+            micros *= 10;
+        }
+    }
+    // Offset east of UTC: +HH, +HH:MM or +HH:MM:SS (timestamp without zone has none).
+    int64_t offsetSeconds = 0;
+    if (pos < text.size()) {
+        const char sign = text[pos++];
+        int64_t offHour = 0, offMinute = 0, offSecond = 0;
+        if ((sign != '+' && sign != '-') || !readDigits(text, pos, 2, offHour)) {
+            return std::nullopt;
+        }
+        if (expect(text, pos, ':') && !readDigits(text, pos, 2, offMinute)) {
+            return std::nullopt;
+        }
+        if (expect(text, pos, ':') && !readDigits(text, pos, 2, offSecond)) {
+            return std::nullopt;
+        }
+        if (pos != text.size()) {
+            return std::nullopt;
+        }
+        offsetSeconds = (offHour * 3600 + offMinute * 60 + offSecond) * (sign == '-' ? -1 : 1);
+    }
+    const auto days = daysFromCivil(year, static_cast<unsigned>(month), static_cast<unsigned>(day));
+    const auto epochSeconds = days * 86400 + hour * 3600 + minute * 60 + second - offsetSeconds;
+    return TimePoint(duration_cast<SystemClock::duration>(microseconds(epochSeconds * 1000000 + micros)));
+}
+
+size_t DataStore::countMappings() const {
+    static const auto metrics = statementMetrics(sql::kCountMappings);
+    auto res = execSync(client_, sql::kCountMappings, metrics);
+    return static_cast<size_t>(res[0]["n"].as<long long>());
+}
+
+std::vector<std::string> DataStore::listCodesAfter(const std::string& after,
+                                                   size_t limit) const {
+    static const auto metrics = statementMetrics(sql::kListCodesAfter);
+    return decodeCodes(execSync(client_, sql::kListCodesAfter, metrics, after, static_cast<long>(limit)));
+}
+
+std::vector<DataStore::StoredMapping> DataStore::listMappingsAfter(const std::string& after,
+                                                                  size_t limit) const {
+    static const auto metrics = statementMetrics(sql::kListMappingsAfter);
+    return decodeStoredMappings(execSync(client_, sql::kListMappingsAfter, metrics, after, static_cast<long>(limit)));
+}
+
+std::vector<DataStore::UrlListItem> DataStore::listRecentMappings(const std::optional<UrlListKey>& after,
+                                                                  size_t limit) const {
+    static const auto firstPageMetrics = statementMetrics(sql::kListRecentMappings);
+    static const auto afterMetrics = statementMetrics(sql::kListRecentMappingsAfter);
+    if (!after) {
+        return decodeListItems(execSync(client_, sql::kListRecentMappings, firstPageMetrics, static_cast<long>(limit)));
+    }
+    const auto afterMicros = static_cast<int64_t>(
+        duration_cast<microseconds>(after->createdAt.time_since_epoch()).count());
+    return decodeListItems(execSync(client_, sql::kListRecentMappingsAfter, afterMetrics, afterMicros, after->code,
+                                    static_cast<long>(limit)));
+}
+
+std::vector<DataStore::StoredMapping> DataStore::lookupMappings(const std::vector<std::string>& codes) const {
+    if (codes.empty()) {
+        return {};
+    }
+    static const auto metrics = statementMetrics(sql::kLookupMappings);
+    return decodeStoredMappings(execSync(client_, sql::kLookupMappings, metrics, textArrayLiteral(codes)));
+}
+
+void DataStore::addClickStats(const std::vector<ClickDelta>& deltas) {
+    if (deltas.empty()) {
+        return;
+    }
+    static const auto metrics = statementMetrics(sql::kUpsertClickStats);
+    std::vector<std::string> codes;
+    codes.reserve(deltas.size());
+    std::string clicks = "{";
+    std::string lastClicks = "{";
+    for (const auto& delta : deltas) {
+        if (!codes.empty()) {
+            clicks += ',';
+            lastClicks += ',';
+        }
+        codes.push_back(delta.code);
+        clicks += std::to_string(delta.clicks);
+        lastClicks += std::to_string(duration_cast<microseconds>(delta.lastClickAt.time_since_epoch()).count());
+    }
+    clicks += '}';
+    lastClicks += '}';
+    execSync(client_, sql::kUpsertClickStats, metrics, textArrayLiteral(codes), clicks, lastClicks);
+}
+
+drogon::Task<> DataStore::pingCoro() const {
+    static const auto metrics = statementMetrics(sql::kPing);
+    co_await execCoro(client_, sql::kPing, metrics);
+}
+
+drogon::Task<std::vector<std::string>> DataStore::insertMappingsCoro(std::vector<NewMapping> rows) {
+    if (rows.empty()) {
+        co_return std::vector<std::string>{};
+    }
+    co_return co_await InsertMappingsAwaiter(
+        [this, &rows](InsertedCallback&& done, std::function<void(const std::exception_ptr&)>&& fail) {
+            insertMappings(rows, std::move(done), std::move(fail));
+        });
+}
+
+drogon::Task<uint64_t> DataStore::leaseIdBlockCoro(uint64_t size) {
+    static const auto metrics = statementMetrics(sql::kLeaseIdBlock);
+    co_return decodeLeasedBlock(co_await execCoro(client_, sql::kLeaseIdBlock, metrics, static_cast<int64_t>(size)));
+}
+
+drogon::Task<std::optional<DataStore::ResolvedUrl>> DataStore::resolveUrlCoro(std::string code) const {
+    static const auto metrics = statementMetrics(sql::kResolveUrl);
+    if (auto* replica = readReplica(codeKey(code))) {
+        try {
+            InflightScope scope(replica->inflight);
+            if (auto resolved = decodeResolved(co_await execCoro(replica->client, sql::kResolveUrl, metrics, code))) {
+                co_return resolved;
+            }
+            readRouteCounter(ReadRoute::PrimaryAfterMiss).inc();
+        } catch (const std::exception&) {
+            readRouteCounter(ReadRoute::PrimaryAfterError).inc();
+        }
+    }
+    co_return decodeResolved(co_await execCoro(client_, sql::kResolveUrl, metrics, std::move(code)));
+}
+
+drogon::Task<std::optional<DataStore::UrlInfo>> DataStore::getUrlInfoCoro(std::string code) const {
+    static const auto metrics = statementMetrics(sql::kGetUrlInfo);
+    if (auto* replica = readReplica(codeKey(code))) {
+        try {
+            InflightScope scope(replica->inflight);
+            if (auto info = decodeUrlInfo(co_await execCoro(replica->client, sql::kGetUrlInfo, metrics, code))) {
+                co_return info;
+            }
+            readRouteCounter(ReadRoute::PrimaryAfterMiss).inc();
+        } catch (const std::exception&) {
+            readRouteCounter(ReadRoute::PrimaryAfterError).inc();
+        }
+    }
+    co_return decodeUrlInfo(co_await execCoro(client_, sql::kGetUrlInfo, metrics, std::move(code)));
+}
+
+drogon::Task<std::optional<DataStore::UserRecord>> DataStore::findUserByEmailCoro(std::string email) const {
+    static const auto metrics = statementMetrics(sql::kFindUserByEmail);
+    co_return decodeUser(co_await execCoro(client_, sql::kFindUserByEmail, metrics, std::move(email)));
+}
+
+drogon::Task<long> DataStore::createUserCoro(std::string name, std::string email, std::string passwordHash) {
+    static const auto metrics = statementMetrics(sql::kCreateUser);
+    auto res = co_await execCoro(client_, sql::kCreateUser, metrics,
+                                 std::move(name), std::move(email), std::move(passwordHash));
+    co_return res[0]["id"].as<long>();
+}
+
+drogon::Task<std::vector<DataStore::UrlListItem>> DataStore::listUrlsForUserCoro(long userId,
+                                                                                std::optional<UrlListKey> after,
+                                                                                size_t limit) const {
+    static const auto firstPageMetrics = statementMetrics(sql::kListUrlsFirstPage);
+    static const auto afterMetrics = statementMetrics(sql::kListUrlsAfter);
+    auto fetchFrom = [&](const drogon::orm::DbClientPtr& client) -> drogon::Task<drogon::orm::Result> {
+        if (!after) {
+            return execCoro(client, sql::kListUrlsFirstPage, firstPageMetrics, userId, static_cast<long>(limit));
+        }
+        const auto afterMicros = static_cast<int64_t>(
+            duration_cast<microseconds>(after->createdAt.time_since_epoch()).count());
+        return execCoro(client, sql::kListUrlsAfter, afterMetrics, userId, afterMicros, after->code,
+                        static_cast<long>(limit));
+    };
+    // A user's own recent links are covered by the read-your-writes window;
+    // an empty page is a valid answer, so only errors are retried.
+    if (auto* replica = readReplica(userKey(userId))) {
+        try {
+            InflightScope scope(replica->inflight);
+            co_return decodeUserListItems(co_await fetchFrom(replica->client));
+        } catch (const std::exception&) {
+            readRouteCounter(ReadRoute::PrimaryAfterError).inc();
+        }
+    }
+    co_return decodeUserListItems(co_await fetchFrom(client_));
+}
+
+drogon::Task<size_t> DataStore::countMappingsCoro() const {
+    static const auto metrics = statementMetrics(sql::kCountMappings);
+    auto res = co_await execCoro(client_, sql::kCountMappings, metrics);
+    co_return static_cast<size_t>(res[0]["n"].as<long long>());
+}
+
+drogon::Task<std::vector<std::string>> DataStore::listCodesAfterCoro(std::string after, size_t limit) const {
+    static const auto metrics = statementMetrics(sql::kListCodesAfter);
+    co_return decodeCodes(co_await execCoro(client_, sql::kListCodesAfter, metrics,
+                                            std::move(after), static_cast<long>(limit)));
+}
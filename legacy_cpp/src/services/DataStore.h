@@ -1,18 +1,62 @@
 #pragma once
 #include <drogon/orm/DbClient.h>
+#include <drogon/utils/coroutine.h>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
 
+// Postgres access. Writes, auth and index rebuilds always use the primary.
+// When streaming replicas are configured, resolve, link info and link
+// listing read from the usable replica with the fewest queries in flight.
+// A replica is usable once a probe (see probeReplicaAsync) has found it
+// reachable, its WAL receiver streaming and its replay within maxLag (the
+// replica user needs pg_read_all_stats to see the receiver); reads of a code or user this process wrote
+// within readYourWritesWindow go to the primary, and a replica miss or
+// error on a code lookup is retried there, so a link is never reported
+// missing only because the replica has not replayed it yet.
 class DataStore {
 public:
     using SystemClock = std::chrono::system_clock;
     using TimePoint = SystemClock::time_point;
 
+    struct ReplicaOptions {
+        std::vector<std::string> uris;
+        // 0 uses the primary's pool size.
+        size_t poolSize{0};
+        std::chrono::milliseconds readYourWritesWindow{std::chrono::milliseconds{5000}};
+        std::chrono::milliseconds maxLag{std::chrono::milliseconds{2000}};
+        // A receiver that has heard nothing from the primary for this long
+        // is taken as disconnected. The primary answers the receiver's
+        // keepalive every wal_receiver_timeout / 2 (30s by default) when idle.
+        std::chrono::milliseconds maxReceiverSilence{std::chrono::milliseconds{35000}};
+    };
+
+    struct ReplicaStatus {
+        std::string name;
+        bool usable{false};
+        // Replay lag from the last probe; negative when unknown.
+        std::chrono::microseconds lag{-1};
+        int64_t inflight{0};
+    };
+
+    struct ResolvedUrl {
+        std::string url;
+        std::optional<TimePoint> expiresAt;
+    };
+
     struct UrlInfo {
         std::string url;
         bool ttlActive{false};
+        uint64_t clicks{0};
+        std::optional<TimePoint> lastClickAt;
     };
 
     struct UrlListItem {
@@ -20,6 +64,35 @@ public:
         std::string url;
         std::optional<TimePoint> expiresAt;
         TimePoint createdAt;
+        // Only filled in by the per-user list.
+        uint64_t clicks{0};
+        std::optional<TimePoint> lastClickAt;
+    };
+
+    // Position in a user's link list, newest first: (created_at, code) of the
+    // last row already returned.
+    struct UrlListKey {
+        TimePoint createdAt;
+        std::string code;
+    };
+
+    struct NewMapping {
+        std::string code;
+        std::string url;
+        std::optional<TimePoint> expiresAt;
+        std::optional<long> userId;
+    };
+
+    struct StoredMapping {
+        std::string code;
+        std::string url;
+        std::optional<TimePoint> expiresAt;
+    };
+
+    struct ClickDelta {
+        std::string code;
+        uint64_t clicks{0};
+        TimePoint lastClickAt;
     };
 
     struct UserRecord {
@@ -29,26 +102,129 @@ public:
         std::string passwordHash;
     };
 
+    using ResolveCallback = std::function<void(std::optional<ResolvedUrl>)>;
+    using ErrorCallback = std::function<void(const std::exception&)>;
+    // Codes that were actually written; the rest hit an existing row.
+    using InsertedCallback = std::function<void(std::vector<std::string>)>;
+    using LeaseCallback = std::function<void(uint64_t firstId)>;
+    using DoneCallback = std::function<void()>;
+    // Replay lag; std::nullopt when the server is not a streaming standby.
+    using LagCallback = std::function<void(std::optional<std::chrono::microseconds>)>;
+
+    // Postgres caps bind parameters at 65535; four are used per row.
+    static constexpr size_t kMaxInsertBatchRows = 16000;
+
     explicit DataStore(const std::string& uri, size_t poolSize = 4);
+    DataStore(const std::string& uri, size_t poolSize, ReplicaOptions replicas);
+    ~DataStore();
+
+    // SELECT 1 on whichever pooled connection is free; for health probes.
+    void pingAsync(DoneCallback&& callback, ErrorCallback&& errorCallback) const;
+    size_t poolSize() const { return poolSize_; }
 
-    bool ping() const;
+    size_t replicaCount() const { return replicas_.size(); }
+    // Measures replay lag on one replica; no lag when its WAL receiver is not
+    // streaming. The caller feeds the outcome back through setReplicaState;
+    // replicas start out unusable.
+    void probeReplicaAsync(size_t index, LagCallback&& callback, ErrorCallback&& errorCallback) const;
+    void setReplicaState(size_t index, bool reachable, std::optional<std::chrono::microseconds> lag);
+    std::vector<ReplicaStatus> replicaStatus() const;
 
-    bool insertMapping(const std::string& code,
-                       const std::string& url,
-                       const std::optional<TimePoint>& expiresAt,
-                       const std::optional<long>& userId);
+    // One multi-row INSERT ... ON CONFLICT DO NOTHING RETURNING code.
+    // Callbacks run on a DB client loop thread.
+    void insertMappingsAsync(const std::vector<NewMapping>& rows,
+                             InsertedCallback&& callback,
+                             ErrorCallback&& errorCallback);
 
-    std::optional<std::string> resolveUrl(const std::string& code) const;
-    std::optional<UrlInfo> getUrlInfo(const std::string& code) const;
+    // pg_notify on the primary, where the change feed listens.
+    void notifyAsync(const std::string& channel,
+                     const std::string& payload,
+                     DoneCallback&& callback,
+                     ErrorCallback&& errorCallback);
 
-    std::optional<UserRecord> findUserByEmail(const std::string& email) const;
-    long createUser(const std::string& name,
-                    const std::string& email,
-                    const std::string& passwordHash);
+    // Reserves [firstId, firstId + size) from short_code_allocator.
+    void leaseIdBlockAsync(uint64_t size,
+                           LeaseCallback&& callback,
+                           ErrorCallback&& errorCallback);
 
-    std::vector<UrlListItem> listUrlsForUser(long userId,
-                                             size_t limit) const;
+    // Non-blocking variant for the redirect path; callbacks run on a DB client loop thread.
+    void resolveUrlAsync(const std::string& code,
+                         ResolveCallback&& callback,
+                         ErrorCallback&& errorCallback) const;
+
+    // Full-table scans for rebuilding in-memory indexes; keyset-paged by code.
+    // Blocking, for background threads only.
+    size_t countMappings() const;
+    std::vector<std::string> listCodesAfter(const std::string& after,
+                                            size_t limit) const;
+    // Unexpired links only; for building URL snapshots.
+    std::vector<StoredMapping> listMappingsAfter(const std::string& after,
+                                                 size_t limit) const;
+    // Unexpired links, newest first, for the startup cache warm-up.
+    std::vector<UrlListItem> listRecentMappings(const std::optional<UrlListKey>& after, size_t limit) const;
+    // Unexpired links among `codes`, in no particular order.
+    std::vector<StoredMapping> lookupMappings(const std::vector<std::string>& codes) const;
+    // Adds to url_click_stats in one statement. Codes must be distinct.
+    // Blocking, for the click flusher thread.
+    void addClickStats(const std::vector<ClickDelta>& deltas);
+
+    // Coroutine API. The awaiting coroutine suspends while the query runs
+    // and resumes on a DB client loop thread, so an IO thread can keep any
+    // number of queries in flight. Failures are rethrown from co_await
+    // (drogon::orm::DrogonDbException for database errors). Arguments are
+    // taken by value because they must outlive the suspension.
+    drogon::Task<> pingCoro() const;
+    drogon::Task<std::vector<std::string>> insertMappingsCoro(std::vector<NewMapping> rows);
+    drogon::Task<uint64_t> leaseIdBlockCoro(uint64_t size);
+    drogon::Task<std::optional<ResolvedUrl>> resolveUrlCoro(std::string code) const;
+    drogon::Task<std::optional<UrlInfo>> getUrlInfoCoro(std::string code) const;
+    drogon::Task<std::optional<UserRecord>> findUserByEmailCoro(std::string email) const;
+    drogon::Task<long> createUserCoro(std::string name, std::string email, std::string passwordHash);
+    // One keyset page ordered by (created_at, code) descending, starting
+    // strictly after `after`. Walks idx_url_mapping_user_created.
+    drogon::Task<std::vector<UrlListItem>> listUrlsForUserCoro(long userId,
+                                                              std::optional<UrlListKey> after,
+                                                              size_t limit) const;
+    drogon::Task<size_t> countMappingsCoro() const;
+    drogon::Task<std::vector<std::string>> listCodesAfterCoro(std::string after, size_t limit) const;
+
+    // Decodes Postgres' ISO text for timestamptz ("2024-05-01 12:00:00.123456+00")
+    // to microsecond precision. std::nullopt if the text is not in that form.
+    static std::optional<TimePoint> parseTimestamp(std::string_view text);
 
 private:
+    // WAL receiver state from the last probe, for the log when a replica
+    // leaves read rotation.
+    enum class Receiver : uint8_t { Unknown, Streaming, NotStandby, NotStreaming, Silent, Hidden };
+
+    struct alignas(64) Replica {
+        std::string name;
+        drogon::orm::DbClientPtr client;
+        std::atomic<int64_t> inflight{0};
+        std::atomic<bool> usable{false};
+        std::atomic<int64_t> lagMicros{-1};
+        std::atomic<Receiver> receiver{Receiver::Unknown};
+    };
+
+    // Lossy table of recent writes keyed by code or user hash; a collision
+    // only sends a read to the primary unnecessarily.
+    static constexpr size_t kRecentWriteSlots = 4096;
+
     drogon::orm::DbClientPtr client_;
+    size_t poolSize_;
+    ReplicaOptions replicaOptions_;
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    mutable std::atomic<size_t> replicaCursor_{0};
+    std::unique_ptr<std::array<std::atomic<int64_t>, kRecentWriteSlots>> recentWrites_;
+
+    // The replica to read from, or nullptr for the primary.
+    Replica* readReplica(uint64_t key) const;
+    void noteWrite(uint64_t key);
+    // insertMappingsAsync with the client's own exception, so the coroutine
+    // API can rethrow it unchanged.
+    void insertMappings(const std::vector<NewMapping>& rows,
+                        InsertedCallback&& callback,
+                        std::function<void(const std::exception_ptr&)>&& errorCallback);
+    static uint64_t codeKey(std::string_view code);
+    static uint64_t userKey(long userId);
 };
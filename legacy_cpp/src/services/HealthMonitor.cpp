@@ -0,0 +1,283 @@
+#include "HealthMonitor.h"
+#include "../cache/RedisPool.h"
+#include "../metrics/Metrics.h"
+#include <json/json.h>
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+// Outstanding probes of one round. Answers that arrive after the round has
+// timed out are ignored.
+struct Round {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending{0};
+    bool closed{false};
+    HealthMonitor::Dependency postgres;
+    HealthMonitor::Dependency redis;
+    std::vector<HealthMonitor::Replica> replicas;
+
+    void finishReplica(size_t index,
+                       bool reachable,
+                       std::optional<std::chrono::microseconds> lag,
+                       HealthMonitor::Clock::time_point started) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            HealthMonitor::Clock::now() - started);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        if (reachable) {
+            replicas[index].reachable = true;
+            replicas[index].lag = lag;
+            replicas[index].latency = elapsed;
+        }
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+
+    void finish(HealthMonitor::Dependency* dependency, HealthMonitor::Clock::time_point started) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            HealthMonitor::Clock::now() - started);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        if (dependency) {
+            ++dependency->healthy;
+            dependency->latency = std::max(dependency->latency, elapsed);
+        }
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+};
+
+Json::Value dependencyJson(const HealthMonitor::Dependency& dependency) {
+    Json::Value out;
+    out["status"] = HealthMonitor::statusName(dependency.status());
+    out["healthy"] = static_cast<Json::UInt64>(dependency.healthy);
+    out["total"] = static_cast<Json::UInt64>(dependency.total);
+    out["latency_ms"] = static_cast<double>(dependency.latency.count()) / 1000.0;
+    return out;
+}
+
+Json::Value replicaJson(const HealthMonitor::Replica& replica) {
+    Json::Value out;
+    out["name"] = replica.name;
+    out["status"] = replica.usable ? "up" : replica.reachable ? "lagging" : "down";
+    if (replica.lag) {
+        out["lag_ms"] = static_cast<double>(replica.lag->count()) / 1000.0;
+    } else {
+        out["lag_ms"] = Json::Value::null;
+    }
+    out["latency_ms"] = static_cast<double>(replica.latency.count()) / 1000.0;
+    return out;
+}
+}  // namespace
+
+HealthMonitor::Status HealthMonitor::Dependency::status() const {
+    if (total > 0 && healthy == total) {
+        return Status::Up;
+    }
+    return healthy > 0 ? Status::Degraded : Status::Down;
+}
+
+bool HealthMonitor::Snapshot::degraded() const {
+    if (postgres.status() != Status::Up || redis.status() != Status::Up || redisBreakerOpen) {
+        return true;
+    }
+    return std::any_of(replicas.begin(), replicas.end(), [](const Replica& replica) { return !replica.usable; });
+}
+
+const char* HealthMonitor::statusName(Status status) {
+    switch (status) {
+        case Status::Up:
+            return "up";
+        case Status::Degraded:
+            return "degraded";
+        case Status::Down:
+            return "down";
+    }
+    return "unknown";
+}
+
+HealthMonitor::HealthMonitor(std::shared_ptr<DataStore> store,
+                             std::shared_ptr<RedisPool> redis,
+                             Options options)
+    : store_(std::move(store)),
+      redis_(std::move(redis)),
+      options_(options),
+      lastRoundTicks_(Clock::now().time_since_epoch().count()) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (options_.interval.count() <= 0) {
+        throw std::runtime_error("health probe interval must be positive");
+    }
+    if (options_.timeout.count() <= 0 || options_.timeout > options_.interval) {
+        options_.timeout = options_.interval;
+    }
+
+    MetricsRegistry::instance().addCollector([this](PrometheusWriter& out) {
+        auto current = snapshot();
+        out.family("urlshortener_ready", "1 when the readiness endpoint reports ready", "gauge");
+        out.sample("urlshortener_ready", {}, current && current->ready() ? 1.0 : 0.0);
+        if (!current) {
+            return;
+        }
+        out.family("urlshortener_dependency_healthy_connections",
+                   "Connections that answered the last health probe", "gauge");
+        out.sample("urlshortener_dependency_healthy_connections", {{"dependency", "postgres"}},
+                   static_cast<double>(current->postgres.healthy));
+        out.sample("urlshortener_dependency_healthy_connections", {{"dependency", "redis"}},
+                   static_cast<double>(current->redis.healthy));
+        out.family("urlshortener_dependency_probe_latency_seconds",
+                   "Slowest successful health probe in the last round", "gauge");
+        out.sample("urlshortener_dependency_probe_latency_seconds", {{"dependency", "postgres"}},
+                   static_cast<double>(current->postgres.latency.count()) / 1e6);
+        out.sample("urlshortener_dependency_probe_latency_seconds", {{"dependency", "redis"}},
+                   static_cast<double>(current->redis.latency.count()) / 1e6);
+    });
+}
+
+HealthMonitor::~HealthMonitor() {
+    stop();
+}
+
+void HealthMonitor::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (worker_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    worker_ = std::thread([this] { run(); });
+}
+
+void HealthMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void HealthMonitor::setWarmingUp(bool warmingUp) {
+    if (warmingUp_.exchange(warmingUp, std::memory_order_acq_rel) == warmingUp) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        roundRequested_ = true;
+    }
+    wakeup_.notify_all();
+}
+
+bool HealthMonitor::live() const {
+    // A round never takes longer than interval + timeout; allow two missed rounds.
+    const auto budget = 3 * (options_.interval + options_.timeout);
+    const auto last = Clock::time_point(Clock::duration(lastRoundTicks_.load(std::memory_order_relaxed)));
+    return Clock::now() - last < budget;
+}
+
+void HealthMonitor::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        auto next = probe();
+        const auto wasReady = [&] {
+            auto previous = snapshot();
+            return previous ? previous->ready() : true;
+        }();
+        if (wasReady != next->ready()) {
+            LOG_WARN << "Readiness changed to " << (next->ready() ? "ready" : "not ready") << ": " << next->json;
+        }
+        snapshot_.store(std::move(next), std::memory_order_release);
+        lastRoundTicks_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        lock.lock();
+        wakeup_.wait_for(lock, options_.interval, [this] { return stopping_ || roundRequested_; });
+        roundRequested_ = false;
+    }
+}
+
+std::shared_ptr<const HealthMonitor::Snapshot> HealthMonitor::probe() {
+    auto round = std::make_shared<Round>();
+    const auto postgresProbes = store_->poolSize();
+    const auto redisProbes = redis_ ? redis_->size() : 0;
+    const auto replicaProbes = store_->replicaCount();
+    round->pending = postgresProbes + redisProbes + replicaProbes;
+    round->postgres.total = postgresProbes;
+    round->redis.total = redisProbes;
+    round->replicas.resize(replicaProbes);
+
+    // Issued without holding round->mutex: failures may be reported inline.
+    for (size_t i = 0; i < postgresProbes; ++i) {
+        const auto started = Clock::now();
+        store_->pingAsync(
+            [round, started] { round->finish(&round->postgres, started); },
+            [round, started](const std::exception&) { round->finish(nullptr, started); });
+    }
+    for (size_t i = 0; i < redisProbes; ++i) {
+        const auto started = Clock::now();
+        redis_->pingConnection(
+            i,
+            [round, started] { round->finish(&round->redis, started); },
+            [round, started](const drogon::nosql::RedisException&) { round->finish(nullptr, started); });
+    }
+    for (size_t i = 0; i < replicaProbes; ++i) {
+        const auto started = Clock::now();
+        store_->probeReplicaAsync(
+            i,
+            [round, i, started](std::optional<std::chrono::microseconds> lag) {
+                round->finishReplica(i, true, lag, started);
+            },
+            [round, i, started](const std::exception&) { round->finishReplica(i, false, std::nullopt, started); });
+    }
+
+    auto next = std::make_shared<Snapshot>();
+    {
+        std::unique_lock<std::mutex> lock(round->mutex);
+        round->done.wait_for(lock, options_.timeout, [&] { return round->pending == 0; });
+        round->closed = true;
+        next->postgres = round->postgres;
+        next->redis = round->redis;
+        next->replicas = round->replicas;
+    }
+    // Unanswered replicas are taken out of read rotation like failed ones.
+    for (size_t i = 0; i < next->replicas.size(); ++i) {
+        auto& replica = next->replicas[i];
+        store_->setReplicaState(i, replica.reachable, replica.lag);
+    }
+    const auto replicaStatus = store_->replicaStatus();
+    for (size_t i = 0; i < next->replicas.size() && i < replicaStatus.size(); ++i) {
+        next->replicas[i].name = replicaStatus[i].name;
+        next->replicas[i].usable = replicaStatus[i].usable;
+    }
+    next->round = ++rounds_;
+    next->checkedAt = Clock::now();
+    next->redisBreakerOpen = redis_ && redis_->breaker().state() == CircuitBreaker::State::Open;
+    next->warmingUp = warmingUp_.load(std::memory_order_acquire);
+
+    Json::Value body;
+    body["status"] = next->warmingUp ? "warming_up" : !next->ready() ? "unavailable" : next->degraded() ? "degraded" : "ok";
+    body["round"] = static_cast<Json::UInt64>(next->round);
+    body["postgres"] = dependencyJson(next->postgres);
+    body["redis"] = dependencyJson(next->redis);
+    body["redis"]["breaker_open"] = next->redisBreakerOpen;
+    if (!next->replicas.empty()) {
+        auto& replicas = body["postgres_replicas"];
+        replicas = Json::Value(Json::arrayValue);
+        for (const auto& replica : next->replicas) {
+            replicas.append(replicaJson(replica));
+        }
+    }
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    next->json = Json::writeString(writer, body);
+    return next;
+}
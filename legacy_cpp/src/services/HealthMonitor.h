@@ -0,0 +1,116 @@
+#pragma once
+#include "DataStore.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RedisPool;
+
+// Probes Postgres and Redis from a background thread on a fixed interval and
+// publishes the result as an immutable snapshot, so health endpoints answer
+// from memory instead of running a query per request. Postgres gets one
+// SELECT 1 per pool connection per round, Redis a PING on every pooled
+// connection, and each read replica a replay-lag query whose outcome also
+// decides whether DataStore sends reads to it.
+class HealthMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::chrono::milliseconds interval{std::chrono::milliseconds{2000}};
+        // Probes not answered within this are counted as failed.
+        std::chrono::milliseconds timeout{std::chrono::milliseconds{1000}};
+    };
+
+    enum class Status { Up, Degraded, Down };
+
+    struct Dependency {
+        size_t healthy{0};
+        size_t total{0};
+        // Slowest successful probe in the round.
+        std::chrono::microseconds latency{0};
+
+        Status status() const;
+    };
+
+    struct Replica {
+        std::string name;
+        bool reachable{false};
+        // std::nullopt when the server reported no replay position.
+        std::optional<std::chrono::microseconds> lag;
+        bool usable{false};
+        std::chrono::microseconds latency{0};
+    };
+
+    struct Snapshot {
+        uint64_t round{0};
+        Clock::time_point checkedAt;
+        Dependency postgres;
+        Dependency redis;
+        std::vector<Replica> replicas;
+        bool redisBreakerOpen{false};
+        // Startup cache warm-up still running
+        bool warmingUp{false};
+        // Rendered once per round for the health endpoints.
+        std::string json;
+
+        // Redirects and shortens need the primary; without Redis or replicas
+        // they fall back to it. A warming instance is held back so it does
+        // not take traffic with cold caches.
+        bool ready() const { return postgres.healthy > 0 && !warmingUp; }
+        bool degraded() const;
+    };
+
+    HealthMonitor(std::shared_ptr<DataStore> store,
+                  std::shared_ptr<RedisPool> redis,
+                  Options options);
+    ~HealthMonitor();
+
+    HealthMonitor(const HealthMonitor&) = delete;
+    HealthMonitor& operator=(const HealthMonitor&) = delete;
+
+    // Starts the probe thread; the first round runs immediately.
+    void start();
+    void stop();
+
+    // Null until the first round has completed.
+    std::shared_ptr<const Snapshot> snapshot() const {
+        return snapshot_.load(std::memory_order_acquire);
+    }
+
+    // Holds readiness while the cache warm-up runs. Clearing it starts a
+    // round right away instead of waiting out the interval.
+    void setWarmingUp(bool warmingUp);
+
+    // False once rounds stop completing, e.g. the probe thread is wedged.
+    bool live() const;
+
+    const Options& options() const { return options_; }
+
+    static const char* statusName(Status status);
+
+private:
+    std::shared_ptr<DataStore> store_;
+    std::shared_ptr<RedisPool> redis_;
+    Options options_;
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot_;
+    std::atomic<int64_t> lastRoundTicks_;
+    uint64_t rounds_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_{false};
+    bool roundRequested_{false};
+    std::atomic<bool> warmingUp_{false};
+    std::thread worker_;
+
+    void run();
+    std::shared_ptr<const Snapshot> probe();
+};
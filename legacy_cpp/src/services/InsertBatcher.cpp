@@ -0,0 +1,162 @@
+#include "InsertBatcher.h"
+#include "ChangeFeed.h"
+#include "../metrics/Metrics.h"
+#include <drogon/orm/Exception.h>
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+
+namespace {
+Counter& rowCounter(const char* result) {
+    return MetricsRegistry::instance().counter(
+        "urlshortener_insert_rows_total", "Rows submitted to the insert batcher by outcome", {{"result", result}});
+}
+}  // namespace
+
+InsertBatcher::InsertBatcher(std::shared_ptr<DataStore> store,
+                             Options options,
+                             std::shared_ptr<ChangeFeed> changeFeed)
+    : store_(std::move(store)),
+      options_(options),
+      changeFeed_(std::move(changeFeed)),
+      batches_(MetricsRegistry::instance().counter(
+          "urlshortener_insert_batches_total", "Multi-row INSERT statements issued by the insert batcher")),
+      inserted_(rowCounter("inserted")),
+      conflicts_(rowCounter("conflict")),
+      failed_(rowCounter("failed")) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    options_.maxBatchSize = std::clamp<size_t>(options_.maxBatchSize, 1, DataStore::kMaxInsertBatchRows);
+    pending_.reserve(options_.maxBatchSize);
+    flusher_ = std::thread([this] { run(); });
+}
+
+InsertBatcher::~InsertBatcher() {
+    stop();
+}
+
+void InsertBatcher::submit(DataStore::NewMapping row, Callback callback) {
+    std::vector<Pending> ready;
+    bool startedBatch = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            ready.push_back(Pending{std::move(row), std::move(callback)});
+        } else {
+            if (pending_.empty()) {
+                batchStarted_ = std::chrono::steady_clock::now();
+                startedBatch = true;
+            }
+            pending_.push_back(Pending{std::move(row), std::move(callback)});
+            if (pending_.size() >= options_.maxBatchSize) {
+                ready.swap(pending_);
+                pending_.reserve(options_.maxBatchSize);
+                startedBatch = false;
+            }
+        }
+    }
+    if (startedBatch) {
+        wakeup_.notify_one();
+    }
+    if (!ready.empty()) {
+        // Full batches go out from the submitting thread; the write itself is async.
+        flush(std::move(ready));
+    }
+}
+
+void InsertBatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+}
+
+void InsertBatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        wakeup_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {
+            return;
+        }
+        // A full batch may be swapped out and a new one started while we
+        // sleep, so re-read the deadline on every wakeup.
+        while (!stopping_ && !pending_.empty()) {
+            const auto deadline = batchStarted_ + options_.maxDelay;
+            if (std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            wakeup_.wait_until(lock, deadline);
+        }
+        if (pending_.empty()) {
+            continue;
+        }
+        std::vector<Pending> ready;
+        ready.swap(pending_);
+        pending_.reserve(options_.maxBatchSize);
+        lock.unlock();
+        flush(std::move(ready));
+        lock.lock();
+    }
+}
+
+void InsertBatcher::flush(std::vector<Pending> batch) {
+    batches_.inc();
+    auto waiting = std::make_shared<std::vector<Pending>>(std::move(batch));
+    std::vector<DataStore::NewMapping> rows;
+    rows.reserve(waiting->size());
+    for (const auto& pending : *waiting) {
+        rows.push_back(pending.row);
+    }
+
+    auto fail = [this, waiting](const std::exception& e) {
+        // A statement error may come from a single row. Halve the batch until
+        // the bad row is alone, so its co-batched submitters still get their
+        // own outcome. Connection errors and timeouts fail the whole batch.
+        if (waiting->size() > 1 && dynamic_cast<const drogon::orm::SqlError*>(&e)) {
+            const auto middle = waiting->begin() + static_cast<std::ptrdiff_t>(waiting->size() / 2);
+            std::vector<Pending> front(std::make_move_iterator(waiting->begin()), std::make_move_iterator(middle));
+            std::vector<Pending> back(std::make_move_iterator(middle), std::make_move_iterator(waiting->end()));
+            flush(std::move(front));
+            flush(std::move(back));
+            return;
+        }
+        failed_.inc(waiting->size());
+        for (auto& pending : *waiting) {
+            pending.callback(Outcome::Failed);
+        }
+    };
+    try {
+        store_->insertMappingsAsync(
+            rows,
+            [this, waiting](std::vector<std::string> insertedCodes) {
+                if (changeFeed_ && !insertedCodes.empty()) {
+                    changeFeed_->publish(insertedCodes);
+                }
+                // A code submitted twice in one batch is inserted once; only
+                // the first submitter gets to claim it.
+                std::unordered_set<std::string> unclaimed(
+                    std::make_move_iterator(insertedCodes.begin()),
+                    std::make_move_iterator(insertedCodes.end()));
+                for (auto& pending : *waiting) {
+                    if (unclaimed.erase(pending.row.code) > 0) {
+                        inserted_.inc();
+                        pending.callback(Outcome::Inserted);
+                    } else {
+                        conflicts_.inc();
+                        pending.callback(Outcome::Conflict);
+                    }
+                }
+            },
+            fail);
+    } catch (const std::exception& e) {
+        fail(e);
+    }
+}
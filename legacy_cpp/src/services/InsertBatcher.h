@@ -0,0 +1,76 @@
+#pragma once
+#include "DataStore.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ChangeFeed;
+class Counter;
+
+// Group-commits concurrent url_mapping inserts. Rows are collected until the
+// batch is full or the oldest row has waited maxDelay, then written with one
+// multi-row INSERT; each submitter learns whether its own row went in. A
+// batch rejected by a statement error is split and retried, so one bad row
+// fails only its own submitter.
+// Committed codes are published on the change feed, when there is one.
+class InsertBatcher {
+public:
+    struct Options {
+        size_t maxBatchSize{256};
+        std::chrono::microseconds maxDelay{2000};
+    };
+
+    enum class Outcome {
+        Inserted,
+        // The code already exists (or appeared twice in one batch)
+        Conflict,
+        Failed,
+    };
+
+    // Runs on a DB client loop thread, or inline when the INSERT could not be issued.
+    using Callback = std::function<void(Outcome)>;
+
+    InsertBatcher(std::shared_ptr<DataStore> store,
+                  Options options,
+                  std::shared_ptr<ChangeFeed> changeFeed = nullptr);
+    ~InsertBatcher();
+
+    InsertBatcher(const InsertBatcher&) = delete;
+    InsertBatcher& operator=(const InsertBatcher&) = delete;
+
+    void submit(DataStore::NewMapping row, Callback callback);
+
+    // Flushes whatever is pending and joins the timer thread.
+    void stop();
+
+    const Options& options() const { return options_; }
+
+private:
+    struct Pending {
+        DataStore::NewMapping row;
+        Callback callback;
+    };
+
+    std::shared_ptr<DataStore> store_;
+    Options options_;
+    std::shared_ptr<ChangeFeed> changeFeed_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::vector<Pending> pending_;
+    std::chrono::steady_clock::time_point batchStarted_;
+    bool stopping_{false};
+    std::thread flusher_;
+
+    Counter& batches_;
+    Counter& inserted_;
+    Counter& conflicts_;
+    Counter& failed_;
+
+    void run();
+    void flush(std::vector<Pending> batch);
+};
@@ -0,0 +1,93 @@
+#include "KdfWorkerPool.h"
+#include "../metrics/Metrics.h"
+#include <algorithm>
+
+KdfWorkerPool::KdfWorkerPool(Options options)
+    : options_(options),
+      accepted_(MetricsRegistry::instance().counter(
+          "urlshortener_kdf_tasks_total", "Password hashing tasks by admission result", {{"result", "accepted"}})),
+      rejected_(MetricsRegistry::instance().counter(
+          "urlshortener_kdf_tasks_total", "Password hashing tasks by admission result", {{"result", "rejected"}})),
+      queueWait_(MetricsRegistry::instance().histogram(
+          "urlshortener_kdf_queue_wait_seconds", "Time password hashing tasks spent queued")),
+      runTime_(MetricsRegistry::instance().histogram(
+          "urlshortener_kdf_task_duration_seconds", "Time spent running password hashing tasks")) {
+    if (options_.threads == 0) {
+        options_.threads = std::max<size_t>(std::thread::hardware_concurrency() / 2, 1);
+    }
+    if (options_.queueLimit == 0) {
+        options_.queueLimit = 1;
+    }
+
+    auto& registry = MetricsRegistry::instance();
+    registry.gauge("urlshortener_kdf_queue_depth", "Password hashing tasks waiting for a worker", {},
+                   [this] { return static_cast<double>(stats().queued); });
+    registry.gauge("urlshortener_kdf_workers_busy", "Password hashing workers currently running a task", {},
+                   [this] { return static_cast<double>(busy_.load(std::memory_order_relaxed)); });
+
+    workers_.reserve(options_.threads);
+    for (size_t i = 0; i < options_.threads; ++i) {
+        workers_.emplace_back([this] { run(); });
+    }
+}
+
+KdfWorkerPool::~KdfWorkerPool() {
+    stop();
+}
+
+bool KdfWorkerPool::trySubmit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= options_.queueLimit) {
+            rejected_.inc();
+            return false;
+        }
+        queue_.push_back(Job{std::move(task), std::chrono::steady_clock::now()});
+    }
+    accepted_.inc();
+    wakeup_.notify_one();
+    return true;
+}
+
+void KdfWorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+KdfWorkerPool::Stats KdfWorkerPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{options_.threads, queue_.size(), busy_.load(std::memory_order_relaxed)};
+}
+
+void KdfWorkerPool::run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        const auto started = std::chrono::steady_clock::now();
+        queueWait_.observe(started - job.enqueuedAt);
+        busy_.fetch_add(1, std::memory_order_relaxed);
+        try {
+            job.task();
+        } catch (...) {
+            // Callers own error reporting; never let a task take the worker down.
+        }
+        busy_.fetch_sub(1, std::memory_order_relaxed);
+        runTime_.observe(std::chrono::steady_clock::now() - started);
+    }
+}
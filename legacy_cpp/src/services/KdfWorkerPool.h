@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class Counter;
+class Histogram;
+
+// Dedicated threads for password hashing so PBKDF2 never runs on Drogon's IO
+// loops. The queue is bounded: once it is full, trySubmit() refuses the task
+// and the caller is expected to shed the request instead of queueing it.
+class KdfWorkerPool {
+public:
+    struct Options {
+        // 0 picks half the hardware threads (at least one).
+        size_t threads{0};
+        size_t queueLimit{256};
+    };
+
+    // Thrown from co_await schedule() when the pool refused the task.
+    class Saturated : public std::runtime_error {
+    public:
+        Saturated() : std::runtime_error("kdf worker pool saturated") {}
+    };
+
+    // co_await pool.schedule() moves the awaiting coroutine onto a worker
+    // thread; it throws Saturated, still on the calling thread, when the
+    // queue is full. A coroutine that hops here must not hold IO-loop-bound
+    // state across the hop.
+    class ScheduleAwaiter {
+    public:
+        explicit ScheduleAwaiter(KdfWorkerPool& pool) : pool_(pool) {}
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            // A worker may resume the coroutine before trySubmit returns, so
+            // the flag is set first and the awaiter is not touched afterwards.
+            accepted_ = true;
+            if (!pool_.trySubmit([handle] { handle.resume(); })) {
+                accepted_ = false;
+                return false;
+            }
+            return true;
+        }
+        void await_resume() const {
+            if (!accepted_) {
+                throw Saturated();
+            }
+        }
+
+    private:
+        KdfWorkerPool& pool_;
+        bool accepted_{false};
+    };
+
+    struct Stats {
+        size_t threads{0};
+        size_t queued{0};
+        size_t busy{0};
+    };
+
+    explicit KdfWorkerPool(Options options);
+    ~KdfWorkerPool();
+
+    KdfWorkerPool(const KdfWorkerPool&) = delete;
+    KdfWorkerPool& operator=(const KdfWorkerPool&) = delete;
+
+    // Returns false, without running the task, when the queue is full or the
+    // pool is stopping. Tasks must handle their own exceptions.
+    bool trySubmit(std::function<void()> task);
+
+    ScheduleAwaiter schedule() { return ScheduleAwaiter(*this); }
+
+    // Drains queued tasks, then joins the workers.
+    void stop();
+
+    Stats stats() const;
+
+private:
+    struct Job {
+        std::function<void()> task;
+        std::chrono::steady_clock::time_point enqueuedAt;
+    };
+
+    Options options_;
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<Job> queue_;
+    bool stopping_{false};
+    std::atomic<size_t> busy_{0};
+    std::vector<std::thread> workers_;
+
+    Counter& accepted_;
+    Counter& rejected_;
+    Histogram& queueWait_;
+    Histogram& runTime_;
+
+    void run();
+};
@@ -0,0 +1,209 @@
+#include "RateLimiter.h"
+#include "../cache/RedisPool.h"
+#include "../metrics/Metrics.h"
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// GCRA: the key holds the theoretical arrival time (TAT) in microseconds,
+// written with %.0f because Lua's default number format drops digits.
+// Returns 0 when admitted, otherwise the microseconds until the next
+// request would be.
+constexpr const char* kGcraScript =
+    "local now = redis.call('TIME') "
+    "local nowUs = tonumber(now[1]) * 1000000 + tonumber(now[2]) "
+    "local interval = tonumber(ARGV[1]) "
+    "local tolerance = tonumber(ARGV[2]) "
+    "local tat = tonumber(redis.call('GET', KEYS[1]) or nowUs) "
+    "if tat < nowUs then tat = nowUs end "
+    "local allowAt = tat + interval - tolerance "
+    "if allowAt > nowUs then return math.max(1, allowAt - nowUs) end "
+    "redis.call('SET', KEYS[1], string.format('%.0f', tat + interval), 'PX', "
+    "math.ceil((tat + interval - nowUs) / 1000)) "
+    "return 0";
+
+std::string sha1Hex(std::string_view data) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha1(), nullptr) != 1) {
+        throw std::runtime_error("SHA-1 is not available");
+    }
+    std::string hex(length * 2, '0');
+    for (unsigned int i = 0; i < length; ++i) {
+        std::snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+bool isNoScript(const drogon::nosql::RedisException& error) {
+    return error.code() == drogon::nosql::RedisErrorCode::kRedisError &&
+           std::string_view(error.what()).rfind("NOSCRIPT", 0) == 0;
+}
+
+int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t hashKey(RateLimiter::Rule rule, std::string_view key) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ static_cast<uint64_t>(rule);
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::chrono::seconds ceilSeconds(double seconds) {
+    return std::chrono::seconds{static_cast<int64_t>(std::ceil(std::max(seconds, 1.0)))};
+}
+}  // namespace
+
+RateLimiter::RateLimiter(Options options, std::shared_ptr<RedisPool> redis)
+    : options_(options), redis_(std::move(redis)), gcraSha_(sha1Hex(kGcraScript)) {
+    auto& registry = MetricsRegistry::instance();
+    const std::string name = "urlshortener_rate_limit_decisions_total";
+    const std::string help = "Rate limiter decisions by rule";
+    for (size_t i = 0; i < kRuleCount; ++i) {
+        auto& limit = options_.limits[i];
+        limit.burst = std::max(limit.burst, 1.0);
+        const auto* rule = ruleName(static_cast<Rule>(i));
+        allowed_[i] = &registry.counter(name, help, {{"rule", rule}, {"result", "allowed"}});
+        limited_[i] = &registry.counter(name, help, {{"rule", rule}, {"result", "limited"}});
+    }
+    options_.maxKeysPerShard = std::max<size_t>(options_.maxKeysPerShard, 1);
+}
+
+const char* RateLimiter::ruleName(Rule rule) {
+    switch (rule) {
+    case Rule::Resolve:
+        return "resolve";
+    case Rule::Shorten:
+        return "shorten";
+    case Rule::Login:
+        return "login";
+    case Rule::Register:
+        return "register";
+    }
+    return "unknown";
+}
+
+RateLimiter::Decision RateLimiter::record(Rule rule, Decision decision) {
+    const auto index = static_cast<size_t>(rule);
+    (decision.allowed ? allowed_[index] : limited_[index])->inc();
+    return decision;
+}
+
+RateLimiter::Decision RateLimiter::tryAcquire(Rule rule, std::string_view key) {
+    const auto& rl = limit(rule);
+    if (rl.ratePerSecond <= 0) {
+        return {};
+    }
+    const auto hash = hashKey(rule, key);
+    auto& shard = shards_[(hash >> 32) % kShards];
+    const auto now = nowNanos();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.buckets.find(hash);
+    if (it == shard.buckets.end()) {
+        if (shard.buckets.size() >= options_.maxKeysPerShard) {
+            sweep(shard, rl, now);
+        }
+        it = shard.buckets.emplace(hash, Bucket{rl.burst, now}).first;
+    }
+    auto& bucket = it->second;
+    const auto elapsed = static_cast<double>(now - bucket.updatedNanos) / 1e9;
+    bucket.tokens = std::min(rl.burst, bucket.tokens + elapsed * rl.ratePerSecond);
+    bucket.updatedNanos = now;
+    if (bucket.tokens >= 1.0) {
+        bucket.tokens -= 1.0;
+        return record(rule, {});
+    }
+    return record(rule, {false, ceilSeconds((1.0 - bucket.tokens) / rl.ratePerSecond)});
+}
+
+void RateLimiter::sweep(Shard& shard, const Limit& limit, int64_t now) {
+    // A bucket that would have refilled completely is indistinguishable from
+    // a fresh one, so it can go. Keys of different rules share shards; the
+    // slowest refill is not known here, so use this rule's as the estimate.
+    const auto refillNanos = static_cast<int64_t>(limit.burst / limit.ratePerSecond * 1e9);
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        if (now - it->second.updatedNanos >= refillNanos) {
+            it = shard.buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (shard.buckets.size() < options_.maxKeysPerShard) {
+        return;
+    }
+    // Still full of active keys, likely a key-spraying client. Evict the
+    // least recently updated eighth so callers in the middle of a burst keep
+    // their buckets, and the sweep runs at most once per eighth of inserts.
+    std::vector<int64_t> updated;
+    updated.reserve(shard.buckets.size());
+    for (const auto& [hash, bucket] : shard.buckets) {
+        updated.push_back(bucket.updatedNanos);
+    }
+    const auto cutoff = updated.begin() + static_cast<std::ptrdiff_t>(updated.size() / 8);
+    std::nth_element(updated.begin(), cutoff, updated.end());
+    const auto oldest = *cutoff;
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+        it = it->second.updatedNanos <= oldest ? shard.buckets.erase(it) : std::next(it);
+    }
+}
+
+void RateLimiter::check(Rule rule, std::string key, DecisionCallback&& callback) {
+    const auto& rl = limit(rule);
+    if (rl.ratePerSecond <= 0) {
+        callback({});
+        return;
+    }
+    if (!rl.distributed || !redis_) {
+        callback(tryAcquire(rule, key));
+        return;
+    }
+
+    const auto intervalUs = std::max<int64_t>(static_cast<int64_t>(1e6 / rl.ratePerSecond), 1);
+    const auto toleranceUs = static_cast<int64_t>(static_cast<double>(intervalUs) * rl.burst);
+    auto call = std::make_shared<GcraCall>(GcraCall{rule, key, std::string("rl:") + ruleName(rule) + ":" + key,
+                                                    std::to_string(intervalUs), std::to_string(toleranceUs),
+                                                    std::move(callback)});
+    evalGcra(std::move(call), false);
+}
+
+void RateLimiter::evalGcra(std::shared_ptr<GcraCall> call, bool sendScript) {
+    auto onResult = [this, call](const drogon::nosql::RedisResult& result) {
+        long long waitUs = 0;
+        try {
+            waitUs = result.asInteger();
+        } catch (const std::exception&) {
+            call->callback(tryAcquire(call->rule, call->key));
+            return;
+        }
+        if (waitUs <= 0) {
+            call->callback(record(call->rule, {}));
+        } else {
+            call->callback(record(call->rule, {false, ceilSeconds(static_cast<double>(waitUs) / 1e6)}));
+        }
+    };
+    auto onError = [this, call, sendScript](const drogon::nosql::RedisException& error) {
+        // Not cached yet (or flushed by a restart or SCRIPT FLUSH): EVAL
+        // runs it once and caches it for the following EVALSHAs.
+        if (!sendScript && isNoScript(error)) {
+            evalGcra(call, true);
+            return;
+        }
+        call->callback(tryAcquire(call->rule, call->key));
+    };
+    redis_->execCommandAsync(std::move(onResult), std::move(onError),
+                             sendScript ? "eval %s 1 %s %s %s" : "evalsha %s 1 %s %s %s",
+                             sendScript ? kGcraScript : gcraSha_.c_str(),
+                             call->redisKey.c_str(),
+                             call->interval.c_str(),
+                             call->tolerance.c_str());
+}
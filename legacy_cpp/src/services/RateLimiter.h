@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class Counter;
+class RedisPool;
+
+// Token-bucket rate limiting per (rule, caller key). Buckets live in
+// lock-striped shards keyed by a hash of the key, so concurrent requests for
+// different callers rarely share a lock and there is no global one. Rules
+// marked distributed are enforced in Redis with GCRA instead, so the limit
+// holds across replicas; if Redis is unavailable they fall back to the
+// local buckets. The GCRA script is sent by hash, and in full only when the
+// server answers NOSCRIPT.
+class RateLimiter {
+public:
+    enum class Rule { Resolve = 0, Shorten, Login, Register };
+    static constexpr size_t kRuleCount = 4;
+
+    struct Limit {
+        // Tokens per second; 0 disables the rule.
+        double ratePerSecond{0.0};
+        double burst{1.0};
+        bool distributed{false};
+    };
+
+    struct Options {
+        std::array<Limit, kRuleCount> limits{};
+        // Idle buckets are swept once a shard holds this many keys; if that
+        // frees nothing, the least recently used eighth is evicted.
+        size_t maxKeysPerShard{16384};
+    };
+
+    struct Decision {
+        bool allowed{true};
+        std::chrono::seconds retryAfter{0};
+    };
+    using DecisionCallback = std::function<void(Decision)>;
+
+    // redis may be null, in which case every rule is local.
+    RateLimiter(Options options, std::shared_ptr<RedisPool> redis);
+
+    bool enabled(Rule rule) const { return limit(rule).ratePerSecond > 0; }
+
+    // Local decision; never blocks on I/O.
+    Decision tryAcquire(Rule rule, std::string_view key);
+
+    // Calls back inline for local rules, from a Redis loop thread for distributed ones.
+    void check(Rule rule, std::string key, DecisionCallback&& callback);
+
+    static const char* ruleName(Rule rule);
+
+private:
+    struct Bucket {
+        double tokens{0.0};
+        int64_t updatedNanos{0};
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Bucket> buckets;
+    };
+    static constexpr size_t kShards = 64;
+
+    struct GcraCall {
+        Rule rule;
+        std::string key;
+        std::string redisKey;
+        std::string interval;
+        std::string tolerance;
+        DecisionCallback callback;
+    };
+
+    Options options_;
+    std::shared_ptr<RedisPool> redis_;
+    // SHA-1 of the GCRA script, for EVALSHA.
+    const std::string gcraSha_;
+    std::array<Shard, kShards> shards_;
+    std::array<Counter*, kRuleCount> allowed_{};
+    std::array<Counter*, kRuleCount> limited_{};
+
+    const Limit& limit(Rule rule) const { return options_.limits[static_cast<size_t>(rule)]; }
+    Decision record(Rule rule, Decision decision);
+    void sweep(Shard& shard, const Limit& limit, int64_t now);
+    void evalGcra(std::shared_ptr<GcraCall> call, bool sendScript);
+};
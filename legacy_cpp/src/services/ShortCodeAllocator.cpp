@@ -0,0 +1,159 @@
+#include "ShortCodeAllocator.h"
+#include "../metrics/Metrics.h"
+#include "../utils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+// 62^7 < 2^42, so a balanced Feistel network on 42 bits plus cycle walking
+// yields a permutation of exactly [0, 62^7).
+constexpr unsigned kHalfBits = 21;
+constexpr uint64_t kHalfMask = (uint64_t{1} << kHalfBits) - 1;
+constexpr int kRounds = 4;
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t feistel(uint64_t value, uint64_t key) {
+    uint64_t left = value >> kHalfBits;
+    uint64_t right = value & kHalfMask;
+    for (int round = 0; round < kRounds; ++round) {
+        const auto f = mix64(right ^ (key + 0x9e3779b97f4a7c15ULL * (round + 1))) & kHalfMask;
+        const auto next = left ^ f;
+        left = right;
+        right = next;
+    }
+    return (left << kHalfBits) | right;
+}
+}  // namespace
+
+ShortCodeAllocator::ShortCodeAllocator(std::shared_ptr<DataStore> store, Options options)
+    : store_(std::move(store)),
+      options_(options),
+      leases_(MetricsRegistry::instance().counter(
+          "urlshortener_code_block_leases_total", "Short code id blocks leased", {{"result", "ok"}})),
+      leaseFailures_(MetricsRegistry::instance().counter(
+          "urlshortener_code_block_leases_total", "Short code id blocks leased", {{"result", "error"}})) {
+    if (!store_) {
+        throw std::runtime_error("DataStore dependency missing");
+    }
+    if (options_.blockSize == 0) {
+        throw std::runtime_error("short code block size must be positive");
+    }
+    options_.prefetchThreshold = std::clamp(options_.prefetchThreshold, 0.0, 1.0);
+}
+
+std::string ShortCodeAllocator::codeForId(uint64_t id, uint64_t key) {
+    if (id >= kCodeSpace) {
+        throw std::out_of_range("short code id space exhausted");
+    }
+    auto scrambled = feistel(id, key);
+    while (scrambled >= kCodeSpace) {
+        scrambled = feistel(scrambled, key);
+    }
+    return Base62::encodeFast7(scrambled);
+}
+
+void ShortCodeAllocator::next(CodeCallback callback) {
+    std::optional<uint64_t> id;
+    bool startLease = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_.remaining() == 0 && spare_) {
+            current_ = *spare_;
+            spare_.reset();
+        }
+        if (current_.remaining() > 0) {
+            id = current_.next++;
+        } else {
+            waiters_.push_back(std::move(callback));
+        }
+        startLease = needsLease();
+    }
+    if (startLease) {
+        lease();
+    }
+    if (id) {
+        callback(codeForId(*id, options_.scrambleKey));
+    }
+}
+
+bool ShortCodeAllocator::needsLease() {
+    if (leasing_ || spare_) {
+        return false;
+    }
+    const auto threshold = static_cast<uint64_t>(options_.blockSize * options_.prefetchThreshold);
+    if (!waiters_.empty() || current_.remaining() <= threshold) {
+        leasing_ = true;
+        return true;
+    }
+    return false;
+}
+
+void ShortCodeAllocator::lease() {
+    try {
+        store_->leaseIdBlockAsync(
+            options_.blockSize,
+            [this](uint64_t first) { onLeased(first); },
+            [this](const std::exception&) { onLeaseFailed(); });
+    } catch (const std::exception&) {
+        onLeaseFailed();
+    }
+}
+
+void ShortCodeAllocator::onLeased(uint64_t first) {
+    if (first >= kCodeSpace) {
+        onLeaseFailed();
+        return;
+    }
+    leases_.inc();
+    std::vector<std::pair<CodeCallback, uint64_t>> ready;
+    bool startLease = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leasing_ = false;
+        Range block{first, std::min(first + options_.blockSize, kCodeSpace)};
+        if (current_.remaining() == 0) {
+            current_ = block;
+        } else {
+            spare_ = block;
+        }
+        size_t served = 0;
+        while (served < waiters_.size() && current_.remaining() > 0) {
+            ready.emplace_back(std::move(waiters_[served]), current_.next++);
+            ++served;
+        }
+        waiters_.erase(waiters_.begin(), waiters_.begin() + static_cast<std::ptrdiff_t>(served));
+        if (current_.remaining() == 0 && spare_) {
+            current_ = *spare_;
+            spare_.reset();
+        }
+        startLease = needsLease();
+    }
+    if (startLease) {
+        lease();
+    }
+    for (auto& [callback, id] : ready) {
+        callback(codeForId(id, options_.scrambleKey));
+    }
+}
+
+void ShortCodeAllocator::onLeaseFailed() {
+    leaseFailures_.inc();
+    std::vector<CodeCallback> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leasing_ = false;
+        failed.swap(waiters_);
+    }
+    for (auto& callback : failed) {
+        callback(std::nullopt);
+    }
+}
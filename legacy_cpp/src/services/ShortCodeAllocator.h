@@ -0,0 +1,64 @@
+#pragma once
+#include "DataStore.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+class Counter;
+
+// Hands out collision-free short codes. Each instance leases blocks of
+// integer ids from Postgres and maps every id through a keyed permutation of
+// [0, 62^7) before base62 encoding, so consecutive ids give unrelated codes
+// and no two ids ever give the same code. The next block is leased in the
+// background once the current one runs low.
+class ShortCodeAllocator {
+public:
+    struct Options {
+        uint64_t blockSize{1000};
+        // Must be identical on every instance sharing a database.
+        uint64_t scrambleKey{0x5deece66dULL};
+        // Fraction of a block left when the next lease is started.
+        double prefetchThreshold{0.25};
+    };
+
+    // std::nullopt when no block could be leased.
+    using CodeCallback = std::function<void(std::optional<std::string>)>;
+
+    ShortCodeAllocator(std::shared_ptr<DataStore> store, Options options);
+
+    // Runs callback inline when the current block has ids left, otherwise
+    // once the next lease completes (on a DB client loop thread).
+    void next(CodeCallback callback);
+
+    static constexpr uint64_t kCodeSpace = 3521614606208ULL;  // 62^7
+    static std::string codeForId(uint64_t id, uint64_t key);
+
+private:
+    struct Range {
+        uint64_t next{0};
+        uint64_t end{0};
+        uint64_t remaining() const { return end - next; }
+    };
+
+    std::shared_ptr<DataStore> store_;
+    Options options_;
+
+    std::mutex mutex_;
+    Range current_;
+    std::optional<Range> spare_;
+    bool leasing_{false};
+    std::vector<CodeCallback> waiters_;
+
+    Counter& leases_;
+    Counter& leaseFailures_;
+
+    // Caller holds mutex_; returns true when the caller must start a lease.
+    bool needsLease();
+    void lease();
+    void onLeased(uint64_t first);
+    void onLeaseFailed();
+};
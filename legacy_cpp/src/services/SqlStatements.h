@@ -0,0 +1,146 @@
+#pragma once
+#include <array>
+
+// Every fixed query DataStore runs, with the label its metrics are exported
+// under. Drogon's Postgres client prepares a parameterised statement the
+// first time a pooled connection sees its text and reuses the prepared plan
+// from then on, so the text of each statement must be a constant: SQL built
+// per call would be parsed and planned again every time.
+struct SqlStatement {
+    const char* name;
+    const char* sql;
+};
+
+namespace sql {
+inline constexpr SqlStatement kPing{"ping", "SELECT 1"};
+
+inline constexpr SqlStatement kResolveUrl{
+    "resolve_url",
+    "SELECT url, expires_at FROM url_mapping WHERE code=$1 AND (expires_at IS NULL OR expires_at > NOW())"};
+
+inline constexpr SqlStatement kGetUrlInfo{
+    "get_url_info",
+    "SELECT m.url, (m.expires_at IS NOT NULL) AS ttl_active, COALESCE(s.clicks, 0) AS clicks, s.last_click_at "
+    "FROM url_mapping m LEFT JOIN url_click_stats s ON s.code = m.code "
+    "WHERE m.code=$1 AND (m.expires_at IS NULL OR m.expires_at > NOW())"};
+
+inline constexpr SqlStatement kLeaseIdBlock{
+    "lease_id_block",
+    "UPDATE short_code_allocator SET next_id = next_id + $1 WHERE id = 1 RETURNING next_id - $1 AS first_id"};
+
+inline constexpr SqlStatement kFindUserByEmail{
+    "find_user_by_email",
+    "SELECT id, name, email, password_hash FROM app_user WHERE email=$1"};
+
+inline constexpr SqlStatement kCreateUser{
+    "create_user",
+    "INSERT INTO app_user(name, email, password_hash) VALUES($1, $2, $3) RETURNING id"};
+
+inline constexpr SqlStatement kListUrlsFirstPage{
+    "list_urls_for_user",
+    "SELECT m.code, m.url, m.created_at, m.expires_at, COALESCE(s.clicks, 0) AS clicks, s.last_click_at "
+    "FROM url_mapping m LEFT JOIN url_click_stats s ON s.code = m.code "
+    "WHERE m.user_id=$1 ORDER BY m.created_at DESC, m.code DESC LIMIT $2"};
+
+// The row comparison is the keyset condition; the plain created_at bound lets
+// the planner use it as an index condition on idx_url_mapping_user_created.
+// Cursor timestamps travel as integer microseconds so no precision is lost.
+inline constexpr SqlStatement kListUrlsAfter{
+    "list_urls_for_user_after",
+    "SELECT m.code, m.url, m.created_at, m.expires_at, COALESCE(s.clicks, 0) AS clicks, s.last_click_at "
+    "FROM url_mapping m LEFT JOIN url_click_stats s ON s.code = m.code "
+    "WHERE m.user_id=$1 AND m.created_at <= TIMESTAMPTZ 'epoch' + $2::bigint * INTERVAL '1 microsecond' "
+    "AND (m.created_at, m.code) < (TIMESTAMPTZ 'epoch' + $2::bigint * INTERVAL '1 microsecond', $3) "
+    "ORDER BY m.created_at DESC, m.code DESC LIMIT $4"};
+
+inline constexpr SqlStatement kCountMappings{"count_mappings", "SELECT COUNT(*) AS n FROM url_mapping"};
+
+inline constexpr SqlStatement kListMappingsAfter{
+    "list_mappings_after",
+    "SELECT code, url, expires_at FROM url_mapping WHERE code > $1 "
+    "AND (expires_at IS NULL OR expires_at > NOW()) ORDER BY code LIMIT $2"};
+
+// Newest links across all users, for the startup cache warm-up. Walks
+// idx_url_mapping_created with the same keyset cursor as the user list.
+inline constexpr SqlStatement kListRecentMappings{
+    "list_recent_mappings",
+    "SELECT code, url, created_at, expires_at FROM url_mapping "
+    "WHERE expires_at IS NULL OR expires_at > NOW() ORDER BY created_at DESC, code DESC LIMIT $1"};
+
+inline constexpr SqlStatement kListRecentMappingsAfter{
+    "list_recent_mappings_after",
+    "SELECT code, url, created_at, expires_at FROM url_mapping "
+    "WHERE created_at <= TIMESTAMPTZ 'epoch' + $1::bigint * INTERVAL '1 microsecond' "
+    "AND (created_at, code) < (TIMESTAMPTZ 'epoch' + $1::bigint * INTERVAL '1 microsecond', $2) "
+    "AND (expires_at IS NULL OR expires_at > NOW()) ORDER BY created_at DESC, code DESC LIMIT $3"};
+
+// The codes travel as one text[] literal so the statement text, and its
+// prepared plan, do not depend on how many are looked up.
+inline constexpr SqlStatement kLookupMappings{
+    "lookup_mappings",
+    "SELECT code, url, expires_at FROM url_mapping "
+    "WHERE code = ANY($1::text[]) AND (expires_at IS NULL OR expires_at > NOW())"};
+
+// One row per code, so the batch must not repeat a code: ON CONFLICT cannot
+// update the same row twice in one statement. Arrays keep the text constant
+// whatever the batch size.
+inline constexpr SqlStatement kUpsertClickStats{
+    "upsert_click_stats",
+    "INSERT INTO url_click_stats(code, clicks, last_click_at) "
+    "SELECT c, n, TIMESTAMPTZ 'epoch' + t * INTERVAL '1 microsecond' "
+    "FROM unnest($1::text[], $2::bigint[], $3::bigint[]) AS u(c, n, t) "
+    "ON CONFLICT (code) DO UPDATE SET clicks = url_click_stats.clicks + EXCLUDED.clicks, "
+    "last_click_at = GREATEST(url_click_stats.last_click_at, EXCLUDED.last_click_at)"};
+
+// Runs on replicas only. receiver is 'streaming' only while the WAL receiver
+// streams and has heard from the primary within $1 milliseconds; a standby
+// that lost its primary has replayed all it received and would otherwise
+// report no lag forever. lag_seconds is 0 when everything received has been
+// replayed, so an idle primary does not show up as growing lag, and NULL
+// when nothing has been replayed yet. Without pg_read_all_stats the receiver
+// row is all NULL but its pid, which reads as 'hidden'.
+inline constexpr SqlStatement kReplicaLag{
+    "replica_lag",
+    "SELECT CASE WHEN NOT pg_is_in_recovery() THEN 'not_standby' "
+    "WHEN r.pid IS NULL THEN 'stopped' "
+    "WHEN r.status IS NULL THEN 'hidden' "
+    "WHEN r.status <> 'streaming' THEN r.status "
+    "WHEN r.last_msg_receipt_time IS NULL "
+    "OR NOW() - r.last_msg_receipt_time > $1::bigint * INTERVAL '1 millisecond' THEN 'silent' "
+    "ELSE 'streaming' END AS receiver, "
+    "CASE WHEN pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0 "
+    "ELSE EXTRACT(EPOCH FROM NOW() - pg_last_xact_replay_timestamp()) END AS lag_seconds "
+    "FROM (SELECT 1) AS one LEFT JOIN pg_stat_wal_receiver r ON true"};
+
+// Delivered to every session LISTENing on the channel once the sending
+// transaction commits; Postgres caps the payload below 8000 bytes.
+inline constexpr SqlStatement kNotify{"notify", "SELECT pg_notify($1, $2)"};
+
+inline constexpr SqlStatement kListCodesAfter{
+    "list_codes_after",
+    "SELECT code FROM url_mapping WHERE code > $1 ORDER BY code LIMIT $2"};
+
+// The multi-row insert is not listed: its text depends on the row count, so
+// Drogon keeps one prepared variant per batch size it has seen.
+inline constexpr const char* kInsertMappingsBatchName = "insert_mappings_batch";
+
+inline constexpr std::array kAll{
+    &kPing,
+    &kResolveUrl,
+    &kGetUrlInfo,
+    &kLeaseIdBlock,
+    &kFindUserByEmail,
+    &kCreateUser,
+    &kListUrlsFirstPage,
+    &kListUrlsAfter,
+    &kCountMappings,
+    &kListCodesAfter,
+    &kListMappingsAfter,
+    &kListRecentMappings,
+    &kListRecentMappingsAfter,
+    &kLookupMappings,
+    &kUpsertClickStats,
+    &kReplicaLag,
+    &kNotify,
+};
+}  // namespace sql
@@ -0,0 +1,35 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// Draws ranks in [0, n) with P(rank k) proportional to 1 / (k + 1)^s using a
+// precomputed CDF; sampling is a binary search.
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double exponent) : cdf_(std::max<size_t>(n, 1)) {
+        double total = 0.0;
+        for (size_t k = 0; k < cdf_.size(); ++k) {
+            total += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+            cdf_[k] = total;
+        }
+        for (auto& value : cdf_) {
+            value /= total;
+        }
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) const {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto it = std::lower_bound(cdf_.begin(), cdf_.end(), uniform(rng));
+        if (it == cdf_.end()) {
+            return cdf_.size() - 1;
+        }
+        return static_cast<size_t>(it - cdf_.begin());
+    }
+
+private:
+    std::vector<double> cdf_;
+};
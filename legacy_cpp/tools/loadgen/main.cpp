@@ -0,0 +1,428 @@
+// Closed-loop HTTP load generator for url_shortener.
+//
+// Registers a throwaway user, seeds a pool of short codes, then keeps
+// --concurrency requests in flight for --duration seconds using the operation
+// mix given by --mix. Resolve targets are drawn from a Zipf distribution over
+// the seeded codes. Prints throughput and p50/p99/p999 latency per operation,
+// plus a single JSON line when --json is given. 429 responses are counted
+// apart from errors, so a run against a rate-limited server shows as such.
+#include "ZipfSampler.h"
+#include <drogon/HttpClient.h>
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+#include <json/json.h>
+#include <trantor/net/EventLoopThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace drogon;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+enum Op { kResolve = 0, kShorten, kList, kOpCount };
+const char* kOpNames[kOpCount] = {"resolve", "shorten", "list"};
+
+struct LoadOptions {
+    std::string baseUrl{"http://127.0.0.1:9090"};
+    int durationSeconds{30};
+    int warmupSeconds{5};
+    size_t concurrency{64};
+    size_t threads{4};
+    size_t seedCodes{10000};
+    double zipfExponent{1.1};
+    double timeoutSeconds{5.0};
+    unsigned mix[kOpCount]{95, 4, 1};
+    bool json{false};
+};
+
+void usage() {
+    std::cerr << "usage: url_shortener_loadgen [--base-url URL] [--duration S] [--warmup S]\n"
+                 "         [--concurrency N] [--threads N] [--codes N] [--zipf S]\n"
+                 "         [--mix resolve=95,shorten=4,list=1] [--timeout S] [--json]\n";
+}
+
+void parseMix(const std::string& spec, LoadOptions& options) {
+    unsigned parsed[kOpCount]{0, 0, 0};
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("bad --mix entry: " + item);
+        }
+        auto name = item.substr(0, eq);
+        auto weight = static_cast<unsigned>(std::stoul(item.substr(eq + 1)));
+        bool known = false;
+        for (int op = 0; op < kOpCount; ++op) {
+            if (name == kOpNames[op]) {
+                parsed[op] = weight;
+                known = true;
+            }
+        }
+        if (!known) {
+            throw std::runtime_error("unknown operation in --mix: " + name);
+        }
+    }
+    if (parsed[kResolve] + parsed[kShorten] + parsed[kList] == 0) {
+        throw std::runtime_error("--mix must have a positive weight");
+    }
+    std::copy(std::begin(parsed), std::end(parsed), std::begin(options.mix));
+}
+
+LoadOptions parseArgs(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(arg + " needs a value");
+            }
+            return argv[++i];
+        };
+        if (arg == "--base-url") {
+            options.baseUrl = next();
+        } else if (arg == "--duration") {
+            options.durationSeconds = std::stoi(next());
+        } else if (arg == "--warmup") {
+            options.warmupSeconds = std::stoi(next());
+        } else if (arg == "--concurrency") {
+            options.concurrency = std::max<size_t>(std::stoul(next()), 1);
+        } else if (arg == "--threads") {
+            options.threads = std::max<size_t>(std::stoul(next()), 1);
+        } else if (arg == "--codes") {
+            options.seedCodes = std::max<size_t>(std::stoul(next()), 1);
+        } else if (arg == "--zipf") {
+            options.zipfExponent = std::stod(next());
+        } else if (arg == "--timeout") {
+            options.timeoutSeconds = std::stod(next());
+        } else if (arg == "--mix") {
+            parseMix(next(), options);
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--help" || arg == "-h") {
+            usage();
+            std::exit(0);
+        } else {
+            usage();
+            throw std::runtime_error("unknown argument: " + arg);
+        }
+    }
+    return options;
+}
+
+// Per-worker results; each worker only runs on its client's loop thread.
+struct WorkerStats {
+    std::vector<uint32_t> latencyMicros[kOpCount];
+    uint64_t errors[kOpCount]{};
+    uint64_t rateLimited[kOpCount]{};
+};
+
+struct Shared {
+    LoadOptions options;
+    std::string token;
+    std::vector<std::string> codes;
+    std::unique_ptr<ZipfSampler> zipf;
+    Clock::time_point measureFrom;
+    Clock::time_point stopAt;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t running{0};
+};
+
+HttpRequestPtr shortenRequest(const std::string& token, uint64_t n) {
+    Json::Value body;
+    body["url"] = "https://example.com/loadgen/" + std::to_string(n);
+    auto req = HttpRequest::newHttpJsonRequest(body);
+    req->setMethod(Post);
+    req->setPath("/api/v1/shorten");
+    req->addHeader("Authorization", "Bearer " + token);
+    return req;
+}
+
+class Worker : public std::enable_shared_from_this<Worker> {
+public:
+    Worker(std::shared_ptr<Shared> shared, HttpClientPtr client, uint64_t seed)
+        : shared_(std::move(shared)), client_(std::move(client)), rng_(seed) {}
+
+    void start() {
+        issue();
+    }
+
+    WorkerStats stats;
+
+private:
+    std::shared_ptr<Shared> shared_;
+    HttpClientPtr client_;
+    std::mt19937_64 rng_;
+    uint64_t sequence_{0};
+
+    Op pickOp() {
+        const auto& mix = shared_->options.mix;
+        std::uniform_int_distribution<unsigned> dist(0, mix[kResolve] + mix[kShorten] + mix[kList] - 1);
+        auto roll = dist(rng_);
+        if (roll < mix[kResolve]) {
+            return kResolve;
+        }
+        return roll < mix[kResolve] + mix[kShorten] ? kShorten : kList;
+    }
+
+    void issue() {
+        if (Clock::now() >= shared_->stopAt) {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            if (--shared_->running == 0) {
+                shared_->done.notify_all();
+            }
+            return;
+        }
+        const auto op = pickOp();
+        HttpRequestPtr req;
+        switch (op) {
+        case kResolve:
+            req = HttpRequest::newHttpRequest();
+            req->setMethod(Get);
+            req->setPath("/" + shared_->codes[(*shared_->zipf)(rng_)]);
+            break;
+        case kShorten:
+            req = shortenRequest(shared_->token, rng_() ^ ++sequence_);
+            break;
+        default:
+            req = HttpRequest::newHttpRequest();
+            req->setMethod(Get);
+            req->setPath("/api/v1/urls");
+            req->setParameter("limit", "50");
+            req->addHeader("Authorization", "Bearer " + shared_->token);
+            break;
+        }
+        const auto started = Clock::now();
+        client_->sendRequest(
+            req,
+            [self = shared_from_this(), op, started](ReqResult result, const HttpResponsePtr& resp) {
+                const auto finished = Clock::now();
+                if (started >= self->shared_->measureFrom && finished <= self->shared_->stopAt) {
+                    const bool ok = result == ReqResult::Ok && resp &&
+                                    (resp->statusCode() == k200OK || resp->statusCode() == k302Found);
+                    if (ok) {
+                        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count();
+                        self->stats.latencyMicros[op].push_back(static_cast<uint32_t>(micros));
+                    } else if (result == ReqResult::Ok && resp && resp->statusCode() == k429TooManyRequests) {
+                        ++self->stats.rateLimited[op];
+                    } else {
+                        ++self->stats.errors[op];
+                    }
+                }
+                self->issue();
+            },
+            shared_->options.timeoutSeconds);
+    }
+};
+
+std::string registerUser(const HttpClientPtr& client, double timeout) {
+    const auto stamp = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    Json::Value body;
+    body["name"] = "Load Generator";
+    body["email"] = "loadgen_" + stamp + "@example.com";
+    body["password"] = "loadgen-" + stamp;
+    auto req = HttpRequest::newHttpJsonRequest(body);
+    req->setMethod(Post);
+    req->setPath("/api/v1/register");
+    auto [result, resp] = client->sendRequest(req, timeout);
+    if (result != ReqResult::Ok || !resp || resp->statusCode() != k200OK) {
+        throw std::runtime_error("register failed; is the server up at the base URL?");
+    }
+    auto json = resp->getJsonObject();
+    if (!json || !(*json)["token"].isString()) {
+        throw std::runtime_error("register response had no token");
+    }
+    return (*json)["token"].asString();
+}
+
+// Shortens options.seedCodes URLs with up to `concurrency` requests in flight.
+std::vector<std::string> seedCodes(const std::shared_ptr<Shared>& shared,
+                                   const std::vector<HttpClientPtr>& clients) {
+    const auto total = shared->options.seedCodes;
+    std::vector<std::string> codes;
+    codes.reserve(total);
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t issued = 0;
+    size_t finished = 0;
+    size_t failures = 0;
+    size_t rateLimited = 0;
+
+    std::function<void(const HttpClientPtr&)> next = [&](const HttpClientPtr& client) {
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (issued >= total) {
+                return;
+            }
+            n = issued++;
+        }
+        client->sendRequest(
+            shortenRequest(shared->token, n),
+            [&, client](ReqResult result, const HttpResponsePtr& resp) {
+                // Issue the next request first: once `finished` reaches
+                // `total` the waiting thread may unwind these locals.
+                next(client);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto json = resp ? resp->getJsonObject() : nullptr;
+                    if (result == ReqResult::Ok && json && (*json)["code"].isString()) {
+                        codes.push_back((*json)["code"].asString());
+                    } else if (result == ReqResult::Ok && resp && resp->statusCode() == k429TooManyRequests) {
+                        ++rateLimited;
+                    } else {
+                        ++failures;
+                    }
+                    ++finished;
+                    if (finished == total) {
+                        done.notify_all();
+                    }
+                }
+            },
+            shared->options.timeoutSeconds);
+    };
+    for (const auto& client : clients) {
+        next(client);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finished == total; });
+    if (rateLimited > 0) {
+        std::cerr << "warning: " << rateLimited << " seed shortens were rate limited (429); "
+                  << "results measure the limiter, not the service\n";
+    }
+    if (codes.empty()) {
+        throw std::runtime_error("seeding produced no codes");
+    }
+    if (failures > 0) {
+        std::cerr << "warning: " << failures << " seed shortens failed\n";
+    }
+    return codes;
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto rank = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return static_cast<double>(sorted[std::min(rank, sorted.size() - 1)]) / 1000.0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    try {
+        options = parseArgs(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    trantor::EventLoopThreadPool loops(options.threads, "loadgen");
+    loops.start();
+
+    auto shared = std::make_shared<Shared>();
+    shared->options = options;
+
+    std::vector<HttpClientPtr> clients;
+    clients.reserve(options.concurrency);
+    for (size_t i = 0; i < options.concurrency; ++i) {
+        clients.push_back(HttpClient::newHttpClient(options.baseUrl, loops.getNextLoop()));
+    }
+
+    try {
+        shared->token = registerUser(clients.front(), options.timeoutSeconds);
+        std::cerr << "seeding " << options.seedCodes << " codes...\n";
+        shared->codes = seedCodes(shared, clients);
+    } catch (const std::exception& e) {
+        std::cerr << "setup failed: " << e.what() << "\n";
+        return 1;
+    }
+    // Decouple popularity rank from creation order.
+    std::shuffle(shared->codes.begin(), shared->codes.end(), std::mt19937_64{7});
+    shared->zipf = std::make_unique<ZipfSampler>(shared->codes.size(), options.zipfExponent);
+
+    const auto now = Clock::now();
+    shared->measureFrom = now + std::chrono::seconds(options.warmupSeconds);
+    shared->stopAt = shared->measureFrom + std::chrono::seconds(options.durationSeconds);
+    shared->running = clients.size();
+
+    std::cerr << "running " << options.concurrency << " connections for "
+              << options.warmupSeconds << "s warm-up + " << options.durationSeconds << "s...\n";
+    std::vector<std::shared_ptr<Worker>> workers;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        workers.push_back(std::make_shared<Worker>(shared, clients[i], 0x5eed + i));
+    }
+    for (auto& worker : workers) {
+        worker->start();
+    }
+    {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->done.wait(lock, [&] { return shared->running == 0; });
+    }
+
+    Json::Value report;
+    report["concurrency"] = static_cast<Json::UInt64>(options.concurrency);
+    report["duration_seconds"] = options.durationSeconds;
+    report["zipf_exponent"] = options.zipfExponent;
+    report["seed_codes"] = static_cast<Json::UInt64>(shared->codes.size());
+
+    std::printf("%-8s %10s %8s %8s %12s %9s %9s %9s %9s\n",
+                "op", "requests", "errors", "429s", "req/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+    uint64_t totalRequests = 0;
+    for (int op = 0; op < kOpCount; ++op) {
+        std::vector<uint32_t> merged;
+        uint64_t errors = 0;
+        uint64_t rateLimited = 0;
+        for (const auto& worker : workers) {
+            const auto& samples = worker->stats.latencyMicros[op];
+            merged.insert(merged.end(), samples.begin(), samples.end());
+            errors += worker->stats.errors[op];
+            rateLimited += worker->stats.rateLimited[op];
+        }
+        std::sort(merged.begin(), merged.end());
+        const double rps = static_cast<double>(merged.size()) / std::max(options.durationSeconds, 1);
+        const double maxMs = merged.empty() ? 0.0 : merged.back() / 1000.0;
+        totalRequests += merged.size();
+        std::printf("%-8s %10zu %8llu %8llu %12.1f %9.3f %9.3f %9.3f %9.3f\n",
+                    kOpNames[op], merged.size(), static_cast<unsigned long long>(errors),
+                    static_cast<unsigned long long>(rateLimited), rps,
+                    percentile(merged, 0.50), percentile(merged, 0.99), percentile(merged, 0.999), maxMs);
+
+        Json::Value entry;
+        entry["requests"] = static_cast<Json::UInt64>(merged.size());
+        entry["errors"] = static_cast<Json::UInt64>(errors);
+        entry["rate_limited"] = static_cast<Json::UInt64>(rateLimited);
+        entry["rps"] = rps;
+        entry["p50_ms"] = percentile(merged, 0.50);
+        entry["p99_ms"] = percentile(merged, 0.99);
+        entry["p999_ms"] = percentile(merged, 0.999);
+        entry["max_ms"] = maxMs;
+        report["ops"][kOpNames[op]] = entry;
+    }
+    const double totalRps = static_cast<double>(totalRequests) / std::max(options.durationSeconds, 1);
+    std::printf("%-8s %10llu %8s %8s %12.1f\n", "total", static_cast<unsigned long long>(totalRequests), "", "",
+                totalRps);
+    report["total_rps"] = totalRps;
+
+    if (options.json) {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        std::cout << Json::writeString(builder, report) << std::endl;
+    }
+    return 0;
+}
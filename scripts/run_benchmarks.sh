@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Build and run the C++ microbenchmarks, writing Google Benchmark JSON that can
+# be compared across releases (e.g. with benchmark's tools/compare.py).
+# Usage: ./scripts/run_benchmarks.sh [extra --benchmark_* flags]
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+SRC_DIR=${SRC_DIR:-"$ROOT_DIR/legacy_cpp"}
+BUILD_DIR=${BUILD_DIR:-"$SRC_DIR/build-bench"}
+OUT_DIR=${OUT_DIR:-"$ROOT_DIR/bench_results"}
+REPETITIONS=${REPETITIONS:-5}
+
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DURL_SHORTENER_BUILD_BENCH=ON
+cmake --build "$BUILD_DIR" --target url_shortener_bench -j
+
+if [ ! -x "$BUILD_DIR/url_shortener_bench" ]; then
+    echo "url_shortener_bench was not built (is Google Benchmark installed?)" >&2
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+REV=$(git -C "$ROOT_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT_FILE="$OUT_DIR/bench-$REV-$(date +%Y%m%d%H%M%S).json"
+
+"$BUILD_DIR/url_shortener_bench" \
+    --benchmark_repetitions="$REPETITIONS" \
+    --benchmark_report_aggregates_only=true \
+    --benchmark_out="$OUT_FILE" \
+    --benchmark_out_format=json \
+    "$@"
+
+echo "Results written to $OUT_FILE"
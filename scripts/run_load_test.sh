@@ -0,0 +1,160 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# End-to-end capacity test: starts Postgres + Redis, applies the migrations,
+# launches url_shortener and drives it with url_shortener_loadgen.
+#
+# Usage: ./scripts/run_load_test.sh [extra loadgen flags]
+#   e.g. DURATION=60 CONCURRENCY=128 MIX=resolve=95,shorten=4,list=1 ./scripts/run_load_test.sh
+#
+# By default throwaway Postgres/Redis containers are started with Docker.
+# Set USE_DOCKER=0 and point DATABASE_URL / REDIS_HOST / REDIS_PORT /
+# REDIS_PASSWORD at existing local instances instead.
+#
+# REPLICA=1 also starts a streaming standby of the Postgres container and
+# passes it to the server as a read replica (with USE_DOCKER=0, set
+# DATABASE_REPLICA_URLS yourself).
+#
+# The server runs with the repo config.json minus its rate limits, which would
+# otherwise cap the single load generator address. RATE_LIMIT=1 keeps them.
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+SRC_DIR=${SRC_DIR:-"$ROOT_DIR/legacy_cpp"}
+BUILD_DIR=${BUILD_DIR:-"$SRC_DIR/build-release"}
+OUT_DIR=${OUT_DIR:-"$ROOT_DIR/bench_results"}
+
+USE_DOCKER=${USE_DOCKER:-1}
+REPLICA=${REPLICA:-0}
+PG_PORT=${PG_PORT:-55432}
+PG_REPLICA_PORT=${PG_REPLICA_PORT:-55433}
+REDIS_PORT=${REDIS_PORT:-56379}
+APP_PORT=${APP_PORT:-9090}
+
+DURATION=${DURATION:-30}
+WARMUP=${WARMUP:-5}
+CONCURRENCY=${CONCURRENCY:-64}
+THREADS=${THREADS:-4}
+CODES=${CODES:-10000}
+ZIPF=${ZIPF:-1.1}
+MIX=${MIX:-resolve=95,shorten=4,list=1}
+RATE_LIMIT=${RATE_LIMIT:-0}
+
+export JWT_SECRET=${JWT_SECRET:-loadtest-secret}
+export REDIS_PASSWORD=${REDIS_PASSWORD:-loadtest}
+
+PG_CONTAINER=urlshortener-loadtest-pg
+PG_REPLICA_CONTAINER=urlshortener-loadtest-pg-replica
+DOCKER_NETWORK=urlshortener-loadtest
+REDIS_CONTAINER=urlshortener-loadtest-redis
+SERVER_PID=""
+
+log() {
+    printf '[%s] %s\n' "$(date -Iseconds)" "$1" >&2
+}
+
+cleanup() {
+    if [ -n "$SERVER_PID" ] && kill -0 "$SERVER_PID" 2>/dev/null; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    if [ "$USE_DOCKER" = "1" ]; then
+        docker rm -f "$PG_CONTAINER" "$PG_REPLICA_CONTAINER" "$REDIS_CONTAINER" >/dev/null 2>&1 || true
+        docker network rm "$DOCKER_NETWORK" >/dev/null 2>&1 || true
+    fi
+}
+trap cleanup EXIT
+
+if [ "$USE_DOCKER" = "1" ]; then
+    log "Starting Postgres and Redis containers"
+    docker rm -f "$PG_CONTAINER" "$PG_REPLICA_CONTAINER" "$REDIS_CONTAINER" >/dev/null 2>&1 || true
+    docker network rm "$DOCKER_NETWORK" >/dev/null 2>&1 || true
+    docker network create "$DOCKER_NETWORK" >/dev/null
+    docker run -d --name "$PG_CONTAINER" --network "$DOCKER_NETWORK" -p "$PG_PORT:5432" \
+        -e POSTGRES_USER=app -e POSTGRES_PASSWORD=appsecret -e POSTGRES_DB=urlshortener \
+        postgres:16-alpine >/dev/null
+    docker run -d --name "$REDIS_CONTAINER" -p "$REDIS_PORT:6379" \
+        redis:7-alpine redis-server --requirepass "$REDIS_PASSWORD" >/dev/null
+    export DATABASE_URL="host=127.0.0.1 port=$PG_PORT dbname=urlshortener user=app password=appsecret"
+    export REDIS_HOST=127.0.0.1
+    for _ in $(seq 1 60); do
+        if docker exec "$PG_CONTAINER" pg_isready -U app -d urlshortener >/dev/null 2>&1; then
+            break
+        fi
+        sleep 1
+    done
+    for migration in "$ROOT_DIR"/db/migrations/*.sql; do
+        log "Applying $(basename "$migration")"
+        docker exec -i "$PG_CONTAINER" psql -q -v ON_ERROR_STOP=1 -U app -d urlshortener < "$migration"
+    done
+    if [ "$REPLICA" = "1" ]; then
+        log "Starting a streaming standby on :$PG_REPLICA_PORT"
+        docker exec "$PG_CONTAINER" sh -c \
+            'echo "host replication all all scram-sha-256" >> "$PGDATA/pg_hba.conf"'
+        docker exec "$PG_CONTAINER" psql -q -U app -d urlshortener -c 'SELECT pg_reload_conf()' >/dev/null
+        docker run -d --name "$PG_REPLICA_CONTAINER" --network "$DOCKER_NETWORK" -p "$PG_REPLICA_PORT:5432" \
+            --user postgres -e PGPASSWORD=appsecret --entrypoint sh postgres:16-alpine -c \
+            'pg_basebackup -h '"$PG_CONTAINER"' -U app -D "$PGDATA" -R -X stream && chmod 700 "$PGDATA" && exec postgres' \
+            >/dev/null
+        for _ in $(seq 1 60); do
+            if docker exec "$PG_REPLICA_CONTAINER" pg_isready -U app -d urlshortener >/dev/null 2>&1; then
+                break
+            fi
+            sleep 1
+        done
+        export DATABASE_REPLICA_URLS="host=127.0.0.1 port=$PG_REPLICA_PORT dbname=urlshortener user=app password=appsecret"
+    fi
+else
+    : "${DATABASE_URL:?DATABASE_URL must be set when USE_DOCKER=0}"
+    export REDIS_HOST=${REDIS_HOST:-127.0.0.1}
+    for migration in "$ROOT_DIR"/db/migrations/*.sql; do
+        log "Applying $(basename "$migration")"
+        psql "$DATABASE_URL" -q -v ON_ERROR_STOP=1 -f "$migration"
+    done
+fi
+export REDIS_PORT
+
+log "Building url_shortener and url_shortener_loadgen (Release)"
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release >/dev/null
+cmake --build "$BUILD_DIR" --target url_shortener url_shortener_loadgen -j
+
+# main() reads config.json and public/ relative to the working directory
+RUN_DIR="$BUILD_DIR/loadtest-run"
+mkdir -p "$RUN_DIR"
+ln -sfn "$ROOT_DIR/public" "$RUN_DIR/public"
+python3 - "$ROOT_DIR/config.json" "$RUN_DIR/config.json" "$RATE_LIMIT" <<'PY'
+import json, sys
+with open(sys.argv[1]) as f:
+    config = json.load(f)
+config.setdefault("rate_limit", {})["enabled"] = sys.argv[3] == "1"
+with open(sys.argv[2], "w") as f:
+    json.dump(config, f, indent=2)
+PY
+
+log "Starting url_shortener on :$APP_PORT (rate limits $([ "$RATE_LIMIT" = "1" ] && echo on || echo off))"
+(cd "$RUN_DIR" && exec "$BUILD_DIR/url_shortener") > "$BUILD_DIR/loadtest-server.log" 2>&1 &
+SERVER_PID=$!
+
+for _ in $(seq 1 60); do
+    if curl -fsS "http://127.0.0.1:$APP_PORT/api/v1/health" >/dev/null 2>&1; then
+        break
+    fi
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+        log "Server exited during startup; see $BUILD_DIR/loadtest-server.log"
+        exit 1
+    fi
+    sleep 1
+done
+
+mkdir -p "$OUT_DIR"
+REV=$(git -C "$ROOT_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT_FILE="$OUT_DIR/load-$REV-$(date +%Y%m%d%H%M%S).json"
+
+log "Running load: ${CONCURRENCY} connections, mix $MIX, zipf $ZIPF"
+"$BUILD_DIR/url_shortener_loadgen" \
+    --base-url "http://127.0.0.1:$APP_PORT" \
+    --duration "$DURATION" --warmup "$WARMUP" \
+    --concurrency "$CONCURRENCY" --threads "$THREADS" \
+    --codes "$CODES" --zipf "$ZIPF" --mix "$MIX" \
+    --json "$@" | tee /dev/stderr | tail -n 1 > "$OUT_FILE"
+
+log "Summary written to $OUT_FILE"